@@ -8,8 +8,12 @@
  */
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <math.h>
 
+#include "2d_draw.h"
+#include "2d_draw_simd.h"
+
 void _2d_draw_dot(
     uint8_t *rgbMap,
     uint32_t width, uint32_t height,
@@ -115,3 +119,263 @@ void _2d_draw_line(
     }
 }
 
+
+/*
+ *  参数方程裁剪的单边检查(Liang-Barsky)
+ *  参数:
+ *      p, q: 该边界的 p*t <= q 约束
+ *      t: [0]进入参数 [1]离开参数,根据约束收窄
+ *
+ *  返回: false/线段完全在边界外
+ */
+static bool _2d_clip_t(float p, float q, float t[2])
+{
+    float r;
+    if (p == 0)
+        return q >= 0;
+    r = q / p;
+    if (p < 0)
+    {
+        if (r > t[1])
+            return false;
+        if (r > t[0])
+            t[0] = r;
+    }
+    else
+    {
+        if (r < t[0])
+            return false;
+        if (r < t[1])
+            t[1] = r;
+    }
+    return true;
+}
+
+/*
+ *  求步进坐标 start + div * count 落在像素区间[min, max]内的步数范围,收窄到[countMin, countMax]
+ *
+ *  返回: false/没有步数落在区间内
+ */
+static bool _2d_step_range(float start, float div, int32_t min, int32_t max, int32_t *countMin, int32_t *countMax)
+{
+    float c1, c2;
+    //该轴不动
+    if (div == 0)
+        return start >= min && start < max + 1;
+    c1 = (min - start) / div;
+    c2 = (max + 1 - start) / div;
+    if (c1 > c2)
+    {
+        float tmp = c1;
+        c1 = c2;
+        c2 = tmp;
+    }
+    //多留一步余量,边界上的点由逐点检查确定
+    if (c1 - 1 > *countMax || c2 + 1 < *countMin)
+        return false;
+    if (c1 - 1 > *countMin)
+        *countMin = (int32_t)(c1 - 1);
+    if (c2 + 1 < *countMax)
+        *countMax = (int32_t)(c2 + 1);
+    return *countMin <= *countMax;
+}
+
+/*
+ *  带深度测试的直线(先裁剪到屏幕范围,再逐像素步进并插值深度)
+ *  参数:
+ *      rgbMap: RGB图像缓冲区
+ *      depthMap: 深度缓冲区,与 rgbMap 像素一一对应,深度值小于缓冲区中的值时才绘制
+ *      width, height: 图像宽高
+ *      xy[4]: 2个屏幕坐标(浮点)
+ *      depth[2]: 2个端点的深度(到相机的距离,要求大于0),像素深度按透视校正插值
+ *      argbColor: 线颜色
+ *      rect[4]: 只绘制落在该矩形内的像素 xMin,yMin,xMax,yMax (闭区间,置NULL时为整个屏幕)
+ *               分块绘制时各块的结果与整屏绘制逐像素一致
+ */
+void _2d_draw_line_depth(
+    uint8_t *rgbMap, float *depthMap,
+    uint32_t width, uint32_t height,
+    float xy[4], float depth[2],
+    uint32_t argbColor, int32_t *rect)
+{
+    float t[2] = {0, 1}; //裁剪后保留的参数范围
+    float dx = xy[2] - xy[0];
+    float dy = xy[3] - xy[1];
+    float rz0 = 1 / depth[0], rz1 = 1 / depth[1]; //深度倒数在屏幕空间是线性的
+    float x, y, rz, xDiv, yDiv, rzDiv, z;
+    float distance;
+    int32_t count, countMin, countMax, steps, xCount, yCount;
+    int32_t xMin = 0, yMin = 0, xMax = width - 1, yMax = height - 1;
+    uint32_t offset;
+    uint8_t r = (argbColor >> 16) & 0xFF;
+    uint8_t g = (argbColor >> 8) & 0xFF;
+    uint8_t b = (argbColor >> 0) & 0xFF;
+
+    //绘制范围
+    if (rect)
+    {
+        xMin = rect[0] > xMin ? rect[0] : xMin;
+        yMin = rect[1] > yMin ? rect[1] : yMin;
+        xMax = rect[2] < xMax ? rect[2] : xMax;
+        yMax = rect[3] < yMax ? rect[3] : yMax;
+    }
+
+    //裁剪到屏幕范围 [0, width) x [0, height)
+    if (!_2d_clip_t(-dx, xy[0], t) ||
+        !_2d_clip_t(dx, width - xy[0], t) ||
+        !_2d_clip_t(-dy, xy[1], t) ||
+        !_2d_clip_t(dy, height - xy[1], t))
+        return;
+
+    //裁剪后的起点
+    x = xy[0] + dx * t[0];
+    y = xy[1] + dy * t[0];
+    rz = rz0 + (rz1 - rz0) * t[0];
+    dx *= t[1] - t[0];
+    dy *= t[1] - t[0];
+
+    //选取基本增量坐标轴,每步走一个像素
+    distance = dx > 0 ? dx : -dx;
+    if (dy > distance)
+        distance = dy;
+    else if (-dy > distance)
+        distance = -dy;
+    steps = (int32_t)distance;
+    if (steps > 0)
+    {
+        xDiv = dx / steps;
+        yDiv = dy / steps;
+        rzDiv = (rz1 - rz0) * (t[1] - t[0]) / steps;
+    }
+    else
+        xDiv = yDiv = rzDiv = 0;
+
+    //只走落在 rect 内的那一段步数(前后各多留一步,由逐点检查兜底)
+    countMin = 0;
+    countMax = steps;
+    if (rect)
+    {
+        if (!_2d_step_range(x, xDiv, rect[0], rect[2], &countMin, &countMax) ||
+            !_2d_step_range(y, yDiv, rect[1], rect[3], &countMin, &countMax))
+            return;
+    }
+
+    //每一步的坐标都从起点直接算出,与从哪一步开始无关
+    for (count = countMin; count <= countMax; count++)
+    {
+        xCount = (int32_t)(x + xDiv * count);
+        yCount = (int32_t)(y + yDiv * count);
+        //范围检查(裁剪边界上的点)
+        if (xCount < xMin || xCount > xMax || yCount < yMin || yCount > yMax)
+            continue;
+        offset = yCount * width + xCount;
+        //被遮挡
+        z = 1 / (rz + rzDiv * count);
+        if (!(z < depthMap[offset]))
+            continue;
+        //占用该点
+        depthMap[offset] = z;
+        //画点
+        rgbMap[offset * 3 + 0] = r;
+        rgbMap[offset * 3 + 1] = g;
+        rgbMap[offset * 3 + 2] = b;
+    }
+}
+
+/*
+ *  带深度测试的三角形填充(边函数法,只遍历三角形包围盒内的像素)
+ *  参数:
+ *      rgbMap: RGB图像缓冲区
+ *      depthMap: 深度缓冲区,与 rgbMap 像素一一对应,深度值小于缓冲区中的值时才绘制
+ *      width, height: 图像宽高
+ *      xy[6]: 3个屏幕坐标(浮点,像素(x,y)的中心位于(x+0.5,y+0.5))
+ *      depth[3]: 3个顶点的深度(到相机的距离,要求大于0),像素深度按透视校正插值
+ *      argbColor: 填充颜色
+ *      rect[4]: 只绘制落在该矩形内的像素 xMin,yMin,xMax,yMax (闭区间,置NULL时为整个屏幕)
+ *               分块绘制时各块的结果与整屏绘制逐像素一致
+ */
+void _2d_draw_triangle_depth(
+    uint8_t *rgbMap, float *depthMap,
+    uint32_t width, uint32_t height,
+    float xy[6], float depth[3],
+    uint32_t argbColor, int32_t *rect)
+{
+    _2D_Triangle tri;
+    float area, rArea;
+    float xMinF, xMaxF, yMinF, yMaxF;
+    uint32_t c;
+
+    //边函数: 第i条边是第i个顶点的对边
+    tri.A[0] = xy[3] - xy[5];
+    tri.B[0] = xy[4] - xy[2];
+    tri.C[0] = xy[2] * xy[5] - xy[4] * xy[3];
+    tri.A[1] = xy[5] - xy[1];
+    tri.B[1] = xy[0] - xy[4];
+    tri.C[1] = xy[4] * xy[1] - xy[0] * xy[5];
+    tri.A[2] = xy[1] - xy[3];
+    tri.B[2] = xy[2] - xy[0];
+    tri.C[2] = xy[0] * xy[3] - xy[2] * xy[1];
+
+    //面积的2倍(带符号),退化三角形不画
+    area = tri.C[0] + tri.C[1] + tri.C[2];
+    if (area == 0 || isnan(area))
+        return;
+    //统一为正向环绕
+    if (area < 0)
+    {
+        for (c = 0; c < 3; c++)
+        {
+            tri.A[c] = -tri.A[c];
+            tri.B[c] = -tri.B[c];
+            tri.C[c] = -tri.C[c];
+        }
+        area = -area;
+    }
+    //边上像素的归属规则,共边的两个三角形其边函数互为相反数,保证不重不漏
+    for (c = 0; c < 3; c++)
+        tri.include[c] = tri.A[c] > 0 || (tri.A[c] == 0 && tri.B[c] > 0);
+
+    //深度倒数在屏幕空间是线性的,由重心坐标 E[i]/area 组合成平面方程
+    rArea = 1 / area;
+    tri.zA = (tri.A[0] / depth[0] + tri.A[1] / depth[1] + tri.A[2] / depth[2]) * rArea;
+    tri.zB = (tri.B[0] / depth[0] + tri.B[1] / depth[1] + tri.B[2] / depth[2]) * rArea;
+    tri.zC = (tri.C[0] / depth[0] + tri.C[1] / depth[1] + tri.C[2] / depth[2]) * rArea;
+
+    //包围盒,并限制在屏幕内
+    xMinF = xMaxF = xy[0];
+    yMinF = yMaxF = xy[1];
+    for (c = 2; c < 6; c += 2)
+    {
+        if (xy[c] < xMinF)
+            xMinF = xy[c];
+        if (xy[c] > xMaxF)
+            xMaxF = xy[c];
+        if (xy[c + 1] < yMinF)
+            yMinF = xy[c + 1];
+        if (xy[c + 1] > yMaxF)
+            yMaxF = xy[c + 1];
+    }
+    if (xMaxF < 0 || yMaxF < 0 || xMinF >= width || yMinF >= height)
+        return;
+    tri.xMin = xMinF > 0 ? (int32_t)xMinF : 0;
+    tri.yMin = yMinF > 0 ? (int32_t)yMinF : 0;
+    tri.xMax = xMaxF < width - 1 ? (int32_t)xMaxF : (int32_t)width - 1;
+    tri.yMax = yMaxF < height - 1 ? (int32_t)yMaxF : (int32_t)height - 1;
+    //再限制到绘制范围
+    if (rect)
+    {
+        tri.xMin = rect[0] > tri.xMin ? rect[0] : tri.xMin;
+        tri.yMin = rect[1] > tri.yMin ? rect[1] : tri.yMin;
+        tri.xMax = rect[2] < tri.xMax ? rect[2] : tri.xMax;
+        tri.yMax = rect[3] < tri.yMax ? rect[3] : tri.yMax;
+    }
+    if (tri.xMin > tri.xMax || tri.yMin > tri.yMax)
+        return;
+
+    tri.rgb[0] = (argbColor >> 16) & 0xFF;
+    tri.rgb[1] = (argbColor >> 8) & 0xFF;
+    tri.rgb[2] = (argbColor >> 0) & 0xFF;
+
+    //逐像素填充(按CPU支持情况选用SIMD版本)
+    _2d_triangle_kernel(&tri, rgbMap, depthMap, width);
+}
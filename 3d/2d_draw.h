@@ -23,4 +23,43 @@ void _2d_draw_line(
     int32_t *xyStart, int32_t *xyEnd,
     uint32_t argbColor, uint32_t size);
 
+/*
+ *  带深度测试的直线(先裁剪到屏幕范围,再逐像素步进并插值深度)
+ *  参数:
+ *      rgbMap: RGB图像缓冲区
+ *      depthMap: 深度缓冲区,与 rgbMap 像素一一对应,深度值小于缓冲区中的值时才绘制
+ *      width, height: 图像宽高
+ *      xy[4]: 2个屏幕坐标(浮点)
+ *      depth[2]: 2个端点的深度(到相机的距离,要求大于0),像素深度按透视校正插值
+ *      argbColor: 线颜色
+ *      rect[4]: 只绘制落在该矩形内的像素 xMin,yMin,xMax,yMax (闭区间,置NULL时为整个屏幕)
+ *               分块绘制时各块的结果与整屏绘制逐像素一致
+ */
+void _2d_draw_line_depth(
+    uint8_t *rgbMap, float *depthMap,
+    uint32_t width, uint32_t height,
+    float xy[4], float depth[2],
+    uint32_t argbColor, int32_t *rect);
+
+/*
+ *  带深度测试的三角形填充(边函数法,只遍历三角形包围盒内的像素)
+ *  参数:
+ *      rgbMap: RGB图像缓冲区
+ *      depthMap: 深度缓冲区,与 rgbMap 像素一一对应,深度值小于缓冲区中的值时才绘制
+ *      width, height: 图像宽高
+ *      xy[6]: 3个屏幕坐标(浮点,像素(x,y)的中心位于(x+0.5,y+0.5))
+ *      depth[3]: 3个顶点的深度(到相机的距离,要求大于0),像素深度按透视校正插值
+ *      argbColor: 填充颜色
+ *      rect[4]: 只绘制落在该矩形内的像素 xMin,yMin,xMax,yMax (闭区间,置NULL时为整个屏幕)
+ *               分块绘制时各块的结果与整屏绘制逐像素一致
+ */
+void _2d_draw_triangle_depth(
+    uint8_t *rgbMap, float *depthMap,
+    uint32_t width, uint32_t height,
+    float xy[6], float depth[3],
+    uint32_t argbColor, int32_t *rect);
+
+// 当前使用的三角形填充内核: "scalar" "sse2" "avx2" "neon" (见 2d_draw_simd.c)
+const char *_2d_draw_simd_name(void);
+
 #endif
@@ -0,0 +1,457 @@
+/*
+ *  三角形填充的逐像素内核: 标量版本 + SSE2/AVX2/NEON 按像素块并行的版本
+ *
+ *  各版本对每个像素的计算步骤完全相同(不使用近似倒数、不融合乘加),输出逐像素一致
+ *  默认运行时按CPU支持情况自动选择,编译时可用 make SIMD=scalar/sse2/avx2/neon 强制指定
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "2d_draw.h"
+#include "2d_draw_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define _2D_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define _2D_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// 强制指定的版本必须与编译目标匹配
+#if defined(DRAW_SIMD)
+#if (DRAW_SIMD == DRAW_SIMD_SSE2 || DRAW_SIMD == DRAW_SIMD_AVX2) && !defined(_2D_SIMD_X86)
+#error "SIMD=sse2/avx2 only for x86 targets"
+#endif
+#if DRAW_SIMD == DRAW_SIMD_NEON && !defined(_2D_SIMD_NEON)
+#error "SIMD=neon needs a NEON enabled target (arm32: -mfpu=neon)"
+#endif
+#endif
+
+// 需要编译进来的版本
+#if defined(_2D_SIMD_X86) && (!defined(DRAW_SIMD) || DRAW_SIMD == DRAW_SIMD_SSE2)
+#define _2D_USE_SSE2
+#endif
+#if defined(_2D_SIMD_X86) && (!defined(DRAW_SIMD) || DRAW_SIMD == DRAW_SIMD_AVX2)
+#define _2D_USE_AVX2
+#endif
+#if defined(_2D_SIMD_NEON) && (!defined(DRAW_SIMD) || DRAW_SIMD == DRAW_SIMD_NEON)
+#define _2D_USE_NEON
+#endif
+
+//单个像素的边函数检查
+static inline bool _2d_edge_pass(float e, bool include)
+{
+    return e > 0 || (e == 0 && include);
+}
+
+//标量版本,遍历指定范围(闭区间)
+static void _2d_kernel_scalar_rect(
+    _2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t width,
+    int32_t xMin, int32_t yMin, int32_t xMax, int32_t yMax)
+{
+    float fx, fy, rowE0, rowE1, rowE2, rowZ, z;
+    int32_t x, y;
+    uint32_t offset;
+    //逐行扫描,边函数每个像素独立求值(结果与扫描起点无关)
+    for (y = yMin; y <= yMax; y++)
+    {
+        fy = y + 0.5f;
+        rowE0 = t->B[0] * fy + t->C[0];
+        rowE1 = t->B[1] * fy + t->C[1];
+        rowE2 = t->B[2] * fy + t->C[2];
+        rowZ = t->zB * fy + t->zC;
+        offset = y * width + xMin;
+        for (x = xMin; x <= xMax; x++, offset++)
+        {
+            fx = x + 0.5f;
+            //在三角形外
+            if (!_2d_edge_pass(t->A[0] * fx + rowE0, t->include[0]) ||
+                !_2d_edge_pass(t->A[1] * fx + rowE1, t->include[1]) ||
+                !_2d_edge_pass(t->A[2] * fx + rowE2, t->include[2]))
+                continue;
+            //透视校正后的深度
+            z = 1 / (t->zA * fx + rowZ);
+            //被遮挡
+            if (!(z < depthMap[offset]))
+                continue;
+            //占用该点
+            depthMap[offset] = z;
+            //画点
+            rgbMap[offset * 3 + 0] = t->rgb[0];
+            rgbMap[offset * 3 + 1] = t->rgb[1];
+            rgbMap[offset * 3 + 2] = t->rgb[2];
+        }
+    }
+}
+
+//标量版本
+static void _2d_kernel_scalar(_2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t width)
+{
+    _2d_kernel_scalar_rect(t, rgbMap, depthMap, width, t->xMin, t->yMin, t->xMax, t->yMax);
+}
+
+#if defined(_2D_USE_SSE2) || defined(_2D_USE_AVX2) || defined(_2D_USE_NEON)
+
+/*
+ *  像素块 [bx, bx + w) x [by, by + h) 是否整块落在某条边的外侧
+ *  边函数沿行、列方向单调(含浮点舍入),只需检查四个角的像素
+ */
+static bool _2d_block_outside(_2D_Triangle *t, int32_t bx, int32_t by, int32_t w, int32_t h)
+{
+    float fx0 = bx + 0.5f, fx1 = (bx + w - 1) + 0.5f;
+    float fy0 = by + 0.5f, fy1 = (by + h - 1) + 0.5f;
+    float row0, row1;
+    uint32_t c;
+    for (c = 0; c < 3; c++)
+    {
+        row0 = t->B[c] * fy0 + t->C[c];
+        row1 = t->B[c] * fy1 + t->C[c];
+        if (!_2d_edge_pass(t->A[c] * fx0 + row0, t->include[c]) &&
+            !_2d_edge_pass(t->A[c] * fx1 + row0, t->include[c]) &&
+            !_2d_edge_pass(t->A[c] * fx0 + row1, t->include[c]) &&
+            !_2d_edge_pass(t->A[c] * fx1 + row1, t->include[c]))
+            return true;
+    }
+    return false;
+}
+
+//按位掩码逐个写入像素(bit i 对应 offset + i)
+static inline void _2d_lanes_store(_2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t offset, float *z, uint32_t bits)
+{
+    uint32_t i;
+    while (bits)
+    {
+        i = __builtin_ctz(bits);
+        bits &= bits - 1;
+        depthMap[offset + i] = z[i];
+        rgbMap[(offset + i) * 3 + 0] = t->rgb[0];
+        rgbMap[(offset + i) * 3 + 1] = t->rgb[1];
+        rgbMap[(offset + i) * 3 + 2] = t->rgb[2];
+    }
+}
+
+//块内位于[xMin, xMax]的像素掩码
+static inline uint32_t _2d_lanes_range(int32_t bx, int32_t lanes, int32_t xMin, int32_t xMax)
+{
+    uint32_t all = (1u << lanes) - 1;
+    int32_t xS = bx > xMin ? bx : xMin;
+    int32_t xE = bx + lanes - 1 < xMax ? bx + lanes - 1 : xMax;
+    return ((all << (xS - bx)) & (all >> (bx + lanes - 1 - xE))) & all;
+}
+
+#endif
+
+#if defined(_2D_USE_SSE2)
+
+//SSE2版本, 4x4像素块
+__attribute__((target("sse2"))) static void _2d_kernel_sse2(_2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t width)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 lane = _mm_set_ps(3, 2, 1, 0);
+    __m128 A0 = _mm_set1_ps(t->A[0]), A1 = _mm_set1_ps(t->A[1]), A2 = _mm_set1_ps(t->A[2]);
+    __m128 inc0 = _mm_castsi128_ps(_mm_set1_epi32(t->include[0] ? -1 : 0));
+    __m128 inc1 = _mm_castsi128_ps(_mm_set1_epi32(t->include[1] ? -1 : 0));
+    __m128 inc2 = _mm_castsi128_ps(_mm_set1_epi32(t->include[2] ? -1 : 0));
+    __m128 zA = _mm_set1_ps(t->zA);
+    __m128 fx, e0, e1, e2, m, z;
+    float fy, zs[4];
+    uint8_t pattern[4 * 3];
+    int32_t bx, by, y, yS, yE;
+    uint32_t laneBits, bits, offset, c;
+
+    for (c = 0; c < 4 * 3; c += 3)
+        memcpy(&pattern[c], t->rgb, 3);
+
+    for (by = t->yMin & ~3; by <= t->yMax; by += 4)
+    {
+        yS = by > t->yMin ? by : t->yMin;
+        yE = by + 3 < t->yMax ? by + 3 : t->yMax;
+        for (bx = t->xMin & ~3; bx <= t->xMax; bx += 4)
+        {
+            //超出行尾的块用标量版本(避免越界读)
+            if (bx + 4 > (int32_t)width)
+            {
+                _2d_kernel_scalar_rect(t, rgbMap, depthMap, width, bx > t->xMin ? bx : t->xMin, yS, t->xMax, yE);
+                continue;
+            }
+            //整块在三角形外
+            if (_2d_block_outside(t, bx, by, 4, 4))
+                continue;
+            laneBits = _2d_lanes_range(bx, 4, t->xMin, t->xMax);
+            fx = _mm_add_ps(_mm_add_ps(_mm_set1_ps((float)bx), lane), half);
+            for (y = yS; y <= yE; y++)
+            {
+                fy = y + 0.5f;
+                e0 = _mm_add_ps(_mm_mul_ps(A0, fx), _mm_set1_ps(t->B[0] * fy + t->C[0]));
+                e1 = _mm_add_ps(_mm_mul_ps(A1, fx), _mm_set1_ps(t->B[1] * fy + t->C[1]));
+                e2 = _mm_add_ps(_mm_mul_ps(A2, fx), _mm_set1_ps(t->B[2] * fy + t->C[2]));
+                m = _mm_or_ps(_mm_cmpgt_ps(e0, zero), _mm_and_ps(_mm_cmpeq_ps(e0, zero), inc0));
+                m = _mm_and_ps(m, _mm_or_ps(_mm_cmpgt_ps(e1, zero), _mm_and_ps(_mm_cmpeq_ps(e1, zero), inc1)));
+                m = _mm_and_ps(m, _mm_or_ps(_mm_cmpgt_ps(e2, zero), _mm_and_ps(_mm_cmpeq_ps(e2, zero), inc2)));
+                bits = _mm_movemask_ps(m) & laneBits;
+                if (!bits)
+                    continue;
+                //深度比较
+                z = _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(zA, fx), _mm_set1_ps(t->zB * fy + t->zC)));
+                offset = y * width + bx;
+                bits &= _mm_movemask_ps(_mm_cmplt_ps(z, _mm_loadu_ps(&depthMap[offset])));
+                //整行写入或按掩码写入
+                if (bits == 0xF)
+                {
+                    _mm_storeu_ps(&depthMap[offset], z);
+                    memcpy(&rgbMap[offset * 3], pattern, sizeof(pattern));
+                }
+                else if (bits)
+                {
+                    _mm_storeu_ps(zs, z);
+                    _2d_lanes_store(t, rgbMap, depthMap, offset, zs, bits);
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+#if defined(_2D_USE_AVX2)
+
+//AVX2版本, 8x8像素块
+__attribute__((target("avx2"))) static void _2d_kernel_avx2(_2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t width)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 lane = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256 A0 = _mm256_set1_ps(t->A[0]), A1 = _mm256_set1_ps(t->A[1]), A2 = _mm256_set1_ps(t->A[2]);
+    __m256 inc0 = _mm256_castsi256_ps(_mm256_set1_epi32(t->include[0] ? -1 : 0));
+    __m256 inc1 = _mm256_castsi256_ps(_mm256_set1_epi32(t->include[1] ? -1 : 0));
+    __m256 inc2 = _mm256_castsi256_ps(_mm256_set1_epi32(t->include[2] ? -1 : 0));
+    __m256 zA = _mm256_set1_ps(t->zA);
+    __m256 fx, e0, e1, e2, m, z;
+    float fy, zs[8];
+    uint8_t pattern[8 * 3];
+    int32_t bx, by, y, yS, yE;
+    uint32_t laneBits, bits, offset, c;
+
+    for (c = 0; c < 8 * 3; c += 3)
+        memcpy(&pattern[c], t->rgb, 3);
+
+    for (by = t->yMin & ~7; by <= t->yMax; by += 8)
+    {
+        yS = by > t->yMin ? by : t->yMin;
+        yE = by + 7 < t->yMax ? by + 7 : t->yMax;
+        for (bx = t->xMin & ~7; bx <= t->xMax; bx += 8)
+        {
+            //超出行尾的块用标量版本(避免越界读)
+            if (bx + 8 > (int32_t)width)
+            {
+                _2d_kernel_scalar_rect(t, rgbMap, depthMap, width, bx > t->xMin ? bx : t->xMin, yS, t->xMax, yE);
+                continue;
+            }
+            //整块在三角形外
+            if (_2d_block_outside(t, bx, by, 8, 8))
+                continue;
+            laneBits = _2d_lanes_range(bx, 8, t->xMin, t->xMax);
+            fx = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps((float)bx), lane), half);
+            for (y = yS; y <= yE; y++)
+            {
+                fy = y + 0.5f;
+                e0 = _mm256_add_ps(_mm256_mul_ps(A0, fx), _mm256_set1_ps(t->B[0] * fy + t->C[0]));
+                e1 = _mm256_add_ps(_mm256_mul_ps(A1, fx), _mm256_set1_ps(t->B[1] * fy + t->C[1]));
+                e2 = _mm256_add_ps(_mm256_mul_ps(A2, fx), _mm256_set1_ps(t->B[2] * fy + t->C[2]));
+                m = _mm256_or_ps(_mm256_cmp_ps(e0, zero, _CMP_GT_OQ), _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_EQ_OQ), inc0));
+                m = _mm256_and_ps(m, _mm256_or_ps(_mm256_cmp_ps(e1, zero, _CMP_GT_OQ), _mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_EQ_OQ), inc1)));
+                m = _mm256_and_ps(m, _mm256_or_ps(_mm256_cmp_ps(e2, zero, _CMP_GT_OQ), _mm256_and_ps(_mm256_cmp_ps(e2, zero, _CMP_EQ_OQ), inc2)));
+                bits = _mm256_movemask_ps(m) & laneBits;
+                if (!bits)
+                    continue;
+                //深度比较
+                z = _mm256_div_ps(one, _mm256_add_ps(_mm256_mul_ps(zA, fx), _mm256_set1_ps(t->zB * fy + t->zC)));
+                offset = y * width + bx;
+                bits &= _mm256_movemask_ps(_mm256_cmp_ps(z, _mm256_loadu_ps(&depthMap[offset]), _CMP_LT_OQ));
+                //整行写入或按掩码写入
+                if (bits == 0xFF)
+                {
+                    _mm256_storeu_ps(&depthMap[offset], z);
+                    memcpy(&rgbMap[offset * 3], pattern, sizeof(pattern));
+                }
+                else if (bits)
+                {
+                    _mm256_storeu_ps(zs, z);
+                    _2d_lanes_store(t, rgbMap, depthMap, offset, zs, bits);
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+#if defined(_2D_USE_NEON)
+
+//NEON比较结果转为位掩码
+static inline uint32_t _2d_neon_bits(uint32x4_t m)
+{
+    return (vgetq_lane_u32(m, 0) & 1) |
+           (vgetq_lane_u32(m, 1) & 2) |
+           (vgetq_lane_u32(m, 2) & 4) |
+           (vgetq_lane_u32(m, 3) & 8);
+}
+
+//NEON除法(arm32没有除法指令,逐个计算以保证与标量结果一致)
+static inline float32x4_t _2d_neon_div(float32x4_t a, float32x4_t b)
+{
+#if defined(__aarch64__)
+    return vdivq_f32(a, b);
+#else
+    float _a[4], _b[4];
+    vst1q_f32(_a, a);
+    vst1q_f32(_b, b);
+    _a[0] /= _b[0];
+    _a[1] /= _b[1];
+    _a[2] /= _b[2];
+    _a[3] /= _b[3];
+    return vld1q_f32(_a);
+#endif
+}
+
+//NEON版本, 4x4像素块
+static void _2d_kernel_neon(_2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t width)
+{
+    const float lanes[4] = {0, 1, 2, 3};
+    const float32x4_t zero = vdupq_n_f32(0);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t lane = vld1q_f32(lanes);
+    float32x4_t A0 = vdupq_n_f32(t->A[0]), A1 = vdupq_n_f32(t->A[1]), A2 = vdupq_n_f32(t->A[2]);
+    uint32x4_t inc0 = vdupq_n_u32(t->include[0] ? 0xFFFFFFFF : 0);
+    uint32x4_t inc1 = vdupq_n_u32(t->include[1] ? 0xFFFFFFFF : 0);
+    uint32x4_t inc2 = vdupq_n_u32(t->include[2] ? 0xFFFFFFFF : 0);
+    float32x4_t zA = vdupq_n_f32(t->zA);
+    float32x4_t fx, e0, e1, e2, z;
+    uint32x4_t m;
+    float fy, zs[4];
+    uint8_t pattern[4 * 3];
+    int32_t bx, by, y, yS, yE;
+    uint32_t laneBits, bits, offset, c;
+
+    for (c = 0; c < 4 * 3; c += 3)
+        memcpy(&pattern[c], t->rgb, 3);
+
+    for (by = t->yMin & ~3; by <= t->yMax; by += 4)
+    {
+        yS = by > t->yMin ? by : t->yMin;
+        yE = by + 3 < t->yMax ? by + 3 : t->yMax;
+        for (bx = t->xMin & ~3; bx <= t->xMax; bx += 4)
+        {
+            //超出行尾的块用标量版本(避免越界读)
+            if (bx + 4 > (int32_t)width)
+            {
+                _2d_kernel_scalar_rect(t, rgbMap, depthMap, width, bx > t->xMin ? bx : t->xMin, yS, t->xMax, yE);
+                continue;
+            }
+            //整块在三角形外
+            if (_2d_block_outside(t, bx, by, 4, 4))
+                continue;
+            laneBits = _2d_lanes_range(bx, 4, t->xMin, t->xMax);
+            fx = vaddq_f32(vaddq_f32(vdupq_n_f32((float)bx), lane), half);
+            for (y = yS; y <= yE; y++)
+            {
+                fy = y + 0.5f;
+                e0 = vaddq_f32(vmulq_f32(A0, fx), vdupq_n_f32(t->B[0] * fy + t->C[0]));
+                e1 = vaddq_f32(vmulq_f32(A1, fx), vdupq_n_f32(t->B[1] * fy + t->C[1]));
+                e2 = vaddq_f32(vmulq_f32(A2, fx), vdupq_n_f32(t->B[2] * fy + t->C[2]));
+                m = vorrq_u32(vcgtq_f32(e0, zero), vandq_u32(vceqq_f32(e0, zero), inc0));
+                m = vandq_u32(m, vorrq_u32(vcgtq_f32(e1, zero), vandq_u32(vceqq_f32(e1, zero), inc1)));
+                m = vandq_u32(m, vorrq_u32(vcgtq_f32(e2, zero), vandq_u32(vceqq_f32(e2, zero), inc2)));
+                bits = _2d_neon_bits(m) & laneBits;
+                if (!bits)
+                    continue;
+                //深度比较
+                z = _2d_neon_div(one, vaddq_f32(vmulq_f32(zA, fx), vdupq_n_f32(t->zB * fy + t->zC)));
+                offset = y * width + bx;
+                bits &= _2d_neon_bits(vcltq_f32(z, vld1q_f32(&depthMap[offset])));
+                //整行写入或按掩码写入
+                if (bits == 0xF)
+                {
+                    vst1q_f32(&depthMap[offset], z);
+                    memcpy(&rgbMap[offset * 3], pattern, sizeof(pattern));
+                }
+                else if (bits)
+                {
+                    vst1q_f32(zs, z);
+                    _2d_lanes_store(t, rgbMap, depthMap, offset, zs, bits);
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+// ---------- 版本选择 ----------
+
+typedef void (*_2D_TriangleKernel)(_2D_Triangle *t, uint8_t *rgbMap, float *depthMap, uint32_t width);
+
+static _2D_TriangleKernel _2d_kernel = NULL;
+static const char *_2d_kernel_name = "scalar";
+static pthread_once_t _2d_kernel_once = PTHREAD_ONCE_INIT;
+
+static void _2d_kernel_select(void)
+{
+    _2d_kernel = &_2d_kernel_scalar;
+    _2d_kernel_name = "scalar";
+#if defined(DRAW_SIMD)
+    //编译时强制指定
+#if DRAW_SIMD == DRAW_SIMD_SSE2
+    _2d_kernel = &_2d_kernel_sse2;
+    _2d_kernel_name = "sse2";
+#elif DRAW_SIMD == DRAW_SIMD_AVX2
+    _2d_kernel = &_2d_kernel_avx2;
+    _2d_kernel_name = "avx2";
+#elif DRAW_SIMD == DRAW_SIMD_NEON
+    _2d_kernel = &_2d_kernel_neon;
+    _2d_kernel_name = "neon";
+#endif
+#elif defined(_2D_USE_AVX2) && defined(_2D_USE_SSE2)
+    //运行时检测CPU
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        _2d_kernel = &_2d_kernel_avx2;
+        _2d_kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        _2d_kernel = &_2d_kernel_sse2;
+        _2d_kernel_name = "sse2";
+    }
+#elif defined(_2D_USE_NEON)
+    //编译目标支持NEON即可用
+    _2d_kernel = &_2d_kernel_neon;
+    _2d_kernel_name = "neon";
+#endif
+}
+
+// 遍历 tri 像素范围,对三角形内且未被遮挡的像素写入深度和颜色
+void _2d_triangle_kernel(_2D_Triangle *tri, uint8_t *rgbMap, float *depthMap, uint32_t width)
+{
+    pthread_once(&_2d_kernel_once, &_2d_kernel_select);
+    _2d_kernel(tri, rgbMap, depthMap, width);
+}
+
+// 当前使用的三角形填充内核: "scalar" "sse2" "avx2" "neon"
+const char *_2d_draw_simd_name(void)
+{
+    pthread_once(&_2d_kernel_once, &_2d_kernel_select);
+    return _2d_kernel_name;
+}
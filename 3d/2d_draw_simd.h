@@ -0,0 +1,39 @@
+/*
+ *  三角形填充的逐像素内核: 标量版本 + SSE2/AVX2/NEON 按像素块并行的版本
+ *
+ *  各版本对每个像素的计算步骤完全相同(不使用近似倒数、不融合乘加),输出逐像素一致
+ *  默认运行时按CPU支持情况自动选择,编译时可用 make SIMD=scalar/sse2/avx2/neon 强制指定
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _2D_DRAW_SIMD_H_
+#define _2D_DRAW_SIMD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// DRAW_SIMD 取值,由 Makefile 的 SIMD 参数传入,未定义时运行时自动选择
+#define DRAW_SIMD_SCALAR 1
+#define DRAW_SIMD_SSE2 2
+#define DRAW_SIMD_AVX2 3
+#define DRAW_SIMD_NEON 4
+
+// 已完成设置的三角形
+typedef struct _2DTriangle
+{
+    float A[3], B[3], C[3]; //三条边的边函数 E = A*x + B*y + C, 已统一为三角形内部 E >= 0
+    bool include[3];        //E == 0 (压在边上)的像素是否归属本三角形
+    float zA, zB, zC;       //深度倒数的平面方程 1/z = zA*x + zB*y + zC
+    uint8_t rgb[3];         //填充颜色
+    int32_t xMin, yMin, xMax, yMax; //要遍历的像素范围(闭区间,已限制在屏幕和绘制范围内)
+} _2D_Triangle;
+
+/*
+ *  遍历 tri 像素范围,对三角形内且未被遮挡的像素写入深度和颜色
+ *  参数:
+ *      width: 图像宽(即 depthMap 每行的像素数)
+ */
+void _2d_triangle_kernel(_2D_Triangle *tri, uint8_t *rgbMap, float *depthMap, uint32_t width);
+
+#endif
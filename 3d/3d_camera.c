@@ -52,12 +52,13 @@ _3D_Camera *camera_init(
     camera->far = far;
     camera->position.quat[0] = 1;
 
-    camera->pixelOfScreen = ((float)height / 2) / tan(openAngle * M_PI / 180 / 2) / near;
+    //投影参数
+    camera_projection_update(camera);
 
     //照片内存
     camera->photoSize = width * height * 3;
     camera->photoMap = (uint8_t *)calloc(camera->photoSize, sizeof(uint8_t));
-    camera->photoDepth = (uint32_t *)calloc(width * height, sizeof(uint32_t));
+    camera->photoDepth = (float *)calloc(width * height, sizeof(float));
 
     //初始状态
     if (xyz)
@@ -109,7 +110,7 @@ _3D_Camera *camera_copy(_3D_Camera *camera)
     //专有指针重新分配内存
     camera2->photoMap = (uint8_t *)calloc(camera2->photoSize, sizeof(uint8_t));
     memcpy(camera2->photoMap, camera->photoMap, camera2->photoSize);
-    camera2->photoDepth = (uint32_t *)calloc(camera2->width * camera2->height, sizeof(uint32_t));
+    camera2->photoDepth = (float *)calloc(camera2->width * camera2->height, sizeof(float));
     //备份
     camera2->backup = (_3D_Camera *)calloc(1, sizeof(_3D_Camera));
     memcpy(camera2->backup, camera2, sizeof(_3D_Camera));
@@ -197,20 +198,272 @@ static float _fabs(float v)
     return v > 0 ? v : (-v);
 }
 
+// 相机参数变化后重新计算投影参数(proj, pixelOfScreen)
+void camera_projection_update(_3D_Camera *camera)
+{
+    projection_setup(&camera->proj, camera->openAngle, camera->width, camera->height, camera->near, camera->far);
+    camera->ar = (float)camera->width / camera->height;
+    camera->pixelOfScreen = camera->proj.scale / camera->near;
+}
+
 //空间坐标(相机坐标系)是否在相机可视范围内
 bool camera_isInside(_3D_Camera *camera, float xyz[3])
 {
-    float a;
     //远近
     if (xyz[0] < camera->near || xyz[0] > camera->far)
         return false;
-    a = camera->openAngle / 2 * M_PI / 180;
     //上下
-    if (_fabs(tan(a)) < _fabs(xyz[2] / xyz[0]))
+    if (camera->proj.tanHalf * xyz[0] < _fabs(xyz[2]))
+        return false;
+    //左右(水平开角按屏幕宽高比放大)
+    if (camera->proj.tanHalfW * xyz[0] < _fabs(xyz[1]))
+        return false;
+
+    return true;
+}
+
+/*
+ *  坐标点(相机坐标系)在视锥和保护带哪些面的外侧
+ *  一组点的标志位相与不为0时全部在同一个面外侧(可以剔除),
+ *  相或后与 CAMERA_OUT_CLIP 为0时不需要裁剪
+ *
+ *  返回: CAMERA_OUT_XXX 标志位
+ */
+uint16_t camera_outcode(_3D_Camera *camera, float xyz[3])
+{
+    float wx = camera->proj.tanHalfW * xyz[0];
+    float hx = camera->proj.tanHalf * xyz[0];
+    float gwx = camera->proj.tanHalfW * CAMERA_GUARD_BAND * xyz[0];
+    float ghx = camera->proj.tanHalf * CAMERA_GUARD_BAND * xyz[0];
+    uint16_t out = 0;
+    //远近
+    if (xyz[0] < camera->near)
+        out |= CAMERA_OUT_NEAR;
+    if (xyz[0] > camera->far)
+        out |= CAMERA_OUT_FAR;
+    //视锥侧面
+    if (xyz[1] > wx)
+        out |= CAMERA_OUT_LEFT;
+    if (xyz[1] < -wx)
+        out |= CAMERA_OUT_RIGHT;
+    if (xyz[2] > hx)
+        out |= CAMERA_OUT_TOP;
+    if (xyz[2] < -hx)
+        out |= CAMERA_OUT_BOTTOM;
+    //保护带(与 camera_clip_dist 的判断一致)
+    if (xyz[1] > gwx)
+        out |= CAMERA_OUT_GUARD_LEFT;
+    if (xyz[1] < -gwx)
+        out |= CAMERA_OUT_GUARD_RIGHT;
+    if (xyz[2] > ghx)
+        out |= CAMERA_OUT_GUARD_TOP;
+    if (xyz[2] < -ghx)
+        out |= CAMERA_OUT_GUARD_BOTTOM;
+    return out;
+}
+
+/*
+ *  一组坐标点(相机坐标系)是否全部在视锥的同一个面(近端、远端、上下左右)之外
+ *  用于剔除线条、三角形、包围盒,返回false时不代表一定可见
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ */
+bool camera_isOutside(_3D_Camera *camera, float *xyz, uint32_t pointTotal)
+{
+    uint32_t c;
+    uint16_t out = CAMERA_OUT_VIEW;
+    for (c = 0; c < pointTotal && out; c++, xyz += 3)
+        out &= camera_outcode(camera, xyz);
+    return out != 0;
+}
+
+// 球体(相机坐标系)是否完全在视锥之外,返回false时不代表一定可见
+bool camera_isOutsideSphere(_3D_Camera *camera, float xyz[3], float radius)
+{
+    float wx = camera->proj.tanHalfW * xyz[0];
+    float hx = camera->proj.tanHalf * xyz[0];
+    //远近
+    if (xyz[0] + radius < camera->near || xyz[0] - radius > camera->far)
+        return true;
+    //左右: 球心到侧面的距离 = (|y| - x * tan) * cos
+    if ((_fabs(xyz[1]) - wx) * camera->proj.cosHalfW > radius)
+        return true;
+    //上下
+    if ((_fabs(xyz[2]) - hx) * camera->proj.cosHalf > radius)
+        return true;
+    return false;
+}
+
+// 裁剪平面个数: 近端,远端,左,右,上,下(后4个为保护带平面)
+#define CAMERA_CLIP_PLANES 6
+
+/*
+ *  坐标点到各裁剪平面的有向距离(不需要归一化),大于等于0为内侧
+ *  参数:
+ *      dist[CAMERA_CLIP_PLANES]: 返回距离
+ *
+ *  返回: 外侧平面的标志位
+ */
+static uint8_t camera_clip_dist(_3D_Camera *camera, float xyz[3], float dist[CAMERA_CLIP_PLANES])
+{
+    float wx = camera->proj.tanHalfW * CAMERA_GUARD_BAND * xyz[0];
+    float hx = camera->proj.tanHalf * CAMERA_GUARD_BAND * xyz[0];
+    uint8_t out = 0;
+    uint32_t i;
+    dist[0] = xyz[0] - camera->near;
+    dist[1] = camera->far - xyz[0];
+    dist[2] = wx - xyz[1];
+    dist[3] = wx + xyz[1];
+    dist[4] = hx - xyz[2];
+    dist[5] = hx + xyz[2];
+    for (i = 0; i < CAMERA_CLIP_PLANES; i++)
+    {
+        if (dist[i] < 0)
+            out |= 1 << i;
+    }
+    return out;
+}
+
+/*
+ *  凸多边形(相机坐标系)裁剪到近端、远端和保护带以内(Sutherland-Hodgman)
+ *  参数:
+ *      xyz[3 * pointTotal]: 多边形顶点
+ *      pointTotal: 顶点数,不超过3
+ *      retXyz[3 * CAMERA_CLIP_MAX]: 返回裁剪后的多边形顶点
+ *
+ *  返回: 裁剪后的顶点数,小于3时多边形不可见
+ */
+uint32_t camera_clip_polygon(_3D_Camera *camera, float *xyz, uint32_t pointTotal, float *retXyz)
+{
+    float buff[2][3 * CAMERA_CLIP_MAX];
+    float dist[CAMERA_CLIP_MAX][CAMERA_CLIP_PLANES];
+    float *src, *dst, *in, *out;
+    float t;
+    uint8_t outAnd = 0xFF, outOr = 0;
+    uint8_t code;
+    uint32_t c, i, next, total, plane;
+
+    //各顶点在哪些平面外侧
+    for (c = 0; c < pointTotal; c++)
+    {
+        code = camera_clip_dist(camera, &xyz[c * 3], dist[c]);
+        outAnd &= code;
+        outOr |= code;
+    }
+    //全部在同一平面外侧
+    if (outAnd)
+        return 0;
+    //全部在内侧(在保护带内的绝大多数图元),不需要裁剪
+    if (!outOr)
+    {
+        memcpy(retXyz, xyz, pointTotal * 3 * sizeof(float));
+        return pointTotal;
+    }
+
+    //只对有顶点在外侧的平面逐个裁剪
+    src = xyz;
+    dst = buff[0];
+    for (plane = 0; plane < CAMERA_CLIP_PLANES; plane++)
+    {
+        if (!(outOr & (1 << plane)))
+            continue;
+        //上一个平面裁剪后的顶点需要重新计算距离
+        if (src != xyz)
+        {
+            for (c = 0; c < pointTotal; c++)
+                camera_clip_dist(camera, &src[c * 3], dist[c]);
+        }
+        for (c = total = 0; c < pointTotal; c++)
+        {
+            next = (c + 1) % pointTotal;
+            //内侧的点保留
+            if (dist[c][plane] >= 0)
+            {
+                memcpy(&dst[total * 3], &src[c * 3], sizeof(float) * 3);
+                total += 1;
+            }
+            //边跨越平面,加入交点
+            if ((dist[c][plane] >= 0) != (dist[next][plane] >= 0))
+            {
+                //总是从内侧点算向外侧点,保证相邻三角形的公共边得到相同的交点
+                if (dist[c][plane] >= 0)
+                {
+                    in = &src[c * 3];
+                    out = &src[next * 3];
+                    t = dist[c][plane] / (dist[c][plane] - dist[next][plane]);
+                }
+                else
+                {
+                    in = &src[next * 3];
+                    out = &src[c * 3];
+                    t = dist[next][plane] / (dist[next][plane] - dist[c][plane]);
+                }
+                for (i = 0; i < 3; i++)
+                    dst[total * 3 + i] = in[i] + (out[i] - in[i]) * t;
+                total += 1;
+            }
+        }
+        pointTotal = total;
+        if (pointTotal < 3)
+            return 0;
+        //交换缓存
+        src = dst;
+        dst = (dst == buff[0]) ? buff[1] : buff[0];
+    }
+
+    memcpy(retXyz, src, pointTotal * 3 * sizeof(float));
+    return pointTotal;
+}
+
+/*
+ *  直线(相机坐标系)裁剪到近端、远端和保护带以内(参数化裁剪)
+ *  参数:
+ *      xyz[6]: 2个三维坐标,裁剪结果覆写到此
+ *
+ *  返回: false/直线不可见
+ */
+bool camera_clip_line(_3D_Camera *camera, float xyz[6])
+{
+    float dist[2][CAMERA_CLIP_PLANES];
+    float t, t0 = 0, t1 = 1;
+    float ret[6];
+    uint8_t code0, code1;
+    uint32_t i;
+
+    code0 = camera_clip_dist(camera, &xyz[0], dist[0]);
+    code1 = camera_clip_dist(camera, &xyz[3], dist[1]);
+    //全部在同一平面外侧
+    if (code0 & code1)
         return false;
-    //左右
-    if (_fabs(tan(a)) < _fabs(xyz[1] / xyz[0]))
+    //全部在内侧
+    if (!(code0 | code1))
+        return true;
+
+    //沿直线参数 t 收窄可见区间 [t0, t1]
+    for (i = 0; i < CAMERA_CLIP_PLANES; i++)
+    {
+        if (!((code0 | code1) & (1 << i)))
+            continue;
+        t = dist[0][i] / (dist[0][i] - dist[1][i]);
+        //起点在外侧: 从外侧进入
+        if (dist[0][i] < 0)
+        {
+            if (t > t0)
+                t0 = t;
+        }
+        //终点在外侧: 从内侧离开
+        else if (t < t1)
+            t1 = t;
+    }
+    if (t0 > t1)
         return false;
 
+    //没有裁剪的一端保持原值
+    for (i = 0; i < 3; i++)
+    {
+        ret[i] = t0 > 0 ? xyz[i] + (xyz[i + 3] - xyz[i]) * t0 : xyz[i];
+        ret[i + 3] = t1 < 1 ? xyz[i] + (xyz[i + 3] - xyz[i]) * t1 : xyz[i + 3];
+    }
+    memcpy(xyz, ret, sizeof(ret));
     return true;
 }
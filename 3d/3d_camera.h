@@ -12,6 +12,29 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "3d_math.h"
+
+// 保护带: 投影后在屏幕中心 CAMERA_GUARD_BAND 倍屏幕范围以内的图元不做侧面裁剪,
+// 直接交给光栅化(光栅化本身只遍历屏幕内的像素),超出的才在相机坐标系中裁剪,保证屏幕坐标不会过大
+#define CAMERA_GUARD_BAND 4
+
+// 坐标点(相机坐标系)在视锥和保护带哪些面的外侧,见 camera_outcode()
+#define CAMERA_OUT_NEAR 0x001
+#define CAMERA_OUT_FAR 0x002
+#define CAMERA_OUT_LEFT 0x004
+#define CAMERA_OUT_RIGHT 0x008
+#define CAMERA_OUT_TOP 0x010
+#define CAMERA_OUT_BOTTOM 0x020
+#define CAMERA_OUT_GUARD_LEFT 0x040
+#define CAMERA_OUT_GUARD_RIGHT 0x080
+#define CAMERA_OUT_GUARD_TOP 0x100
+#define CAMERA_OUT_GUARD_BOTTOM 0x200
+#define CAMERA_OUT_VIEW 0x03F //视锥的6个面
+#define CAMERA_OUT_CLIP 0x3C3 //需要在相机坐标系中裁剪的面: 近端,远端和保护带
+
+// 多边形裁剪后的最多顶点数(三角形被近端、远端和4个保护带平面各裁一次)
+#define CAMERA_CLIP_MAX (3 + 6)
+
 typedef struct _3DCameraPosition
 {
     float xyz[3];      //相机原点当前所在坐标
@@ -35,9 +58,11 @@ typedef struct _3DCamera
 
     float pixelOfScreen; //屏幕前显示的空间点被放大倍数, 等式 h/2 = tan(a/2)*near 左边除以右边
 
+    _3D_Projection proj; //由上面参数算好的投影参数,修改 width/height/openAngle/near/far 后需调用 camera_projection_update()
+
     uint32_t photoSize; //照片字节长度 width*height*3
     uint8_t *photoMap;  //照片缓冲区,RGB存储格式,字节长度 width*height*3
-    uint32_t *photoDepth; //照片(二维点阵)中的每个点的深度信息,当绘制点处于遮挡状态时可以不绘制,字节长度 width*height*sizeof(float)
+    float *photoDepth;  //照片(二维点阵)中的每个点的深度信息(到相机的距离),当绘制点处于遮挡状态时可以不绘制,字节长度 width*height*sizeof(float)
 
     float lock_xyz[3]; //锁定目标点(就是让相机的旋转以此为原点)
     _3D_CameraPosition position; //相机位置
@@ -111,7 +136,50 @@ void camera_unlock(_3D_Camera *camera);
 
 /* ---------- 其它 ---------- */
 
+// 相机参数变化后重新计算投影参数(proj, pixelOfScreen)
+void camera_projection_update(_3D_Camera *camera);
+
 //空间坐标(相机坐标系)是否在相机可视范围内
 bool camera_isInside(_3D_Camera *camera, float xyz[3]);
 
+/*
+ *  坐标点(相机坐标系)在视锥和保护带哪些面的外侧
+ *  一组点的标志位相与不为0时全部在同一个面外侧(可以剔除),
+ *  相或后与 CAMERA_OUT_CLIP 为0时不需要裁剪
+ *
+ *  返回: CAMERA_OUT_XXX 标志位
+ */
+uint16_t camera_outcode(_3D_Camera *camera, float xyz[3]);
+
+/*
+ *  一组坐标点(相机坐标系)是否全部在视锥的同一个面(近端、远端、上下左右)之外
+ *  用于剔除线条、三角形、包围盒,返回false时不代表一定可见
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ */
+bool camera_isOutside(_3D_Camera *camera, float *xyz, uint32_t pointTotal);
+
+// 球体(相机坐标系)是否完全在视锥之外,返回false时不代表一定可见
+bool camera_isOutsideSphere(_3D_Camera *camera, float xyz[3], float radius);
+
+/*
+ *  凸多边形(相机坐标系)裁剪到近端、远端和保护带以内(Sutherland-Hodgman)
+ *  参数:
+ *      xyz[3 * pointTotal]: 多边形顶点
+ *      pointTotal: 顶点数,不超过3
+ *      retXyz[3 * CAMERA_CLIP_MAX]: 返回裁剪后的多边形顶点
+ *
+ *  返回: 裁剪后的顶点数,小于3时多边形不可见
+ */
+uint32_t camera_clip_polygon(_3D_Camera *camera, float *xyz, uint32_t pointTotal, float *retXyz);
+
+/*
+ *  直线(相机坐标系)裁剪到近端、远端和保护带以内(参数化裁剪)
+ *  参数:
+ *      xyz[6]: 2个三维坐标,裁剪结果覆写到此
+ *
+ *  返回: false/直线不可见
+ */
+bool camera_clip_line(_3D_Camera *camera, float xyz[6]);
+
 #endif
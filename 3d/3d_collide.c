@@ -0,0 +1,341 @@
+/*
+ *  单元的碰撞/接近检测: 均匀网格粗筛(空间哈希,每次运动计算后只搬动换了格子的单元),
+ *  再对候选对依次做包围球、有向包围盒(OBB)的精确判断,总开销约为 O(N)
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "3d_collide.h"
+#include "3d_math.h"
+
+/*
+ *  初始化
+ *  参数:
+ *      margin: 接近距离, 0/只报告包围体相交
+ */
+_3D_Collide *collide_init(float margin)
+{
+    _3D_Collide *collide = (_3D_Collide *)calloc(1, sizeof(_3D_Collide));
+    collide->margin = margin > 0 ? margin : 0;
+    collide->dirty = true;
+    return collide;
+}
+
+// 单元增删后调用(单元序号变了),下次更新时重建网格
+void collide_invalidate(_3D_Collide *collide)
+{
+    collide->dirty = true;
+}
+
+//格子坐标映射到桶
+static uint32_t collide_hash(_3D_Collide *collide, int32_t coord[3])
+{
+    uint32_t h = ((uint32_t)coord[0] * 73856093u) ^ ((uint32_t)coord[1] * 19349663u) ^ ((uint32_t)coord[2] * 83492791u);
+    return h & (collide->bucketMax - 1);
+}
+
+//单元挂到所在格子的桶(链表头)
+static void collide_link(_3D_Collide *collide, uint32_t i)
+{
+    uint32_t h = collide_hash(collide, collide->coord[i]);
+    collide->prev[i] = COLLIDE_NONE;
+    collide->next[i] = collide->bucket[h];
+    if (collide->next[i] != COLLIDE_NONE)
+        collide->prev[collide->next[i]] = i;
+    collide->bucket[h] = i;
+}
+
+//单元从所在格子的桶中摘下
+static void collide_unlink(_3D_Collide *collide, uint32_t i)
+{
+    if (collide->prev[i] != COLLIDE_NONE)
+        collide->next[collide->prev[i]] = collide->next[i];
+    else
+        collide->bucket[collide_hash(collide, collide->coord[i])] = collide->next[i];
+    if (collide->next[i] != COLLIDE_NONE)
+        collide->prev[collide->next[i]] = collide->prev[i];
+}
+
+//单元包围球在空间中的球心和半径, 返回半径, -1/空模型
+static float collide_sphere(float xyz[3], float quat[4], _3D_Model *model, float center[3])
+{
+    float rs[3][3];
+    int k;
+    if (!model || !model->bound.valid)
+        return -1;
+    quat_to_matrix(quat, rs, false);
+    for (k = 0; k < 3; k++)
+        center[k] = rs[k][0] * model->bound.center[0] + rs[k][1] * model->bound.center[1] + rs[k][2] * model->bound.center[2] + xyz[k];
+    return model->bound.radius;
+}
+
+//球心所在的格子
+static void collide_coord(_3D_Collide *collide, float center[3], int32_t coord[3])
+{
+    coord[0] = (int32_t)floorf(center[0] / collide->cell);
+    coord[1] = (int32_t)floorf(center[1] / collide->cell);
+    coord[2] = (int32_t)floorf(center[2] / collide->cell);
+}
+
+//重建网格: 按最大包围球半径定网格边长,所有单元重新入桶
+static void collide_rebuild(_3D_Collide *collide, float (*xyz)[3], float (*quat)[4], _3D_Model **model, uint32_t total)
+{
+    uint32_t i, max;
+    //扩容(加倍)
+    if (total > collide->max)
+    {
+        for (max = collide->max > 0 ? collide->max : 64; max < total; max *= 2)
+            ;
+        collide->coord = realloc(collide->coord, max * sizeof(*collide->coord));
+        collide->center = realloc(collide->center, max * sizeof(*collide->center));
+        collide->radius = (float *)realloc(collide->radius, max * sizeof(float));
+        collide->next = (uint32_t *)realloc(collide->next, max * sizeof(uint32_t));
+        collide->prev = (uint32_t *)realloc(collide->prev, max * sizeof(uint32_t));
+        collide->max = max;
+    }
+    //桶数不少于单元数的2倍
+    for (max = 64; max < total * 2; max *= 2)
+        ;
+    if (max != collide->bucketMax)
+    {
+        collide->bucket = (uint32_t *)realloc(collide->bucket, max * sizeof(uint32_t));
+        collide->bucketMax = max;
+    }
+    memset(collide->bucket, 0xFF, collide->bucketMax * sizeof(uint32_t));
+    //网格边长
+    collide->radiusMax = 0;
+    for (i = 0; i < total; i++)
+    {
+        collide->radius[i] = collide_sphere(xyz[i], quat[i], model[i], collide->center[i]);
+        if (collide->radius[i] > collide->radiusMax)
+            collide->radiusMax = collide->radius[i];
+    }
+    collide->cell = collide->radiusMax * 2 + collide->margin;
+    if (collide->cell < 1.0f)
+        collide->cell = 1.0f;
+    //入桶
+    for (i = 0; i < total; i++)
+    {
+        if (collide->radius[i] < 0)
+            continue;
+        collide_coord(collide, collide->center[i], collide->coord[i]);
+        collide_link(collide, i);
+    }
+    collide->total = total;
+    collide->moved = total;
+    collide->dirty = false;
+}
+
+/*
+ *  按单元的最新位置更新网格: 单元数变化、标记重建或出现更大的包围球时重建,否则只搬动换了格子的单元
+ *  参数:
+ *      xyz, quat, model: 各单元的位置、朝向、模型(同 _3D_Unit),序号 0 ~ total-1
+ */
+void collide_update(_3D_Collide *collide, float (*xyz)[3], float (*quat)[4], _3D_Model **model, uint32_t total)
+{
+    int32_t coord[3];
+    float radius;
+    uint32_t i;
+    if (collide->dirty || total != collide->total)
+    {
+        collide_rebuild(collide, xyz, quat, model, total);
+        return;
+    }
+    collide->moved = 0;
+    for (i = 0; i < total; i++)
+    {
+        radius = collide_sphere(xyz[i], quat[i], model[i], collide->center[i]);
+        //模型变大,网格边长不够了
+        if (radius > collide->radiusMax)
+        {
+            collide_rebuild(collide, xyz, quat, model, total);
+            return;
+        }
+        if (radius < 0)
+        {
+            if (collide->radius[i] >= 0)
+                collide_unlink(collide, i);
+            collide->radius[i] = radius;
+            continue;
+        }
+        collide_coord(collide, collide->center[i], coord);
+        if (collide->radius[i] >= 0)
+        {
+            //还在原来的格子
+            if (coord[0] == collide->coord[i][0] && coord[1] == collide->coord[i][1] && coord[2] == collide->coord[i][2])
+            {
+                collide->radius[i] = radius;
+                continue;
+            }
+            collide_unlink(collide, i);
+        }
+        memcpy(collide->coord[i], coord, sizeof(coord));
+        collide->radius[i] = radius;
+        collide_link(collide, i);
+        collide->moved += 1;
+    }
+}
+
+/*
+ *  有向包围盒相交(分离轴定理,15个轴),包围盒各向外扩 margin/2
+ *  参数:
+ *      xyz, quat, model: 两个单元的位置、朝向、模型
+ */
+static bool collide_obb(float *xyz[2], float *quat[2], _3D_Model *model[2], float margin)
+{
+    float rs[2][3][3], c[2][3], e[2][3];
+    float R[3][3], AbsR[3][3], d[3], t[3];
+    float ra, rb, *box;
+    int u, i, j;
+
+    for (u = 0; u < 2; u++)
+    {
+        box = model[u]->bound.aabb;
+        quat_to_matrix(quat[u], rs[u], false);
+        for (i = 0; i < 3; i++)
+        {
+            e[u][i] = (box[3 + i] - box[i]) / 2 + margin / 2;
+            d[i] = (box[3 + i] + box[i]) / 2;
+        }
+        for (i = 0; i < 3; i++)
+            c[u][i] = rs[u][i][0] * d[0] + rs[u][i][1] * d[1] + rs[u][i][2] * d[2] + xyz[u][i];
+    }
+    //盒 b 的轴在盒 a 坐标系中的表示(轴为旋转矩阵的列),加小量避免轴平行时叉积为0
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            R[i][j] = rs[0][0][i] * rs[1][0][j] + rs[0][1][i] * rs[1][1][j] + rs[0][2][i] * rs[1][2][j];
+            AbsR[i][j] = fabsf(R[i][j]) + 1e-6f;
+        }
+    }
+    for (i = 0; i < 3; i++)
+        d[i] = c[1][i] - c[0][i];
+    for (i = 0; i < 3; i++)
+        t[i] = rs[0][0][i] * d[0] + rs[0][1][i] * d[1] + rs[0][2][i] * d[2];
+
+    //盒 a 的3个轴
+    for (i = 0; i < 3; i++)
+    {
+        ra = e[0][i];
+        rb = e[1][0] * AbsR[i][0] + e[1][1] * AbsR[i][1] + e[1][2] * AbsR[i][2];
+        if (fabsf(t[i]) > ra + rb)
+            return false;
+    }
+    //盒 b 的3个轴
+    for (j = 0; j < 3; j++)
+    {
+        ra = e[0][0] * AbsR[0][j] + e[0][1] * AbsR[1][j] + e[0][2] * AbsR[2][j];
+        rb = e[1][j];
+        if (fabsf(t[0] * R[0][j] + t[1] * R[1][j] + t[2] * R[2][j]) > ra + rb)
+            return false;
+    }
+    //两盒轴的叉积 Ai x Bj
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ra = e[0][(i + 1) % 3] * AbsR[(i + 2) % 3][j] + e[0][(i + 2) % 3] * AbsR[(i + 1) % 3][j];
+            rb = e[1][(j + 1) % 3] * AbsR[i][(j + 2) % 3] + e[1][(j + 2) % 3] * AbsR[i][(j + 1) % 3];
+            if (fabsf(t[(i + 2) % 3] * R[(i + 1) % 3][j] - t[(i + 1) % 3] * R[(i + 2) % 3][j]) > ra + rb)
+                return false;
+        }
+    }
+    return true;
+}
+
+//追加接触对(扩容加倍)
+static void collide_pair_add(_3D_Collide *collide, uint32_t a, uint32_t b, float gap)
+{
+    if (collide->pairTotal >= collide->pairMax)
+    {
+        collide->pairMax = collide->pairMax > 0 ? collide->pairMax * 2 : 64;
+        collide->pair = (_3D_CollidePair *)realloc(collide->pair, collide->pairMax * sizeof(_3D_CollidePair));
+    }
+    collide->pair[collide->pairTotal].a = a;
+    collide->pair[collide->pairTotal].b = b;
+    collide->pair[collide->pairTotal].gap = gap;
+    collide->pairTotal += 1;
+}
+
+/*
+ *  检测接触对,结果放在 collide->pair,按单元序号 a 升序
+ *  参数: 同 collide_update(),需先调用 collide_update()
+ *
+ *  返回: 接触对数
+ */
+uint32_t collide_query(_3D_Collide *collide, float (*xyz)[3], float (*quat)[4], _3D_Model **model, uint32_t total)
+{
+    int32_t coord[3];
+    float d[3], gap;
+    float *pairXyz[2], *pairQuat[2];
+    _3D_Model *pairModel[2];
+    uint32_t i, j, n;
+
+    collide->pairTotal = 0;
+    if (total != collide->total)
+        return 0;
+    for (i = 0; i < total; i++)
+    {
+        if (collide->radius[i] < 0)
+            continue;
+        //相邻的27个格子(每对只在序号小的一方检测一次)
+        for (n = 0; n < 27; n++)
+        {
+            coord[0] = collide->coord[i][0] + (int32_t)(n % 3) - 1;
+            coord[1] = collide->coord[i][1] + (int32_t)(n / 3 % 3) - 1;
+            coord[2] = collide->coord[i][2] + (int32_t)(n / 9) - 1;
+            for (j = collide->bucket[collide_hash(collide, coord)]; j != COLLIDE_NONE; j = collide->next[j])
+            {
+                //同一桶里其它格子的单元
+                if (j <= i || collide->coord[j][0] != coord[0] || collide->coord[j][1] != coord[1] || collide->coord[j][2] != coord[2])
+                    continue;
+                //包围球
+                d[0] = collide->center[j][0] - collide->center[i][0];
+                d[1] = collide->center[j][1] - collide->center[i][1];
+                d[2] = collide->center[j][2] - collide->center[i][2];
+                gap = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) - collide->radius[i] - collide->radius[j];
+                if (gap > collide->margin)
+                    continue;
+                //有向包围盒
+                pairXyz[0] = xyz[i];
+                pairXyz[1] = xyz[j];
+                pairQuat[0] = quat[i];
+                pairQuat[1] = quat[j];
+                pairModel[0] = model[i];
+                pairModel[1] = model[j];
+                if (!collide_obb(pairXyz, pairQuat, pairModel, collide->margin))
+                    continue;
+                collide_pair_add(collide, i, j, gap);
+            }
+        }
+    }
+    return collide->pairTotal;
+}
+
+// 内存销毁
+void collide_release(_3D_Collide **collide)
+{
+    if (collide && (*collide))
+    {
+        if ((*collide)->max > 0)
+        {
+            free((*collide)->coord);
+            free((*collide)->center);
+            free((*collide)->radius);
+            free((*collide)->next);
+            free((*collide)->prev);
+        }
+        if ((*collide)->bucket)
+            free((*collide)->bucket);
+        if ((*collide)->pair)
+            free((*collide)->pair);
+        free(*collide);
+        *collide = NULL;
+    }
+}
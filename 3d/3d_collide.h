@@ -0,0 +1,80 @@
+/*
+ *  单元的碰撞/接近检测: 均匀网格粗筛(空间哈希,每次运动计算后只搬动换了格子的单元),
+ *  再对候选对依次做包围球、有向包围盒(OBB)的精确判断,总开销约为 O(N)
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_COLLIDE_H_
+#define _3D_COLLIDE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "3d_model.h"
+
+// 链表结束/不在网格中
+#define COLLIDE_NONE 0xFFFFFFFF
+
+// 一对接触的单元(单元序号 a < b)
+typedef struct _3DCollidePair
+{
+    uint32_t a, b;
+    float gap; //包围球表面间距,负数为相交深度
+} _3D_CollidePair;
+
+/*
+ *  网格边长取 2 * 最大包围球半径 + margin,接触的两个单元球心必在相邻(含自身)的27个格子内
+ *  格子坐标经哈希映射到桶,桶内是单元序号的双向链表,不同格子落在同一桶时按格子坐标区分
+ */
+typedef struct _3DCollide
+{
+    float margin;    //接近距离: 两个包围体外扩 margin 后相交即算接触
+    float cell;      //网格边长
+    float radiusMax; //建网格时的最大包围球半径,出现更大的单元时重建
+
+    int32_t (*coord)[3]; //各单元所在的格子坐标
+    float (*center)[3];  //各单元包围球球心(空间坐标)
+    float *radius;       //各单元包围球半径, <0 为空模型(不参与检测)
+    uint32_t *next;      //同一桶的下一个/上一个单元
+    uint32_t *prev;
+    uint32_t total, max; //单元数,容量
+
+    uint32_t *bucket;   //各桶的链表头
+    uint32_t bucketMax; //桶数,2的幂
+    bool dirty;         //单元序号变动(增删),下次更新时重建
+
+    _3D_CollidePair *pair; //最近一次检测的接触对
+    uint32_t pairTotal, pairMax;
+    uint32_t moved; //最近一次更新中换了格子的单元数(重建时为全部)
+} _3D_Collide;
+
+/*
+ *  初始化
+ *  参数:
+ *      margin: 接近距离, 0/只报告包围体相交
+ */
+_3D_Collide *collide_init(float margin);
+
+// 单元增删后调用(单元序号变了),下次更新时重建网格
+void collide_invalidate(_3D_Collide *collide);
+
+/*
+ *  按单元的最新位置更新网格: 单元数变化、标记重建或出现更大的包围球时重建,否则只搬动换了格子的单元
+ *  参数:
+ *      xyz, quat, model: 各单元的位置、朝向、模型(同 _3D_Unit),序号 0 ~ total-1
+ */
+void collide_update(_3D_Collide *collide, float (*xyz)[3], float (*quat)[4], _3D_Model **model, uint32_t total);
+
+/*
+ *  检测接触对,结果放在 collide->pair,按单元序号 a 升序
+ *  参数: 同 collide_update(),需先调用 collide_update()
+ *
+ *  返回: 接触对数
+ */
+uint32_t collide_query(_3D_Collide *collide, float (*xyz)[3], float (*quat)[4], _3D_Model **model, uint32_t total);
+
+// 内存销毁
+void collide_release(_3D_Collide **collide);
+
+#endif
@@ -9,91 +9,329 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "3d_engine.h"
 #include "2d_draw.h"
 
-// 延时
-#include <sys/time.h>
-void engine_delayus(unsigned int us)
-{
-    struct timeval tv;
-    tv.tv_sec = us / 1000000;
-    tv.tv_usec = us % 1000000;
-    select(0, NULL, NULL, NULL, &tv);
-}
-long engine_getTickUs(void)
-{
-    struct timeval tv = {0};
-    gettimeofday(&tv, NULL);
-    return (long)(tv.tv_sec * 1000000u + tv.tv_usec);
-}
-// 自校准延时
-#define ENGINE_DELAY_INIT \
-    long _tick1 = 0, _tick2 = 0;
-#define ENGINE_DELAY_US(us)                      \
-    _tick2 = engine_getTickUs();                 \
-    if (_tick2 > _tick1 && _tick2 - _tick1 < us) \
-        engine_delayus(us - (_tick2 - _tick1));  \
-    _tick1 = engine_getTickUs();
-
-//根据sport运动状态,更新位置和旋转角度(朝向)
-static void engine_sport(_3D_Engine *engine, _3D_Sport *sport)
-{
-    uint32_t count;
-    float _speed_angle[3];
-    //平移
-    for (count = 0; count < 3; count++)
-    {
-        sport->xyz[count] += sport->speed[count] * engine->intervalMs / 1000;
-        //范围限制(循环进出)
-        if (sport->xyz[count] > engine->xyzRange[count][1])
-            sport->xyz[count] -= engine->xyzSize[count];
-        else if (sport->xyz[count] < engine->xyzRange[count][0])
-            sport->xyz[count] += engine->xyzSize[count];
-    }
-    //旋转
-    // for (count = 0; count < 3; count++)
-    // {
-    //     sport->roll_xyz[count] += sport->speed_angle[count] * engine->intervalMs / 1000;
-    //     //范围限制
-    //     if (sport->roll_xyz[count] > 360)
-    //         sport->roll_xyz[count] -= 360;
-    //     else if (sport->roll_xyz[count] < -360)
-    //         sport->roll_xyz[count] += 360;
-    // }
-    _speed_angle[0] = sport->speed_angle[0] * engine->intervalMs / 1000;
-    _speed_angle[1] = sport->speed_angle[1] * engine->intervalMs / 1000;
-    _speed_angle[2] = sport->speed_angle[2] * engine->intervalMs / 1000;
-    quat_diff2(sport->quat, _speed_angle);
-    quat_to_pry2(sport->quat, sport->roll_xyz);
-}
-
-// 主线程
+#ifndef M_PI //理论上在 math.h 中有定义
+#define M_PI 3.14159265358979323846
+#endif
+
+// 单调时钟,单位:ns (不受系统改时间影响)
+#include <time.h>
+#include <errno.h>
+static uint64_t engine_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+// 睡眠到绝对时刻 ns (被信号打断时继续睡)
+static void engine_sleep_until(uint64_t ns)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000u);
+    ts.tv_nsec = (long)(ns % 1000000000u);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/*
+ *  平移和范围限制(循环进出): 单元的 xyz、speed 各自连续,每 ENGINE_TICK_LANE 个单元一组,
+ *  min/max/size 按一组的 xyz 排列展开,组内循环次数固定,编译器展开成SIMD指令
+ */
+static void engine_tick_move(float *restrict xyz, float *restrict speed, uint32_t lane, float dt,
+    float *restrict min, float *restrict max, float *restrict size)
+{
+    float p;
+    uint32_t i, k;
+    for (i = 0; i < lane; i++, xyz += 3 * ENGINE_TICK_LANE, speed += 3 * ENGINE_TICK_LANE)
+    {
+        for (k = 0; k < 3 * ENGINE_TICK_LANE; k++)
+        {
+            p = xyz[k] + speed[k] * dt;
+            xyz[k] = p - size[k] * (p > max[k]) + size[k] * (p < min[k]);
+        }
+    }
+}
+
+/*
+ *  运动计算: 更新序号 [start, end) 的单元, start 是 ENGINE_TICK_LANE 的倍数
+ *  每 ENGINE_TICK_LANE 个单元一组,组内循环次数固定、没有分支和函数调用,编译器展开成SIMD指令;
+ *  最后一组不足时多算的是容量内的空位(见 engine_unit_reserve),结果不用
+ *  朝向只积分四元数,欧拉角 roll_xyz 在 engine_sport_get() 时才换算
+ */
+static void engine_tick_lanes(_3D_Engine *engine, uint32_t start, uint32_t end,
+    float *min, float *max, float *size)
+{
+    _3D_Unit *unit = &engine->unit;
+    float dt = (float)engine->intervalMs / 1000;
+    float rad = dt * (float)(M_PI / 180) / 2;
+    float q[4][ENGINE_TICK_LANE], w[3][ENGINE_TICK_LANE], norm[ENGINE_TICK_LANE];
+    uint32_t i, k, c;
+
+    //保留这一步之前的状态,抓拍在前后两步之间插值
+    memcpy(unit->xyzPrev[start], unit->xyz[start], (end - start) * sizeof(*unit->xyz));
+    memcpy(unit->quatPrev[start], unit->quat[start], (end - start) * sizeof(*unit->quat));
+
+    engine_tick_move(unit->xyz[start], unit->speed[start], (end - start + ENGINE_TICK_LANE - 1) / ENGINE_TICK_LANE, dt, min, max, size);
+
+    for (i = start; i < end; i += ENGINE_TICK_LANE)
+    {
+        //旋转: 四元数微分方程(同 quat_diff2),先转置成按分量存放
+        for (k = 0; k < ENGINE_TICK_LANE; k++)
+        {
+            for (c = 0; c < 4; c++)
+                q[c][k] = unit->quat[i + k][c];
+            for (c = 0; c < 3; c++)
+                w[c][k] = unit->speed_angle[i + k][c] * rad;
+        }
+        for (k = 0; k < ENGINE_TICK_LANE; k++)
+        {
+            q[0][k] += -q[1][k] * w[0][k] - q[2][k] * w[1][k] - q[3][k] * w[2][k];
+            q[1][k] += q[0][k] * w[0][k] + q[2][k] * w[2][k] - q[3][k] * w[1][k];
+            q[2][k] += q[0][k] * w[1][k] - q[1][k] * w[2][k] + q[3][k] * w[0][k];
+            q[3][k] += q[0][k] * w[2][k] + q[1][k] * w[1][k] - q[2][k] * w[0][k];
+            norm[k] = sqrtf(q[0][k] * q[0][k] + q[1][k] * q[1][k] + q[2][k] * q[2][k] + q[3][k] * q[3][k]);
+        }
+        for (k = 0; k < ENGINE_TICK_LANE; k++)
+        {
+            for (c = 0; c < 4; c++)
+                unit->quat[i + k][c] = q[c][k] / norm[k];
+        }
+    }
+
+    //混在组里的静止单元恢复原状态(静止单元的状态只在 engine_sport_set() 时改变,抓拍据此缓存)
+    for (i = start; i < end; i += ENGINE_TICK_LANE)
+    {
+        if (unit->laneMoving[i / ENGINE_TICK_LANE] == ENGINE_TICK_LANE)
+            continue;
+        for (k = i; k < i + ENGINE_TICK_LANE && k < end; k++)
+        {
+            if (unit->rest[k] == 0)
+                continue;
+            memcpy(unit->xyz[k], unit->xyzPrev[k], sizeof(unit->xyz[k]));
+            memcpy(unit->quat[k], unit->quatPrev[k], sizeof(unit->quat[k]));
+        }
+    }
+}
+
+/*
+ *  运动计算的一个任务: 更新序号 [index * ENGINE_TICK_CHUNK, +ENGINE_TICK_CHUNK) 的单元
+ *  整组静止的单元(见 _3D_Unit.rest)跳过,连续的非静止组一起计算
+ */
+static void engine_tick_task(void *argv, uint32_t index)
+{
+    _3D_Engine *engine = (_3D_Engine *)argv;
+    _3D_Unit *unit = &engine->unit;
+    uint32_t start = index * ENGINE_TICK_CHUNK;
+    uint32_t end = unit->total - start < ENGINE_TICK_CHUNK ? unit->total : start + ENGINE_TICK_CHUNK;
+    uint32_t lane = start / ENGINE_TICK_LANE;
+    uint32_t laneEnd = (end + ENGINE_TICK_LANE - 1) / ENGINE_TICK_LANE;
+    uint32_t run, k;
+    float min[3 * ENGINE_TICK_LANE], max[3 * ENGINE_TICK_LANE], size[3 * ENGINE_TICK_LANE];
+
+    //空间范围按一组单元的 xyz 排列展开
+    for (k = 0; k < 3 * ENGINE_TICK_LANE; k++)
+    {
+        min[k] = engine->xyzRange[k % 3][0];
+        max[k] = engine->xyzRange[k % 3][1];
+        size[k] = engine->xyzSize[k % 3];
+    }
+
+    while (lane < laneEnd)
+    {
+        if (unit->laneMoving[lane] == 0)
+        {
+            lane += 1;
+            continue;
+        }
+        for (run = lane + 1; run < laneEnd && unit->laneMoving[run] > 0; run++)
+            ;
+        engine_tick_lanes(engine, lane * ENGINE_TICK_LANE,
+            run * ENGINE_TICK_LANE < end ? run * ENGINE_TICK_LANE : end, min, max, size);
+        lane = run;
+    }
+}
+
+//快照扩容(加倍),只在发布方调用
+static void engine_snapshot_reserve(_3D_Snapshot *snap, uint32_t total)
+{
+    uint32_t max;
+    if (total <= snap->max)
+        return;
+    for (max = snap->max > 0 ? snap->max : 64; max < total; max *= 2)
+        ;
+    snap->xyz = realloc(snap->xyz, max * sizeof(*snap->xyz));
+    snap->quat = realloc(snap->quat, max * sizeof(*snap->quat));
+    snap->xyzPrev = realloc(snap->xyzPrev, max * sizeof(*snap->xyzPrev));
+    snap->quatPrev = realloc(snap->quatPrev, max * sizeof(*snap->quatPrev));
+    snap->rest = (uint32_t *)realloc(snap->rest, max * sizeof(uint32_t));
+    snap->model = (_3D_Model **)realloc(snap->model, max * sizeof(_3D_Model *));
+    snap->slot = (uint32_t *)realloc(snap->slot, max * sizeof(uint32_t));
+    snap->generation = (uint32_t *)realloc(snap->generation, max * sizeof(uint32_t));
+    snap->max = max;
+}
+
+/*
+ *  发布快照: 单元状态拷贝到后台一份,再与中间一份交换
+ *  调用方需持有 lock (运动计算持读锁,其它持写锁),保证同一时间只有一个发布方且单元数组不变
+ */
+static void engine_snapshot_publish(_3D_Engine *engine)
+{
+    _3D_Unit *unit = &engine->unit;
+    _3D_Snapshot *snap = &engine->snapshot[engine->snapshotBack];
+    uint32_t i;
+    engine_snapshot_reserve(snap, unit->total);
+    memcpy(snap->xyz, unit->xyz, unit->total * sizeof(*unit->xyz));
+    memcpy(snap->quat, unit->quat, unit->total * sizeof(*unit->quat));
+    memcpy(snap->xyzPrev, unit->xyzPrev, unit->total * sizeof(*unit->xyzPrev));
+    memcpy(snap->quatPrev, unit->quatPrev, unit->total * sizeof(*unit->quatPrev));
+    memcpy(snap->rest, unit->rest, unit->total * sizeof(uint32_t));
+    memcpy(snap->model, unit->model, unit->total * sizeof(_3D_Model *));
+    memcpy(snap->slot, unit->slot, unit->total * sizeof(uint32_t));
+    for (i = 0; i < unit->total; i++)
+        snap->generation[i] = unit->slotGeneration[unit->slot[i]];
+    snap->total = unit->total;
+    snap->tick = engine->tick;
+    snap->timeNs = engine->tickNs;
+    __atomic_store_n(&engine->snapshotDirty, false, __ATOMIC_RELAXED);
+    engine->snapshotBack = __atomic_exchange_n(&engine->snapshotMiddle,
+        engine->snapshotBack | ENGINE_SNAPSHOT_FRESH, __ATOMIC_ACQ_REL) & 3;
+}
+
+//抓拍取最新的快照: 中间一份更新过就与前台一份交换(只在抓拍中调用,持有 photoLock)
+static _3D_Snapshot *engine_snapshot_acquire(_3D_Engine *engine)
+{
+    //单元有增删、设置而运动计算还没发布(如暂停中),补发一次
+    if (__atomic_load_n(&engine->snapshotDirty, __ATOMIC_RELAXED))
+    {
+        pthread_rwlock_wrlock(&engine->lock);
+        if (engine->snapshotDirty)
+            engine_snapshot_publish(engine);
+        pthread_rwlock_unlock(&engine->lock);
+    }
+    if (__atomic_load_n(&engine->snapshotMiddle, __ATOMIC_ACQUIRE) & ENGINE_SNAPSHOT_FRESH)
+        engine->snapshotFront = __atomic_exchange_n(&engine->snapshotMiddle,
+            engine->snapshotFront, __ATOMIC_ACQ_REL) & 3;
+    return &engine->snapshot[engine->snapshotFront];
+}
+
+//一步运动计算: 单元分块交给线程池并行计算(需持有读锁)
+static void engine_tick_step(_3D_Engine *engine)
+{
+    uint32_t chunk = (engine->unit.total + ENGINE_TICK_CHUNK - 1) / ENGINE_TICK_CHUNK;
+    if (chunk == 1)
+        engine_tick_task(engine, 0);
+    else if (chunk > 1)
+        pool_run(engine->tickPool, &engine_tick_task, engine, chunk);
+    engine->tick += 1;
+}
+
+/*
+ *  碰撞/接近检测: 网格按单元的新位置增量更新,再检测接触对,单元序号换成句柄(需持有读锁)
+ *  contact[] 只在引擎线程中写,读取方持写锁
+ */
+static void engine_collide(_3D_Engine *engine)
+{
+    _3D_Unit *unit = &engine->unit;
+    _3D_Collide *collide = engine->collide;
+    _3D_CollidePair *pair;
+    uint32_t i, total;
+    collide_update(collide, unit->xyz, unit->quat, unit->model, unit->total);
+    total = collide_query(collide, unit->xyz, unit->quat, unit->model, unit->total);
+    if (total > engine->contactMax)
+    {
+        engine->contactMax = collide->pairMax;
+        engine->contact = (_3D_Contact *)realloc(engine->contact, engine->contactMax * sizeof(_3D_Contact));
+    }
+    for (i = 0; i < total; i++)
+    {
+        pair = &collide->pair[i];
+        engine->contact[i].a = ((_3D_Handle)unit->slotGeneration[unit->slot[pair->a]] << 32) | unit->slot[pair->a];
+        engine->contact[i].b = ((_3D_Handle)unit->slotGeneration[unit->slot[pair->b]] << 32) | unit->slot[pair->b];
+        engine->contact[i].gap = pair->gap;
+    }
+    engine->contactTotal = total;
+}
+
+/*
+ *  主线程: 固定步长调度
+ *      按绝对时刻 next 睡眠,醒来后补算落后的步数(最多 ENGINE_CATCHUP_MAX 步),
+ *      计算耗时、唤醒延迟都不会累积成漂移; 再落后就丢弃积压的步数,从当前时刻重新计时
+ */
 static void engine_thread(void *argv)
 {
     _3D_Engine *engine = (_3D_Engine *)argv;
-    _3D_Unit *unit;
-    _3D_Sport sport;
-    ENGINE_DELAY_INIT;
-    while (!engine->threadExit)
-    {
-        ENGINE_DELAY_US(engine->intervalMs * 1000);
-        //暂停状态
-        if (!engine->run)
+    uint64_t step = (uint64_t)engine->intervalMs * 1000000u;
+    uint64_t next, now, late, last;
+    uint64_t dropped;
+    uint32_t steps, i, moving;
+    float jitter, cost;
+    EngineContactCallback callback;
+    void *priv = NULL;
+
+    if (step < 1)
+        step = 1;
+    next = engine_time_ns() + step;
+    while (!__atomic_load_n(&engine->threadExit, __ATOMIC_ACQUIRE))
+    {
+        engine_sleep_until(next);
+        now = engine_time_ns();
+        late = now > next ? now - next : 0;
+        //落后几步补算几步
+        steps = late / step >= ENGINE_CATCHUP_MAX ? ENGINE_CATCHUP_MAX : (uint32_t)(late / step) + 1;
+        dropped = late / step + 1 - steps;
+        if (dropped > 0)
+        {
+            last = now;
+            next = now + step;
+        }
+        else
+        {
+            last = next + (steps - 1) * step;
+            next = last + step;
+        }
+        //暂停状态(保持节拍)
+        if (!__atomic_load_n(&engine->run, __ATOMIC_ACQUIRE))
             continue;
-        //遍历模型链表
-        pthread_mutex_lock(&engine->lock);
-        unit = engine->unit;
-        while (unit)
+        //期间只挡住增删单元和读写运动状态
+        pthread_rwlock_rdlock(&engine->lock);
+        for (i = 0; i < steps; i++)
+            engine_tick_step(engine);
+        engine->tickNs = last;
+        moving = engine->unit.moving;
+        //碰撞/接近检测(只检测最后一步)
+        callback = NULL;
+        if (engine->collide)
         {
-            //更新运动状态
-            memcpy(&sport, unit->sport, sizeof(sport));
-            engine_sport(engine, &sport);
-            memcpy(unit->sport, &sport, sizeof(sport));
-            //下一个
-            unit = unit->next;
+            engine_collide(engine);
+            callback = engine->contactCallback;
+            priv = engine->contactPriv;
         }
-        pthread_mutex_unlock(&engine->lock);
+        //发布给抓拍(不等待抓拍)
+        engine_snapshot_publish(engine);
+        pthread_rwlock_unlock(&engine->lock);
+        //接触回调(不持锁,回调里可以增删单元、读写运动状态)
+        if (callback)
+            callback(priv, engine->contact, engine->contactTotal);
+        //统计
+        jitter = (float)late / 1000;
+        cost = (float)(engine_time_ns() - now) / 1000;
+        pthread_mutex_lock(&engine->statsLock);
+        engine->stats.tick += steps;
+        engine->stats.moving = moving;
+        engine->stats.wakeup += 1;
+        engine->stats.overrun += steps > 1 ? 1 : 0;
+        engine->stats.dropped += dropped;
+        engine->stats.jitterUs = jitter;
+        engine->stats.jitterAvgUs = engine->stats.wakeup > 1 ? engine->stats.jitterAvgUs * 0.9f + jitter * 0.1f : jitter;
+        if (jitter > engine->stats.jitterMaxUs)
+            engine->stats.jitterMaxUs = jitter;
+        engine->stats.costUs = cost;
+        if (cost > engine->stats.costMaxUs)
+            engine->stats.costMaxUs = cost;
+        pthread_mutex_unlock(&engine->statsLock);
     }
 }
 
@@ -120,374 +358,958 @@ _3D_Engine *engine_init(uint32_t intervalMs, float xSize, float ySize, float zSi
     engine->xyzRange[1][1] = ySize / 2;
     engine->xyzRange[2][0] = -(zSize / 2);
     engine->xyzRange[2][1] = zSize / 2;
-    pthread_mutex_init(&engine->lock, NULL);
+    pthread_rwlock_init(&engine->lock, NULL);
+    pthread_mutex_init(&engine->photoLock, NULL);
+    pthread_mutex_init(&engine->statsLock, NULL);
+    engine->interpolate = true;
+    engine->tickNs = engine_time_ns();
+    engine->pool = pool_init(0);
+    engine->tickPool = pool_init(0);
+    //三份快照: 前台0,后台1,中间2
+    engine->snapshotFront = 0;
+    engine->snapshotBack = 1;
+    engine->snapshotMiddle = 2;
+    engine->render = render_init();
     pthread_create(&engine->th, NULL, (void *)&engine_thread, engine);
     return engine;
 }
 
+//单元数组扩容(加倍),保证能放下 total 个单元,容量总是 ENGINE_TICK_LANE 的倍数
+static void engine_unit_reserve(_3D_Unit *unit, uint32_t total)
+{
+    uint32_t max, i;
+    if (total <= unit->max)
+        return;
+    for (max = unit->max > 0 ? unit->max : 64; max < total; max *= 2)
+        ;
+    unit->xyz = realloc(unit->xyz, max * sizeof(*unit->xyz));
+    unit->speed = realloc(unit->speed, max * sizeof(*unit->speed));
+    unit->speed_angle = realloc(unit->speed_angle, max * sizeof(*unit->speed_angle));
+    unit->quat = realloc(unit->quat, max * sizeof(*unit->quat));
+    unit->xyzPrev = realloc(unit->xyzPrev, max * sizeof(*unit->xyzPrev));
+    unit->quatPrev = realloc(unit->quatPrev, max * sizeof(*unit->quatPrev));
+    unit->rest = (uint32_t *)realloc(unit->rest, max * sizeof(uint32_t));
+    unit->laneMoving = (uint8_t *)realloc(unit->laneMoving, max / ENGINE_TICK_LANE);
+    unit->model = (_3D_Model **)realloc(unit->model, max * sizeof(_3D_Model *));
+    unit->slot = (uint32_t *)realloc(unit->slot, max * sizeof(uint32_t));
+    unit->slotUnit = (uint32_t *)realloc(unit->slotUnit, max * sizeof(uint32_t));
+    unit->slotGeneration = (uint32_t *)realloc(unit->slotGeneration, max * sizeof(uint32_t));
+    unit->slotFree = (uint32_t *)realloc(unit->slotFree, max * sizeof(uint32_t));
+    //新增的空位清零(运动计算按组进行,末尾的空位也会参与计算)
+    memset(&unit->xyz[unit->max], 0, (max - unit->max) * sizeof(*unit->xyz));
+    memset(&unit->speed[unit->max], 0, (max - unit->max) * sizeof(*unit->speed));
+    memset(&unit->speed_angle[unit->max], 0, (max - unit->max) * sizeof(*unit->speed_angle));
+    memset(&unit->quat[unit->max], 0, (max - unit->max) * sizeof(*unit->quat));
+    memset(&unit->rest[unit->max], 0, (max - unit->max) * sizeof(uint32_t));
+    memset(&unit->laneMoving[unit->max / ENGINE_TICK_LANE], 0, (max - unit->max) / ENGINE_TICK_LANE);
+    for (i = unit->max; i < max; i++)
+        unit->quat[i][0] = 1.0f;
+    unit->max = max;
+}
+
+//句柄对应的单元序号(需持有 lock), -1/句柄已失效
+static int64_t engine_unit_find(_3D_Unit *unit, _3D_Handle handle)
+{
+    uint32_t slot = (uint32_t)handle;
+    uint32_t generation = (uint32_t)(handle >> 32);
+    if (slot >= unit->slotTotal || unit->slotGeneration[slot] != generation)
+        return -1;
+    return unit->slotUnit[slot];
+}
+
+//在动的单元计入/移出所在组的计数
+static void engine_unit_moving(_3D_Unit *unit, uint32_t i, int32_t delta)
+{
+    if (unit->rest[i] != 0)
+        return;
+    unit->laneMoving[i / ENGINE_TICK_LANE] += delta;
+    unit->moving += delta;
+}
+
+//按速度、角速度更新静止标记(需持有写锁),进入静止时分配新的编号
+static void engine_unit_rest(_3D_Unit *unit, uint32_t i)
+{
+    engine_unit_moving(unit, i, -1);
+    if (unit->speed[i][0] == 0 && unit->speed[i][1] == 0 && unit->speed[i][2] == 0 &&
+        unit->speed_angle[i][0] == 0 && unit->speed_angle[i][1] == 0 && unit->speed_angle[i][2] == 0)
+    {
+        if (++unit->restStamp == 0)
+            unit->restStamp = 1;
+        unit->rest[i] = unit->restStamp;
+    }
+    else
+        unit->rest[i] = 0;
+    engine_unit_moving(unit, i, 1);
+}
+
 /*
  *  添加模型
  *  参数:
  *      xyz: 在空间中的初始位置(可以置NULL)
  *      roll_xyz: 绕自身坐标系旋转角度,即朝向,欧拉角,单位:度(可以置NULL)
  * 
- *  返回: 模型运动控制器,可进行异步控制、获取模型的运动状态
+ *  返回: 单元句柄,用于异步控制、获取模型的运动状态, ENGINE_HANDLE_NONE/失败
  *  其它: 当 xyz = NULL, roll_xyz = NULL 模型在空间默认位置为原点,面朝x轴正方向,头顶z轴正方向,左边y轴正方向
  */
-_3D_Sport *engine_model_add(_3D_Engine *engine, _3D_Model *model, float *xyz, float *roll_xyz)
+_3D_Handle engine_model_add(_3D_Engine *engine, _3D_Model *model, float *xyz, float *roll_xyz)
 {
-    _3D_Unit *unit, *tmpUnit;
+    _3D_Unit *unit = &engine->unit;
+    _3D_Handle handle;
+    uint32_t i, slot;
     //参数检查
     if (!model)
-        return NULL;
-    //参数初始化
-    unit = (_3D_Unit *)calloc(1, sizeof(_3D_Unit));
-    unit->sport = (_3D_Sport *)calloc(1, sizeof(_3D_Sport));
-    unit->sport->quat[0] = 1.0f;
-    unit->model = model;
+        return ENGINE_HANDLE_NONE;
+    pthread_rwlock_wrlock(&engine->lock);
+    engine_unit_reserve(unit, unit->total + 1);
+    //分配槽位: 优先用回收的
+    if (unit->slotFreeTotal > 0)
+        slot = unit->slotFree[--unit->slotFreeTotal];
+    else
+    {
+        slot = unit->slotTotal++;
+        unit->slotGeneration[slot] = 1;
+    }
+    //追加到末尾
+    i = unit->total++;
+    unit->slot[i] = slot;
+    unit->slotUnit[slot] = i;
+    memset(unit->xyz[i], 0, sizeof(unit->xyz[i]));
+    memset(unit->speed[i], 0, sizeof(unit->speed[i]));
+    memset(unit->speed_angle[i], 0, sizeof(unit->speed_angle[i]));
+    memset(unit->quat[i], 0, sizeof(unit->quat[i]));
+    unit->quat[i][0] = 1.0f;
+    unit->model[i] = model;
     if (xyz)
-        memcpy(unit->sport->xyz, xyz, sizeof(float) * 3);
+        memcpy(unit->xyz[i], xyz, sizeof(float) * 3);
     if (roll_xyz)
     {
-        pry_to_quat2(roll_xyz, unit->sport->quat);
-        quat_to_pry2(unit->sport->quat, unit->sport->roll_xyz);
+        pry_to_quat2(roll_xyz, unit->quat[i]);
     }
-    //加入链表
-    pthread_mutex_lock(&engine->lock);
-    if (engine->unit == NULL)
-        engine->unit = unit;
-    else
+    memcpy(unit->xyzPrev[i], unit->xyz[i], sizeof(unit->xyz[i]));
+    memcpy(unit->quatPrev[i], unit->quat[i], sizeof(unit->quat[i]));
+    unit->rest[i] = 1; //先按静止(不在计数中),再按速度更新
+    engine_unit_rest(unit, i);
+    handle = ((_3D_Handle)unit->slotGeneration[slot] << 32) | slot;
+    if (engine->collide)
+        collide_invalidate(engine->collide);
+    __atomic_store_n(&engine->snapshotDirty, true, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&engine->lock);
+    return handle;
+}
+
+// 模型移除,成功返回true (之后该句柄失效)
+bool engine_model_remove(_3D_Engine *engine, _3D_Handle handle)
+{
+    _3D_Unit *unit = &engine->unit;
+    int64_t i;
+    uint32_t last, slot;
+    pthread_rwlock_wrlock(&engine->lock);
+    i = engine_unit_find(unit, handle);
+    if (i < 0)
+    {
+        pthread_rwlock_unlock(&engine->lock);
+        return false;
+    }
+    //回收槽位,代数加1使旧句柄失效(跳过0,保证句柄不等于 ENGINE_HANDLE_NONE)
+    slot = unit->slot[i];
+    if (++unit->slotGeneration[slot] == 0)
+        unit->slotGeneration[slot] = 1;
+    unit->slotFree[unit->slotFreeTotal++] = slot;
+    //最后一个单元移到空位
+    engine_unit_moving(unit, i, -1);
+    last = --unit->total;
+    if (i != last)
     {
-        tmpUnit = engine->unit;
-        while (tmpUnit->next)
-            tmpUnit = tmpUnit->next;
-        tmpUnit->next = unit;
+        engine_unit_moving(unit, last, -1);
+        unit->rest[i] = unit->rest[last];
+        engine_unit_moving(unit, i, 1);
+        memcpy(unit->xyz[i], unit->xyz[last], sizeof(unit->xyz[i]));
+        memcpy(unit->speed[i], unit->speed[last], sizeof(unit->speed[i]));
+        memcpy(unit->speed_angle[i], unit->speed_angle[last], sizeof(unit->speed_angle[i]));
+        memcpy(unit->quat[i], unit->quat[last], sizeof(unit->quat[i]));
+        memcpy(unit->xyzPrev[i], unit->xyzPrev[last], sizeof(unit->xyzPrev[i]));
+        memcpy(unit->quatPrev[i], unit->quatPrev[last], sizeof(unit->quatPrev[i]));
+        unit->model[i] = unit->model[last];
+        unit->slot[i] = unit->slot[last];
+        unit->slotUnit[unit->slot[i]] = (uint32_t)i;
     }
-    pthread_mutex_unlock(&engine->lock);
-    return unit->sport;
+    if (engine->collide)
+        collide_invalidate(engine->collide);
+    __atomic_store_n(&engine->snapshotDirty, true, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&engine->lock);
+    return true;
 }
 
-// 模型移除,成功返回true (注意 sport 指针成功移除等于被释放,不能再使用)
-bool engine_model_remove(_3D_Engine *engine, _3D_Sport *sport)
+// 读取单元的运动状态,句柄已失效时返回false
+bool engine_sport_get(_3D_Engine *engine, _3D_Handle handle, _3D_Sport *sport)
 {
-    _3D_Unit *unit, *unitNext;
-    if (engine->unit)
+    _3D_Unit *unit = &engine->unit;
+    int64_t i;
+    pthread_rwlock_wrlock(&engine->lock);
+    i = engine_unit_find(unit, handle);
+    if (i >= 0)
     {
-        //是第一个
-        if (engine->unit->sport == sport)
-        {
-            pthread_mutex_lock(&engine->lock);
-            unit = engine->unit;
-            engine->unit = engine->unit->next;
-            free(unit->sport);
-            free(unit);
-            pthread_mutex_unlock(&engine->lock);
-            return true;
-        }
-        //不是第一个
-        else
-        {
-            //检索
-            unit = engine->unit;
-            unitNext = engine->unit->next;
-            while (unitNext && unitNext->sport != sport)
-            {
-                unit = unit->next;
-                unitNext = unit->next;
-            }
-            //移除
-            if (unitNext && unitNext->sport == sport)
-            {
-                pthread_mutex_lock(&engine->lock);
-                unit->next = unitNext->next;
-                free(unitNext->sport);
-                free(unitNext);
-                pthread_mutex_unlock(&engine->lock);
-                return true;
-            }
-        }
+        memcpy(sport->xyz, unit->xyz[i], sizeof(sport->xyz));
+        memcpy(sport->speed, unit->speed[i], sizeof(sport->speed));
+        memcpy(sport->speed_angle, unit->speed_angle[i], sizeof(sport->speed_angle));
+        memcpy(sport->quat, unit->quat[i], sizeof(sport->quat));
+    }
+    pthread_rwlock_unlock(&engine->lock);
+    //欧拉角由四元数换算(运动计算时不换算)
+    if (i >= 0)
+        quat_to_pry2(sport->quat, sport->roll_xyz);
+    return i >= 0;
+}
+
+// 设置单元的运动状态(朝向以 quat 为准, roll_xyz 忽略),句柄已失效时返回false
+bool engine_sport_set(_3D_Engine *engine, _3D_Handle handle, _3D_Sport *sport)
+{
+    _3D_Unit *unit = &engine->unit;
+    int64_t i;
+    pthread_rwlock_wrlock(&engine->lock);
+    i = engine_unit_find(unit, handle);
+    if (i >= 0)
+    {
+        memcpy(unit->xyz[i], sport->xyz, sizeof(sport->xyz));
+        memcpy(unit->speed[i], sport->speed, sizeof(sport->speed));
+        memcpy(unit->speed_angle[i], sport->speed_angle, sizeof(sport->speed_angle));
+        memcpy(unit->quat[i], sport->quat, sizeof(sport->quat));
+        //直接设置的状态不插值(相当于瞬移)
+        memcpy(unit->xyzPrev[i], sport->xyz, sizeof(sport->xyz));
+        memcpy(unit->quatPrev[i], sport->quat, sizeof(sport->quat));
+        engine_unit_rest(unit, i);
+        __atomic_store_n(&engine->snapshotDirty, true, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&engine->lock);
+    return i >= 0;
+}
+
+//单元模型坐标到空间坐标的变换矩阵: world = Rs * xyz + Ts
+static void engine_unit_world(float xyz[3], float quat[4], float world[3][4])
+{
+    float rs[3][3];
+    int i;
+    quat_to_matrix(quat, rs, false);
+    for (i = 0; i < 3; i++)
+    {
+        memcpy(world[i], rs[i], sizeof(rs[i]));
+        world[i][3] = xyz[i];
     }
-    return false;
 }
 
 /*
- *  模型根据当前运动状态更新位置
+ *  合成模型坐标到相机坐标的变换矩阵(每个单元每次抓拍只算一次)
+ *      模型坐标先按单元的空间变换到空间坐标,再平移、逆旋转到相机坐标:
+ *      camera = Rc' * (Rs * xyz + Ts - Tc) = (Rc' * Rs) * xyz + Rc' * (Ts - Tc)
  *  参数:
- *      xyz[3 * pointTotal]: 坐标点数组
- *      retXyz[3 * pointTotal]: 坐标点数组
- *      pointTotal: 数组中坐标点的个数
+ *      world[3][4]: 单元的空间变换,见 engine_unit_world()
+ *      rc[3][3]: 相机的逆旋转矩阵 Rc' (每次抓拍算一次)
+ *      matrix[3][4]: 返回3x4变换矩阵,配合 matrix_transform() 使用
  */
-static void engine_position(_3D_Sport *sport, float *xyz, float *retXyz, uint32_t pointTotal)
+static void engine_model_view(float world[3][4], float rc[3][3], _3D_CameraPosition *position, float matrix[3][4])
 {
-    uint32_t xyzCount;
-    //转存
-    for (xyzCount = 0; xyzCount < pointTotal * 3; xyzCount++)
-        retXyz[xyzCount] = xyz[xyzCount];
-    //先旋转
-    for (xyzCount = 0; xyzCount < pointTotal * 3; xyzCount += 3)
+    float t[3];
+    int i, j;
+    t[0] = world[0][3] - position->xyz[0];
+    t[1] = world[1][3] - position->xyz[1];
+    t[2] = world[2][3] - position->xyz[2];
+    for (i = 0; i < 3; i++)
     {
-        //用姿态四元数直接旋转向量
-        quat_roll(sport->quat, NULL, 0, &retXyz[xyzCount], false);
+        for (j = 0; j < 3; j++)
+            matrix[i][j] = rc[i][0] * world[0][j] + rc[i][1] * world[1][j] + rc[i][2] * world[2][j];
+        matrix[i][3] = rc[i][0] * t[0] + rc[i][1] * t[1] + rc[i][2] * t[2];
     }
-    //再平移
-    for (xyzCount = 0; xyzCount < pointTotal * 3;)
+}
+
+/*
+ *  单元是否完全在相机视锥之外(使用模型的包围体,不遍历顶点)
+ *  参数:
+ *      matrix[3][4]: 模型坐标到相机坐标的变换矩阵,只含旋转和平移,不改变包围球半径
+ */
+static bool engine_unit_isOutside(_3D_Camera *camera, _3D_Model *model, float matrix[3][4])
+{
+    float center[3];
+    float corner[8 * 3];
+    uint32_t c;
+    //空模型
+    if (!model->bound.valid)
+        return true;
+    //包围球
+    matrix_transform(matrix, model->bound.center, center, 1);
+    if (camera_isOutsideSphere(camera, center, model->bound.radius))
+        return true;
+    //包围盒的8个角点
+    for (c = 0; c < 8; c++)
     {
-        //注意这里要反方向平移
-        retXyz[xyzCount++] += sport->xyz[0];
-        retXyz[xyzCount++] += sport->xyz[1];
-        retXyz[xyzCount++] += sport->xyz[2];
+        corner[c * 3 + 0] = model->bound.aabb[(c & 1) ? 3 : 0];
+        corner[c * 3 + 1] = model->bound.aabb[(c & 2) ? 4 : 1];
+        corner[c * 3 + 2] = model->bound.aabb[(c & 4) ? 5 : 2];
     }
+    matrix_transform(matrix, corner, corner, 8);
+    return camera_isOutside(camera, corner, 8);
 }
 
 /*
- *  三维坐标点相对于相机的位置转换
+ *  按包围球投影半径选用细节层次
  *  参数:
- *      xyz[3 * pointTotal]: 坐标点数组
- *      retXyz[3 * pointTotal]: 坐标点数组
- *      pointTotal: 数组中坐标点的个数
+ *      matrix[3][4]: 模型坐标到相机坐标的变换矩阵
+ *
+ *  返回: 本次抓拍使用的模型
+ */
+static _3D_Model *engine_unit_lod(_3D_Model *model, _3D_UnitLod *lod, _3D_Camera *camera, float matrix[3][4])
+{
+    float center[3];
+    uint32_t i, level = 0, *slot = &level;
+    if (model->lodTotal < 1)
+        return model;
+    //相机在包围球内时用原模型
+    matrix_transform(matrix, model->bound.center, center, 1);
+    if (center[0] <= model->bound.radius)
+        return model;
+    //该相机上次的选择
+    for (i = 0; i < ENGINE_LOD_CAMERA_MAX; i++)
+    {
+        if (lod->camera[i] == camera || !lod->camera[i])
+        {
+            lod->camera[i] = camera;
+            slot = &lod->level[i];
+            break;
+        }
+    }
+    *slot = model_lod_level(model, model->bound.radius * camera->proj.scale / center[0], *slot);
+    return *slot > 0 ? model->lod[*slot - 1] : model;
+}
+
+//顶点缓存扩容(加倍),保证能放下 total 个顶点
+static void engine_cache_reserve(_3D_VertexCache *cache, uint32_t total)
+{
+    if (total <= cache->max)
+        return;
+    cache->max = cache->max * 2 > total ? cache->max * 2 : total;
+    cache->xyz = (float *)realloc(cache->xyz, cache->max * sizeof(float) * 3);
+    cache->xy = (float *)realloc(cache->xy, cache->max * sizeof(float) * 2);
+    cache->depth = (float *)realloc(cache->depth, cache->max * sizeof(float));
+    cache->out = (uint16_t *)realloc(cache->out, cache->max * sizeof(uint16_t));
+    cache->allocs += 4;
+}
+
+/*
+ *  把模型的所有顶点按各实例的矩阵变换到相机坐标系,并计算屏幕坐标和视锥标志位,各实例的顶点依次存放
+ *  在近端之前的顶点屏幕坐标无意义(可能为inf),但用到它的图元一定会进入裁剪流程而不使用该值
  */
-static void engine_position_of_camera(_3D_CameraPosition *position, float *xyz, float *retXyz, uint32_t pointTotal)
+static void engine_cache_vertex(_3D_VertexCache *cache, _3D_Camera *camera, _3D_Model *model, float (*matrix)[3][4], uint32_t matrixTotal)
 {
-    uint32_t xyzCount;
-    //先把相机的平移转嫁为坐标点相对相机的平移(即让坐标点以相机位置作为原点)
-    for (xyzCount = 0; xyzCount < pointTotal * 3;)
+    uint32_t c, total = model->xyzTotal * matrixTotal;
+    engine_cache_reserve(cache, total);
+    //量化编码: 反量化合并进各实例的矩阵
+    if (model->xyzQ)
     {
-        //注意这里要反方向平移
-        retXyz[xyzCount] = xyz[xyzCount] - position->xyz[0];
-        xyzCount += 1;
-        retXyz[xyzCount] = xyz[xyzCount] - position->xyz[1];
-        xyzCount += 1;
-        retXyz[xyzCount] = xyz[xyzCount] - position->xyz[2];
-        xyzCount += 1;
+        for (c = 0; c < matrixTotal; c++)
+            matrix_transform_q16(matrix[c], model->quantOffset, model->quantScale, model->xyzQ, &cache->xyz[c * model->xyzTotal * 3], model->xyzTotal);
     }
-    //再把相机自身的旋转转嫁为坐标点相对相机的旋转
-    for (xyzCount = 0; xyzCount < pointTotal * 3; xyzCount += 3)
+    else
+        matrix_transform_batch(matrix, matrixTotal, model->xyz, cache->xyz, model->xyzTotal);
+    projection_batch_float(&camera->proj, cache->xyz, total, cache->xy, cache->depth);
+    for (c = 0; c < total; c++)
+        cache->out[c] = camera_outcode(camera, &cache->xyz[c * 3]);
+}
+
+//实例分组扩容(加倍),保证能放下 total 个实例
+static void engine_instance_reserve(_3D_Instance *instance, uint32_t total)
+{
+    if (total <= instance->max)
+        return;
+    instance->max = instance->max * 2 > total ? instance->max * 2 : total;
+    instance->view = (float(*)[3][4])realloc(instance->view, instance->max * sizeof(float) * 12);
+    instance->viewUnsorted = (float(*)[3][4])realloc(instance->viewUnsorted, instance->max * sizeof(float) * 12);
+    instance->group = (uint32_t *)realloc(instance->group, instance->max * sizeof(uint32_t));
+    instance->groupModel = (_3D_Model **)realloc(instance->groupModel, instance->max * sizeof(_3D_Model *));
+    instance->groupStart = (uint32_t *)realloc(instance->groupStart, instance->max * sizeof(uint32_t));
+    instance->groupTotal = (uint32_t *)realloc(instance->groupTotal, instance->max * sizeof(uint32_t));
+    instance->allocs += 6;
+    //哈希表的装载率不超过一半
+    if (instance->hashMax < instance->max * 2)
+    {
+        while (instance->hashMax < instance->max * 2)
+            instance->hashMax = instance->hashMax ? instance->hashMax * 2 : 64;
+        instance->hashModel = (_3D_Model **)realloc(instance->hashModel, instance->hashMax * sizeof(_3D_Model *));
+        instance->hashGroup = (uint32_t *)realloc(instance->hashGroup, instance->hashMax * sizeof(uint32_t));
+        instance->allocs += 2;
+    }
+}
+
+//模型所在的组,还没有时新建一组
+static uint32_t engine_instance_group(_3D_Instance *instance, _3D_Model *model)
+{
+    uint32_t mask = instance->hashMax - 1;
+    uint32_t h = (uint32_t)((uintptr_t)model >> 4) * 2654435761u & mask;
+    while (instance->hashModel[h])
+    {
+        if (instance->hashModel[h] == model)
+            return instance->hashGroup[h];
+        h = (h + 1) & mask;
+    }
+    instance->hashModel[h] = model;
+    instance->hashGroup[h] = instance->groupCount;
+    instance->groupModel[instance->groupCount] = model;
+    instance->groupTotal[instance->groupCount] = 0;
+    return instance->groupCount++;
+}
+
+//槽位上单元的细节层次记录,槽位换了单元(代数不同)时重置
+static _3D_UnitLod *engine_instance_lod(_3D_Instance *instance, uint32_t slot, uint32_t generation)
+{
+    uint32_t max;
+    if (slot >= instance->lodMax)
+    {
+        for (max = instance->lodMax > 0 ? instance->lodMax : 64; max <= slot; max *= 2)
+            ;
+        instance->lod = (_3D_UnitLod *)realloc(instance->lod, max * sizeof(_3D_UnitLod));
+        memset(&instance->lod[instance->lodMax], 0, (max - instance->lodMax) * sizeof(_3D_UnitLod));
+        instance->lodMax = max;
+        instance->allocs += 1;
+    }
+    if (instance->lod[slot].generation != generation)
+    {
+        memset(&instance->lod[slot], 0, sizeof(_3D_UnitLod));
+        instance->lod[slot].generation = generation;
+    }
+    return &instance->lod[slot];
+}
+
+//静止单元的空间变换: 按槽位缓存,所有相机、各次抓拍共用,静止编号对不上(单元换了或被设置过)时重算
+static _3D_UnitWorld *engine_instance_world(_3D_Instance *instance, uint32_t slot, uint32_t rest, float xyz[3], float quat[4])
+{
+    uint32_t max;
+    if (slot >= instance->worldMax)
     {
-        //用姿态四元数直接旋转向量
-        quat_roll(position->quat, NULL, 0, &retXyz[xyzCount], true);
+        for (max = instance->worldMax > 0 ? instance->worldMax : 64; max <= slot; max *= 2)
+            ;
+        instance->world = (_3D_UnitWorld *)realloc(instance->world, max * sizeof(_3D_UnitWorld));
+        memset(&instance->world[instance->worldMax], 0, (max - instance->worldMax) * sizeof(_3D_UnitWorld));
+        instance->worldMax = max;
+        instance->allocs += 1;
     }
+    if (instance->world[slot].rest != rest)
+    {
+        engine_unit_world(xyz, quat, instance->world[slot].matrix);
+        instance->world[slot].rest = rest;
+    }
+    return &instance->world[slot];
+}
+
+//抓拍的插值系数: 距快照那一步过去的时间 / 步长,限制在 [0, 1]
+static float engine_snapshot_alpha(_3D_Engine *engine, _3D_Snapshot *snap)
+{
+    uint64_t now;
+    float alpha;
+    if (!engine->interpolate || engine->intervalMs < 1)
+        return 1.0f;
+    now = engine_time_ns();
+    if (now <= snap->timeNs)
+        return 0.0f;
+    alpha = (float)(now - snap->timeNs) / ((float)engine->intervalMs * 1000000);
+    return alpha < 1.0f ? alpha : 1.0f;
 }
 
 /*
- *  透视投影三维坐标点到相机的二维平面
- *      xyz[3 * pointTotal]: 坐标点数组
- *      pointTotal: 数组中坐标点的个数
- *      xy: 返回屏幕中的坐标
- *      depth: 返回每个 xy 点的深度信息,单位:点
- *      inside: 返回每个 xy 点是否在屏幕内
+ *  快照中单元插值后的状态: 位置线性插值,朝向归一化线性插值(nlerp,取短弧)
+ *  前后两步相同(静止)或 alpha 为1时直接用当前状态; 某一轴越界循环进出时位置不插值
  */
-static void engine_project_into_camera(
-    _3D_Camera *camera,
-    float *xyz,
-    uint32_t pointTotal,
-    uint32_t *xy,
-    float *depth,
-    bool *inside)
-{
-    float _xy[2];
-    uint32_t cI, cD, cXy, cXyz; //三个数组的指针移动计数
-    //处理每一个点
-    for (cI = cD = cXy = cXyz = 0; cI < pointTotal; cXyz += 3)
-    {
-        //再根据透视投影,得到具体的二维坐标和深度信息
-        inside[cI++] = projection(
-            camera->openAngle,
-            &xyz[cXyz],
-            camera->ar,
-            camera->near,
-            camera->far,
-            _xy,
-            &depth[cD++]);
-        //由于投影矩阵计算时是假设屏幕高为2(继而宽为2ar)的情况下计算,这里需对坐标进行比例恢复
-        _xy[0] = _xy[0] / (2 * camera->ar) * camera->width;
-        _xy[1] = _xy[1] / 2 * camera->height;
-        //把坐标原点移动到屏幕中心
-        xy[cXy++] = (uint32_t)(camera->width / 2 + _xy[0]);
-        xy[cXy++] = (uint32_t)(camera->height / 2 - _xy[1]);
+static void engine_snapshot_state(_3D_Engine *engine, _3D_Snapshot *snap, uint32_t i, float alpha, float xyz[3], float quat[4])
+{
+    float *p = snap->xyzPrev[i], *q = snap->quatPrev[i];
+    float sign, norm;
+    int k;
+    memcpy(xyz, snap->xyz[i], sizeof(float) * 3);
+    memcpy(quat, snap->quat[i], sizeof(float) * 4);
+    if (alpha >= 1.0f)
+        return;
+    if (memcmp(p, xyz, sizeof(float) * 3) != 0 &&
+        fabsf(xyz[0] - p[0]) < engine->xyzSize[0] / 2 &&
+        fabsf(xyz[1] - p[1]) < engine->xyzSize[1] / 2 &&
+        fabsf(xyz[2] - p[2]) < engine->xyzSize[2] / 2)
+    {
+        for (k = 0; k < 3; k++)
+            xyz[k] = p[k] + (xyz[k] - p[k]) * alpha;
+    }
+    if (memcmp(q, quat, sizeof(float) * 4) != 0)
+    {
+        sign = q[0] * quat[0] + q[1] * quat[1] + q[2] * quat[2] + q[3] * quat[3] < 0 ? -1.0f : 1.0f;
+        for (k = 0; k < 4; k++)
+            quat[k] = q[k] + (quat[k] * sign - q[k]) * alpha;
+        norm = sqrtf(quat[0] * quat[0] + quat[1] * quat[1] + quat[2] * quat[2] + quat[3] * quat[3]);
+        for (k = 0; k < 4; k++)
+            quat[k] /= norm;
     }
 }
 
-// 相机抓拍,照片缓存在 camera->photoMap
-void engine_photo(_3D_Engine *engine, _3D_Camera *camera)
+/*
+ *  可见单元按模型分组: 剔除视锥之外的单元,选用细节层次,合成变换矩阵,
+ *  组内保持单元序号的先后顺序,组间按模型首次出现的顺序
+ */
+static void engine_instance_collect(_3D_Engine *engine, _3D_Camera *camera, _3D_CameraPosition *position)
+{
+    _3D_Instance *instance = &engine->instance;
+    _3D_Snapshot *snap = engine_snapshot_acquire(engine);
+    _3D_Model *model;
+    _3D_UnitLod *lod;
+    float alpha = engine_snapshot_alpha(engine, snap);
+    float xyz[3], quat[4], moving[3][4], rc[3][3];
+    float (*world)[4];
+    uint32_t total, i, g;
+
+    pthread_mutex_lock(&engine->statsLock);
+    engine->stats.alpha = alpha;
+    pthread_mutex_unlock(&engine->statsLock);
+
+    engine_instance_reserve(instance, snap->total);
+    instance->groupCount = 0;
+    if (snap->total < 1)
+        return;
+    memset(instance->hashModel, 0, instance->hashMax * sizeof(_3D_Model *));
+    quat_to_matrix(position->quat, rc, true);
+
+    for (i = 0, total = 0; i < snap->total; i++)
+    {
+        //单元的空间变换: 静止的用缓存,在动的在前后两步之间插值
+        if (snap->rest[i] != 0)
+            world = engine_instance_world(instance, snap->slot[i], snap->rest[i], snap->xyz[i], snap->quat[i])->matrix;
+        else
+        {
+            engine_snapshot_state(engine, snap, i, alpha, xyz, quat);
+            engine_unit_world(xyz, quat, moving);
+            world = moving;
+        }
+        //和相机位置合成一个变换矩阵
+        engine_model_view(world, rc, position, instance->viewUnsorted[total]);
+        //整个单元在视锥之外: 先用包围球,再用包围盒的8个角点判断
+        if (engine_unit_isOutside(camera, snap->model[i], instance->viewUnsorted[total]))
+            continue;
+        lod = engine_instance_lod(instance, snap->slot[i], snap->generation[i]);
+        model = engine_unit_lod(snap->model[i], lod, camera, instance->viewUnsorted[total]);
+        g = engine_instance_group(instance, model);
+        instance->groupTotal[g] += 1;
+        instance->group[total++] = g;
+    }
+
+    //按组排列变换矩阵
+    for (g = 0, i = 0; g < instance->groupCount; g++)
+    {
+        instance->groupStart[g] = i;
+        i += instance->groupTotal[g];
+        instance->groupTotal[g] = 0;
+    }
+    for (i = 0; i < total; i++)
+    {
+        g = instance->group[i];
+        memcpy(instance->view[instance->groupStart[g] + instance->groupTotal[g]++],
+            instance->viewUnsorted[i], sizeof(float) * 12);
+    }
+}
+
+//图元的顶点序号: 量化编码的16位序号展开到 tmp[]
+static uint32_t *engine_index(uint32_t *index, uint16_t *indexQ, uint32_t offset, uint32_t count, uint32_t tmp[3])
+{
+    uint32_t c;
+    if (!indexQ)
+        return &index[offset];
+    for (c = 0; c < count; c++)
+        tmp[c] = indexQ[offset + c];
+    return tmp;
+}
+
+//图元颜色: 量化编码的取调色板
+static uint32_t engine_color(uint32_t *color, uint8_t *colorQ, uint32_t *palette, uint32_t i)
+{
+    return colorQ ? palette[colorQ[i]] : color[i];
+}
+
+/*
+ *  没有法向量(量化编码)时在相机坐标系中由顶点判断正反面,顶点从正面看为逆时针
+ *  相机在原点: side = ((v1 - v0) x (v2 - v0)) · (0 - v0)
+ */
+static float engine_plane_side(float *xyz, uint32_t *index)
+{
+    float *p0 = &xyz[index[0] * 3], *p1 = &xyz[index[1] * 3], *p2 = &xyz[index[2] * 3];
+    float u[3], v[3];
+    uint32_t c;
+    for (c = 0; c < 3; c++)
+    {
+        u[c] = p1[c] - p0[c];
+        v[c] = p2[c] - p0[c];
+    }
+    return -((u[1] * v[2] - u[2] * v[1]) * p0[0] +
+             (u[2] * v[0] - u[0] * v[2]) * p0[1] +
+             (u[0] * v[1] - u[1] * v[0]) * p0[2]);
+}
+
+/*
+ *  绘制一个实例的所有图元
+ *  参数:
+ *      cache: 该实例的顶点变换结果,按模型顶点序号取用
+ *      modelView[3][4]: 模型坐标到相机坐标的变换矩阵
+ */
+static void engine_photo_unit(_3D_Engine *engine, _3D_Camera *camera, _3D_Model *model, _3D_VertexCache *cache, float modelView[3][4])
 {
     float xyz[3 * 3]; //3个三维坐标
     uint32_t xy[2]; //在相机屏幕中的坐标
     float depth; //在相机屏幕中的深度
     bool inside; //是否入屏
-
+    float clipXyz[3 * CAMERA_CLIP_MAX]; //裁剪后的多边形顶点
+    uint32_t clipTotal; //裁剪后的多边形顶点数
+    float fxy[2 * CAMERA_CLIP_MAX]; //顶点在相机屏幕中的浮点坐标
+    float fDepth[CAMERA_CLIP_MAX]; //顶点的深度
+    float triXy[2 * 3]; //拆分后的三角形
+    float triDepth[3];
     uint32_t c;
-    uint32_t offset;
 
-    int32_t ret; //遍历空间三角平面后返回的点数量
-    float *retXyz; //遍历空间三角平面后返回的坐标数组
+    float eye[3]; //相机在模型坐标系中的位置,用于判断三角平面的正反面
+    float side; //相机在三角平面正面(大于0)还是背面(小于0)
 
-    _3D_Unit *unit;
-    _3D_Line *line;
-    _3D_Plane *plane;
-    _3D_Label *label;
-    _3D_Sport sport;
-    _3D_CameraPosition position;
+    uint32_t i;
+    uint32_t *index; //图元的顶点序号
+    uint32_t indexTmp[3]; //展开的16位顶点序号
+    uint32_t color;
+    float *normal; //三角平面法向量
+    uint16_t out; //图元各顶点的视锥标志位(相或)
 
-    //定格相机位置(否则可能图像撕裂)
-    memcpy(&position, &camera->position, sizeof(position));
+    //遍历线条
+    for (i = 0; i < model->lineTotal; i++)
+    {
+        index = engine_index(model->lineIndex, model->lineIndexQ, i * 2, 2, indexTmp);
+        color = engine_color(model->lineColor, model->lineColorQ, model->palette, i);
+        out = cache->out[index[0]] | cache->out[index[1]];
+        //完全在视锥外
+        if (cache->out[index[0]] & cache->out[index[1]] & CAMERA_OUT_VIEW)
+            continue;
+        //在保护带以内,直接使用缓存的屏幕坐标
+        if (!(out & CAMERA_OUT_CLIP))
+        {
+            memcpy(&fxy[0], &cache->xy[index[0] * 2], sizeof(float) * 2);
+            memcpy(&fxy[2], &cache->xy[index[1] * 2], sizeof(float) * 2);
+            fDepth[0] = cache->depth[index[0]];
+            fDepth[1] = cache->depth[index[1]];
+            render_line(engine->render, fxy, fDepth, color);
+            continue;
+        }
+        //裁剪到近端、远端和保护带以内,再投影两个端点,在屏幕上逐像素画线
+        memcpy(&xyz[0], &cache->xyz[index[0] * 3], sizeof(float) * 3);
+        memcpy(&xyz[3], &cache->xyz[index[1] * 3], sizeof(float) * 3);
+        if (camera_clip_line(camera, xyz))
+        {
+            projection_batch_float(&camera->proj, xyz, 2, fxy, fDepth);
+            render_line(engine->render, fxy, fDepth, color);
+        }
+    }
 
-    //遍历单元链表
-    unit = engine->unit;
-    while (unit)
+    //相机原点变换回模型坐标系: eye = -R' * t
+    if (model->cull != MODEL_CULL_NONE)
     {
-        //定格运动状态(否则可能图像撕裂)
-        memcpy(&sport, unit->sport, sizeof(sport));
+        for (c = 0; c < 3; c++)
+            eye[c] = -(modelView[0][c] * modelView[0][3] +
+                       modelView[1][c] * modelView[1][3] +
+                       modelView[2][c] * modelView[2][3]);
+    }
 
-        //遍历plane链表
-        line = unit->model->line;
-        while (line)
+    //遍历三角平面
+    for (i = 0; i < model->planeTotal; i++)
+    {
+        index = engine_index(model->planeIndex, model->planeIndexQ, i * 3, 3, indexTmp);
+
+        //正反面剔除
+        if (model->cull != MODEL_CULL_NONE)
         {
-            //根据运动状态更新位置
-            engine_position(&sport, line->xyz, xyz, 2);
-            //坐标点相对于相机的位置变化
-            engine_position_of_camera(&position, xyz, xyz, 2);
-
-            //有任意一点入屏
-            // if (camera_isInside(camera, &xyz[0]) ||
-            //     camera_isInside(camera, &xyz[3]))
+            if (model->planeNormal)
             {
-                //遍历空间直线上的所有点
-                ret = line_enum3Dp(xyz, &retXyz, camera->pixelOfScreen / 20);
-                for (c = 0; c < ret * 3; c += 3)
-                {
-                    //获取该点在相机平面中的"二维坐标"和"深度信息"
-                    engine_project_into_camera(camera, &retXyz[c], 1, xy, &depth, &inside);
-                    //再次检查入屏 && 没有被遮挡
-                    offset = xy[1] * camera->width + xy[0];
-                    if (inside && depth < camera->photoDepth[offset])
-                    {
-                        //占用该点
-                        camera->photoDepth[offset] = depth;
-                        //画点
-                        offset *= 3;//像素偏移
-                        camera->photoMap[offset++] = (uint8_t)((line->argbColor >> 16) & 0xFF);
-                        camera->photoMap[offset++] = (uint8_t)((line->argbColor >> 8) & 0xFF);
-                        camera->photoMap[offset++] = (uint8_t)(line->argbColor & 0xFF);
-                    }
-                }
-                //内存回收
-                free(retXyz);
+                normal = &model->planeNormal[i * 4];
+                side = normal[0] * eye[0] + normal[1] * eye[1] + normal[2] * eye[2] - normal[3];
             }
-
-            //下一个
-            line = line->next;
+            else
+                side = engine_plane_side(cache->xyz, index);
+            if ((model->cull == MODEL_CULL_BACK && side < 0) ||
+                (model->cull == MODEL_CULL_FRONT && side > 0))
+                continue;
         }
 
-        //遍历plane链表
-        plane = unit->model->plane;
-        while (plane)
+        color = engine_color(model->planeColor, model->planeColorQ, model->palette, i);
+        out = cache->out[index[0]] | cache->out[index[1]] | cache->out[index[2]];
+        //完全在视锥外
+        if (cache->out[index[0]] & cache->out[index[1]] & cache->out[index[2]] & CAMERA_OUT_VIEW)
+            continue;
+        //在保护带以内(多数三角形),直接使用缓存的屏幕坐标光栅化
+        if (!(out & CAMERA_OUT_CLIP))
         {
-            //根据运动状态更新位置
-            engine_position(&sport, plane->xyz, xyz, 3);
-            //坐标点相对于相机的位置变化
-            engine_position_of_camera(&position, xyz, xyz, 3);
-
-            //有任意一点入屏
-            // if (camera_isInside(camera, &xyz[0]) ||
-            //     camera_isInside(camera, &xyz[3]) ||
-            //     camera_isInside(camera, &xyz[6]))
+            for (c = 0; c < 3; c++)
             {
-                //遍历空间三角平面上的所有点
-                ret = triangle_enum3Dp(xyz, &retXyz, camera->pixelOfScreen / 20);
-                for (c = 0; c < ret * 3; c += 3)
-                {
-                    //获取该点在相机平面中的"二维坐标"和"深度信息"
-                    engine_project_into_camera(camera, &retXyz[c], 1, xy, &depth, &inside);
-                    //再次检查入屏 && 没有被遮挡
-                    offset = xy[1] * camera->width + xy[0];
-                    if (inside && depth < camera->photoDepth[offset])
-                    {
-                        //占用该点
-                        camera->photoDepth[offset] = depth;
-                        //画点
-                        offset *= 3;//像素偏移
-                        camera->photoMap[offset++] = (uint8_t)((plane->argbColor >> 16) & 0xFF);
-                        camera->photoMap[offset++] = (uint8_t)((plane->argbColor >> 8) & 0xFF);
-                        camera->photoMap[offset++] = (uint8_t)(plane->argbColor & 0xFF);
-                    }
-                }
-                //内存回收
-                free(retXyz);
+                memcpy(&triXy[c * 2], &cache->xy[index[c] * 2], sizeof(float) * 2);
+                triDepth[c] = cache->depth[index[c]];
             }
-
-            //下一个
-            plane = plane->next;
+            render_triangle(engine->render, triXy, triDepth, color);
+            continue;
         }
-
-        //遍历label链表
-        label = unit->model->label;
-        while (label)
+        //裁剪到近端、远端和保护带以内,投影后按扇形拆成三角形光栅化
+        for (c = 0; c < 3; c++)
+            memcpy(&xyz[c * 3], &cache->xyz[index[c] * 3], sizeof(float) * 3);
+        clipTotal = camera_clip_polygon(camera, xyz, 3, clipXyz);
+        if (clipTotal >= 3)
         {
-            //根据运动状态更新位置
-            engine_position(&sport, label->xyz, xyz, 1);
-            //坐标点相对于相机的位置变化
-            engine_position_of_camera(&position, xyz, xyz, 1);
-
-            //目标点入屏
-            if (camera_isInside(camera, xyz))
+            projection_batch_float(&camera->proj, clipXyz, clipTotal, fxy, fDepth);
+            for (c = 1; c + 1 < clipTotal; c++)
             {
-                //获取该点在相机平面中的"二维坐标"和"深度信息"
-                engine_project_into_camera(camera, xyz, 1, xy, &depth, &inside);
-                //再次检查入屏 && 没有被遮挡
-                offset = xy[1] * camera->width + xy[0];
-                if (inside && depth < camera->photoDepth[offset])
-                {
-                    //占用该点
-                    camera->photoDepth[offset] = depth;
-                    //画点
-                    ;
-                    //画label
-                    ;
-                }
+                triXy[0] = fxy[0];
+                triXy[1] = fxy[1];
+                memcpy(&triXy[2], &fxy[c * 2], sizeof(float) * 4);
+                triDepth[0] = fDepth[0];
+                memcpy(&triDepth[1], &fDepth[c], sizeof(float) * 2);
+                render_triangle(engine->render, triXy, triDepth, color);
             }
+        }
+    }
 
-            //下一个
-            label = label->next;
+    //遍历注释
+    for (i = 0; i < model->labelTotal; i++)
+    {
+        //目标点入屏
+        memcpy(xyz, &cache->xyz[model->labelIndex[i] * 3], sizeof(float) * 3);
+        if (camera_isInside(camera, xyz))
+        {
+            //获取该点在相机平面中的"二维坐标"和"深度信息"
+            projection_batch(&camera->proj, xyz, 1, xy, &depth, &inside);
+            //入屏的点交给绘制环节做遮挡检查(目前只占用深度)
+            if (inside)
+            {
+                fxy[0] = xy[0];
+                fxy[1] = xy[1];
+                render_dot(engine->render, fxy, depth, engine_color(model->labelColor, model->labelColorQ, model->palette, i), false);
+                //画label
+                ;
+            }
         }
+    }
+}
+
+// 相机抓拍,照片缓存在 camera->photoMap
+void engine_photo(_3D_Engine *engine, _3D_Camera *camera)
+{
+    uint32_t allocs; //抓拍前的堆分配计数
+    _3D_Model *model;
+    _3D_VertexCache *cache = &engine->cache;
+    _3D_VertexCache part; //某个实例在顶点缓存中的部分
+    _3D_Instance *instance = &engine->instance;
+    _3D_CameraPosition position;
+    uint32_t g, start, total, batch, i;
 
-        //下一个
-        unit = unit->next;
+    //定格相机位置(否则可能图像撕裂)
+    memcpy(&position, &camera->position, sizeof(position));
+
+    //图元缓存多个相机共用
+    pthread_mutex_lock(&engine->photoLock);
+    render_begin(engine->render, camera->photoMap, camera->photoDepth, camera->width, camera->height);
+    allocs = engine->render->allocs + cache->allocs + instance->allocs;
+
+    engine_instance_collect(engine, camera, &position);
+
+    //逐组: 同一模型的实例一起变换顶点,再依次遍历图元
+    for (g = 0; g < instance->groupCount; g++)
+    {
+        model = instance->groupModel[g];
+        batch = model->xyzTotal > 0 ? ENGINE_INSTANCE_VERTEX_MAX / model->xyzTotal : instance->groupTotal[g];
+        if (batch < 1)
+            batch = 1;
+        for (start = 0; start < instance->groupTotal[g]; start += batch)
+        {
+            total = instance->groupTotal[g] - start < batch ? instance->groupTotal[g] - start : batch;
+            //所有顶点只变换、投影一次
+            engine_cache_vertex(cache, camera, model, &instance->view[instance->groupStart[g] + start], total);
+            for (i = 0; i < total; i++)
+            {
+                part = *cache;
+                part.xyz += i * model->xyzTotal * 3;
+                part.xy += i * model->xyzTotal * 2;
+                part.depth += i * model->xyzTotal;
+                part.out += i * model->xyzTotal;
+                engine_photo_unit(engine, camera, model, &part, instance->view[instance->groupStart[g] + start + i]);
+            }
+        }
     }
+
+    //绘制(多线程时按屏幕分块并行)
+    render_end(engine->render, engine->pool);
+    engine->photoAllocs = engine->render->allocs + cache->allocs + instance->allocs - allocs;
+    pthread_mutex_unlock(&engine->photoLock);
+}
+
+// 最近一次抓拍过程中的堆分配次数(图元缓存、顶点缓存扩容),首帧之后应为0
+uint32_t engine_photo_allocs(_3D_Engine *engine)
+{
+    return engine->photoAllocs;
+}
+
+// 设置相机抓拍的并行绘制线程数(含调用者线程),传0时按CPU核心数(默认),传1时单线程绘制
+void engine_photo_threads(_3D_Engine *engine, uint32_t threadTotal)
+{
+    pthread_mutex_lock(&engine->photoLock);
+    pool_release(&engine->pool);
+    engine->pool = pool_init(threadTotal);
+    pthread_mutex_unlock(&engine->photoLock);
+}
+
+// 设置运动计算的并行线程数(含引擎线程),传0时按CPU核心数(默认),传1时单线程计算
+void engine_tick_threads(_3D_Engine *engine, uint32_t threadTotal)
+{
+    pthread_rwlock_wrlock(&engine->lock);
+    pool_release(&engine->tickPool);
+    engine->tickPool = pool_init(threadTotal);
+    pthread_rwlock_unlock(&engine->lock);
+}
+
+// 抓拍时是否在最近两步运动计算之间插值,关闭时直接用最近一步的状态
+void engine_interpolate(_3D_Engine *engine, bool enable)
+{
+    pthread_mutex_lock(&engine->photoLock);
+    engine->interpolate = enable;
+    pthread_mutex_unlock(&engine->photoLock);
+}
+
+// 读取调度统计
+void engine_stats(_3D_Engine *engine, _3D_EngineStats *stats)
+{
+    pthread_mutex_lock(&engine->statsLock);
+    memcpy(stats, &engine->stats, sizeof(_3D_EngineStats));
+    pthread_mutex_unlock(&engine->statsLock);
+}
+
+/*
+ *  开启碰撞/接近检测: 每次运动计算后检测单元间的接触(包围球、有向包围盒外扩 margin 后相交)
+ *  参数:
+ *      margin: 接近距离, 0/只报告包围体相交; 重复调用时替换之前的设置
+ *      priv, callback: 接触回调(可以置NULL,只用 engine_contact_get() 读取)
+ */
+void engine_collide_enable(_3D_Engine *engine, float margin, void *priv, EngineContactCallback callback)
+{
+    pthread_rwlock_wrlock(&engine->lock);
+    collide_release(&engine->collide);
+    engine->collide = collide_init(margin);
+    engine->contactPriv = priv;
+    engine->contactCallback = callback;
+    engine->contactTotal = 0;
+    pthread_rwlock_unlock(&engine->lock);
+}
+
+// 关闭碰撞/接近检测
+void engine_collide_disable(_3D_Engine *engine)
+{
+    pthread_rwlock_wrlock(&engine->lock);
+    collide_release(&engine->collide);
+    engine->contactTotal = 0;
+    pthread_rwlock_unlock(&engine->lock);
+}
+
+/*
+ *  读取最近一次检测的接触对
+ *  参数:
+ *      contact: 返回接触对,最多 max 对(可以置NULL,只查数量)
+ *
+ *  返回: 接触对总数(可能大于 max)
+ */
+uint32_t engine_contact_get(_3D_Engine *engine, _3D_Contact *contact, uint32_t max)
+{
+    uint32_t total;
+    pthread_rwlock_wrlock(&engine->lock);
+    total = engine->contactTotal;
+    if (contact)
+        memcpy(contact, engine->contact, (total < max ? total : max) * sizeof(_3D_Contact));
+    pthread_rwlock_unlock(&engine->lock);
+    return total;
 }
 
 // 开始
 void engine_start(_3D_Engine *engine)
 {
-    engine->run = true;
+    __atomic_store_n(&engine->run, true, __ATOMIC_RELEASE);
 }
 
 // 暂停
 void engine_pause(_3D_Engine *engine)
 {
-    engine->run = false;
+    __atomic_store_n(&engine->run, false, __ATOMIC_RELEASE);
 }
 
 // 内存销毁(注意其中用到的 model 和 camera 需自行销毁)
 void engine_release(_3D_Engine **engine)
 {
-    _3D_Unit *unit, *unitNext;
+    uint32_t i;
     if (engine && (*engine))
     {
         //结束线程
-        (*engine)->threadExit = true;
+        __atomic_store_n(&(*engine)->threadExit, true, __ATOMIC_RELEASE);
         pthread_join((*engine)->th, NULL);
-        pthread_mutex_destroy(&(*engine)->lock);
-        //释放链表
-        if ((*engine)->unit)
+        pthread_rwlock_destroy(&(*engine)->lock);
+        pthread_mutex_destroy(&(*engine)->photoLock);
+        pthread_mutex_destroy(&(*engine)->statsLock);
+        pool_release(&(*engine)->pool);
+        pool_release(&(*engine)->tickPool);
+        render_release(&(*engine)->render);
+        collide_release(&(*engine)->collide);
+        if ((*engine)->contact)
+            free((*engine)->contact);
+        //顶点缓存
+        if ((*engine)->cache.xyz)
+            free((*engine)->cache.xyz);
+        if ((*engine)->cache.xy)
+            free((*engine)->cache.xy);
+        if ((*engine)->cache.depth)
+            free((*engine)->cache.depth);
+        if ((*engine)->cache.out)
+            free((*engine)->cache.out);
+        //实例分组
+        if ((*engine)->instance.view)
         {
-            unitNext = (*engine)->unit;
-            do
+            free((*engine)->instance.view);
+            free((*engine)->instance.viewUnsorted);
+            free((*engine)->instance.group);
+            free((*engine)->instance.groupModel);
+            free((*engine)->instance.groupStart);
+            free((*engine)->instance.groupTotal);
+            free((*engine)->instance.hashModel);
+            free((*engine)->instance.hashGroup);
+        }
+        if ((*engine)->instance.lod)
+            free((*engine)->instance.lod);
+        if ((*engine)->instance.world)
+            free((*engine)->instance.world);
+        //快照
+        for (i = 0; i < 3; i++)
+        {
+            if ((*engine)->snapshot[i].max > 0)
             {
-                unit = unitNext;
-                unitNext = unitNext->next;
-                free(unit->sport);
-                free(unit);
-            } while (unitNext);
+                free((*engine)->snapshot[i].xyz);
+                free((*engine)->snapshot[i].quat);
+                free((*engine)->snapshot[i].xyzPrev);
+                free((*engine)->snapshot[i].quatPrev);
+                free((*engine)->snapshot[i].rest);
+                free((*engine)->snapshot[i].model);
+                free((*engine)->snapshot[i].slot);
+                free((*engine)->snapshot[i].generation);
+            }
+        }
+        //单元
+        if ((*engine)->unit.max > 0)
+        {
+            free((*engine)->unit.xyz);
+            free((*engine)->unit.speed);
+            free((*engine)->unit.speed_angle);
+            free((*engine)->unit.quat);
+            free((*engine)->unit.xyzPrev);
+            free((*engine)->unit.quatPrev);
+            free((*engine)->unit.rest);
+            free((*engine)->unit.laneMoving);
+            free((*engine)->unit.model);
+            free((*engine)->unit.slot);
+            free((*engine)->unit.slotUnit);
+            free((*engine)->unit.slotGeneration);
+            free((*engine)->unit.slotFree);
         }
         free(*engine);
         *engine = NULL;
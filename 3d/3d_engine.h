@@ -15,12 +15,16 @@
 #include "3d_camera.h"
 #include "3d_model.h"
 #include "3d_math.h"
+#include "3d_render.h"
+#include "3d_pool.h"
+#include "3d_lod.h"
+#include "3d_collide.h"
 
-// 单元的运动控制状态(模型原点的运行动)
+// 单元的运动控制状态(模型原点的运行动),用 engine_sport_get()/engine_sport_set() 读写
 typedef struct _3DSport
 {
     float xyz[3];         //质心在空间中的位置
-    float roll_xyz[3];    //绕自身坐标系转角(单位:度)
+    float roll_xyz[3];    //绕自身坐标系转角(单位:度),读取时由 quat 换算
 
     float speed[3];       //速度向量,相对空间坐标系,单位:点/秒
     float speed_angle[3]; //角速度向量,相对自身坐标系,单位:度/秒
@@ -29,31 +33,203 @@ typedef struct _3DSport
     // struct _3DSport *next;   //用链表来记录历史状态
 } _3D_Sport;
 
-// 空间中的物体单元
+// 运动计算时每个任务处理的单元数,单元分块后由线程池并行计算
+#define ENGINE_TICK_CHUNK 1024
+// 块内每组单元数(SIMD宽度),ENGINE_TICK_CHUNK 和单元容量都是它的倍数
+#define ENGINE_TICK_LANE 4
+
+// 落后时一次唤醒最多补算的步数,再落后的步数丢弃(防止计算跟不上时越积越多)
+#define ENGINE_CATCHUP_MAX 4
+
+// 每个单元为几个相机分别记录上次选用的细节层次(用于滞后切换),超出的相机不带滞后
+#define ENGINE_LOD_CAMERA_MAX 4
+
+/*
+ *  单元句柄: 低32位为槽位,高32位为槽位的代数(槽位每回收一次加1)
+ *  单元移除后旧句柄的代数对不上,不会误操作占用同一槽位的新单元
+ */
+typedef uint64_t _3D_Handle;
+#define ENGINE_HANDLE_NONE 0 //无效句柄
+
+// 单元各相机上次选用的细节层次 level[],见 model_lod_level(); 抓拍时按槽位记录,代数对不上说明槽位换了单元
+typedef struct _3DUnitLod
+{
+    _3D_Camera *camera[ENGINE_LOD_CAMERA_MAX];
+    uint32_t level[ENGINE_LOD_CAMERA_MAX];
+    uint32_t generation;
+} _3D_UnitLod;
+
+/*
+ *  空间中的物体单元: 各字段分别连续存放,单元序号 0 ~ total-1 稠密排列,
+ *  移除时把最后一个单元移到空位,运动计算和抓拍都按序号顺序访问内存
+ *  句柄通过槽位找到单元序号,单元移动时只需更新槽位表
+ */
 typedef struct _3DUnit
 {
-    _3D_Sport *sport; //运动状态
-    _3D_Model *model; //模型(该参数在这里是只读的,所以可以把一个模型赋值给多个单元)
-    struct _3DUnit *next;
+    float (*xyz)[3];         //同 _3D_Sport (roll_xyz 不存放,读取时换算)
+    float (*speed)[3];
+    float (*speed_angle)[3];
+    float (*quat)[4];
+    float (*xyzPrev)[3];     //上一步运动计算之前的位置和朝向(抓拍插值用)
+    float (*quatPrev)[4];
+    _3D_Model **model;       //模型(该参数在这里是只读的,所以可以把一个模型赋值给多个单元)
+    uint32_t *slot;          //单元所在的槽位
+    uint32_t total, max;     //单元数,容量(各数组、槽位表共用)
+
+    /*
+     *  静止标记: speed、speed_angle 全为0的单元不参与运动计算,状态只在 engine_sport_set() 时改变
+     *  0/在动, 其它/静止,值为每次进入静止状态时分配的编号(全局唯一),抓拍按编号缓存单元的空间变换
+     */
+    uint32_t *rest;
+    uint8_t *laneMoving;     //每 ENGINE_TICK_LANE 个单元一组,组内在动的单元数(整组静止时跳过)
+    uint32_t moving;         //在动的单元数
+    uint32_t restStamp;      //最近分配的静止编号
+
+    uint32_t *slotUnit;       //槽位上的单元序号
+    uint32_t *slotGeneration; //槽位的代数,从1开始
+    uint32_t *slotFree;       //回收的槽位(栈)
+    uint32_t slotTotal, slotFreeTotal;
 } _3D_Unit;
 
+/*
+ *  单元状态的快照: 抓拍只读快照,不碰运动计算正在写的单元数组
+ *  三份快照轮换: 运动计算写后台一份,写完与中间一份交换; 抓拍开始时若中间一份更新过,与前台一份交换
+ *  双方都不用等对方,抓拍读到的总是某次运动计算完整的结果
+ */
+typedef struct _3DSnapshot
+{
+    float (*xyz)[3];
+    float (*quat)[4];
+    float (*xyzPrev)[3];  //上一步的状态,抓拍在 prev 和当前状态之间插值
+    float (*quatPrev)[4];
+    uint32_t *rest;       //静止编号,见 _3D_Unit.rest
+    _3D_Model **model;
+    uint32_t *slot;       //单元所在的槽位和槽位代数(抓拍按槽位记录细节层次)
+    uint32_t *generation;
+    uint32_t total, max;
+    uint64_t tick;        //第几次运动计算的结果
+    uint64_t timeNs;      //该次运动计算的计划时刻(CLOCK_MONOTONIC),单位:ns
+} _3D_Snapshot;
+
+// 中间一份快照是新发布的(还没被抓拍取走)
+#define ENGINE_SNAPSHOT_FRESH 4
+
+// 静止单元模型坐标到空间坐标的变换矩阵(所有相机、各次抓拍共用),静止编号对不上时重算
+typedef struct _3DUnitWorld
+{
+    float matrix[3][4];
+    uint32_t rest;
+} _3D_UnitWorld;
+
+// 抓拍时单元顶点的变换缓存: 每个单元的每个顶点只变换、投影一次,各图元按顶点序号取用
+typedef struct _3DVertexCache
+{
+    float *xyz;      //相机坐标 xyz[3 * n]
+    float *xy;       //屏幕坐标 xy[2 * n] (只在不需要裁剪的图元中使用)
+    float *depth;    //深度
+    uint16_t *out;   //camera_outcode() 标志位
+    uint32_t max;    //容量,单位:顶点
+    uint32_t allocs; //累计扩容次数
+} _3D_VertexCache;
+
+// 同一模型的实例一次最多变换多少个顶点(实例数 x 模型顶点数),限制顶点缓存的大小
+#define ENGINE_INSTANCE_VERTEX_MAX 65536
+
+// 抓拍时按模型分组的可见单元: 同一模型的实例连续存放,一起变换顶点、遍历图元
+typedef struct _3DInstance
+{
+    float (*view)[3][4]; //各实例模型坐标到相机坐标的变换矩阵,按组连续存放
+    uint32_t *group;     //各可见单元所在的组(按单元序号顺序)
+    uint32_t max;        //容量,单位:实例
+    _3D_Model **groupModel; //各组的模型(选用细节层次之后)
+    uint32_t *groupStart;   //各组在 view[] 中的起始位置
+    uint32_t *groupTotal;   //各组的实例数
+    uint32_t groupCount;
+    _3D_Model **hashModel; //模型到组的哈希表(开放寻址)
+    uint32_t *hashGroup;
+    uint32_t hashMax; //哈希表容量,2的幂
+    float (*viewUnsorted)[3][4]; //按单元序号顺序的变换矩阵
+    _3D_UnitLod *lod;    //各槽位单元选用的细节层次
+    uint32_t lodMax;
+    _3D_UnitWorld *world; //各槽位静止单元的空间变换
+    uint32_t worldMax;
+    uint32_t allocs; //累计扩容次数
+} _3D_Instance;
+
+// 运动计算的调度统计,用 engine_stats() 读取
+typedef struct _3DEngineStats
+{
+    uint64_t tick;      //运动计算步数
+    uint32_t moving;    //在动的单元数(其余静止,不参与运动计算)
+    uint64_t wakeup;    //调度线程唤醒次数(运行中)
+    uint64_t overrun;   //唤醒时已落后一步以上、需要补算的次数
+    uint64_t dropped;   //超过 ENGINE_CATCHUP_MAX 而丢弃的步数
+    float jitterUs;     //最近一次唤醒相对计划时刻的延迟,单位:us
+    float jitterAvgUs;  //唤醒延迟的滑动平均
+    float jitterMaxUs;  //唤醒延迟的最大值
+    float costUs;       //最近一次唤醒的计算耗时(含补算和发布快照)
+    float costMaxUs;
+    float alpha;        //最近一次抓拍的插值系数 [0, 1]
+} _3D_EngineStats;
+
+// 接触的一对单元,见 engine_collide_enable()
+typedef struct _3DContact
+{
+    _3D_Handle a, b;
+    float gap; //包围球表面间距,负数为相交深度
+} _3D_Contact;
+
+/*
+ *  接触回调,在引擎线程中每步运动计算(含补算时的最后一步)之后调用,此时不持有任何锁
+ *  参数:
+ *      priv: engine_collide_enable() 传入的参数
+ *      contact: 本次的接触对(回调返回后失效)
+ *      total: 接触对数
+ */
+typedef void (*EngineContactCallback)(void *priv, _3D_Contact *contact, uint32_t total);
+
 // 主结构体
 typedef struct _3DEngine
 {
-    _3D_Unit *unit;       //单元链表
-    uint32_t intervalMs;  //刷新/计算间隔,单位:ms
+    _3D_Unit unit;        //单元
+    uint32_t intervalMs;  //刷新/计算间隔(固定步长),单位:ms
     float xyzSize[3];     //xyz空间范围
     float xyzRange[3][2]; //空间范围 [x][0]/min [x][1]/max
     pthread_t th;
-    pthread_mutex_t lock;
-    bool run;        //开/停标志
-    bool threadExit; //线程回收标志
+    pthread_rwlock_t lock; //运动计算时持读锁,增删单元、读写运动状态、补发快照时持写锁
+    _3D_Pool *tickPool;    //运动计算的线程池(与抓拍的线程池分开,两者可同时进行)
+    uint64_t tick;         //运动计算次数
+    uint64_t tickNs;       //最近一步的计划时刻(CLOCK_MONOTONIC),单位:ns
+    _3D_EngineStats stats; //调度统计(受 statsLock 保护)
+    pthread_mutex_t statsLock;
+    bool interpolate;      //抓拍时在最近两步之间插值(默认开)
+
+    _3D_Snapshot snapshot[3]; //单元状态的三份快照
+    uint32_t snapshotBack;    //后台一份的序号(发布方独占)
+    uint32_t snapshotFront;   //前台一份的序号(抓拍独占)
+    uint32_t snapshotMiddle;  //中间一份的序号 | ENGINE_SNAPSHOT_FRESH (原子操作)
+    bool snapshotDirty;       //单元增删、设置后还没发布快照(原子操作)
+    bool run;        //开/停标志(原子操作)
+    bool threadExit; //线程回收标志(原子操作)
+
+    _3D_Collide *collide;  //碰撞/接近检测, NULL/未开启
+    _3D_Contact *contact;  //最近一次检测的接触对
+    uint32_t contactTotal, contactMax;
+    EngineContactCallback contactCallback;
+    void *contactPriv;
+
+    _3D_Pool *pool;     //相机抓拍时并行绘制各分块的线程池
+    _3D_Render *render; //相机抓拍时的图元缓存(多个相机共用,抓拍过程互斥)
+    pthread_mutex_t photoLock;
+    _3D_VertexCache cache; //抓拍时的顶点变换缓存(多个相机共用,抓拍过程互斥)
+    _3D_Instance instance; //抓拍时按模型分组的可见单元(多个相机共用,抓拍过程互斥)
+    uint32_t photoAllocs; //最近一次抓拍过程中的堆分配次数,稳定后应为0
 } _3D_Engine;
 
 /*
  *  引擎初始化
  *  参数:
- *      intervalMs: 刷新间隔,单位:ms
+ *      intervalMs: 运动计算的固定步长,单位:ms; 调度按 CLOCK_MONOTONIC 的绝对时刻睡眠,不随计算耗时漂移
  *      xSize, ySize, zSize: 空间场地大小,其中点(xSize/2, ySize/2, zSize/2)的位置将作为空间原点
  */
 _3D_Engine *engine_init(uint32_t intervalMs, float xSize, float ySize, float zSize);
@@ -64,17 +240,62 @@ _3D_Engine *engine_init(uint32_t intervalMs, float xSize, float ySize, float zSi
  *      xyz: 在空间中的初始位置(可以置NULL)
  *      roll_xyz: 绕自身坐标系旋转角度,即朝向,欧拉角,单位:度(可以置NULL)
  * 
- *  返回: 模型运动控制器,可进行异步控制、获取模型的运动状态
+ *  返回: 单元句柄,用于异步控制、获取模型的运动状态, ENGINE_HANDLE_NONE/失败
  *  其它: 当 xyz = NULL, roll_xyz = NULL 模型在空间默认位置为原点,面朝x轴正方向,头顶z轴正方向,左边y轴正方向
  */
-_3D_Sport *engine_model_add(_3D_Engine *engine, _3D_Model *model, float *xyz, float *roll_xyz);
+_3D_Handle engine_model_add(_3D_Engine *engine, _3D_Model *model, float *xyz, float *roll_xyz);
+
+// 模型移除,成功返回true (之后该句柄失效)
+bool engine_model_remove(_3D_Engine *engine, _3D_Handle handle);
 
-// 模型移除,成功返回true (注意 sport 指针成功移除等于被释放,不能再使用)
-bool engine_model_remove(_3D_Engine *engine, _3D_Sport *sport);
+// 读取单元的运动状态,句柄已失效时返回false
+bool engine_sport_get(_3D_Engine *engine, _3D_Handle handle, _3D_Sport *sport);
+
+// 设置单元的运动状态(朝向以 quat 为准, roll_xyz 忽略),句柄已失效时返回false
+bool engine_sport_set(_3D_Engine *engine, _3D_Handle handle, _3D_Sport *sport);
 
 // 相机抓拍,照片缓存在 camera->photoMap
+// 使用最近一次发布的单元快照,不等待运动计算; 移除单元后,从下一次调用开始不再使用它(进行中的抓拍可能还在用,其模型要等这次抓拍结束才能销毁)
+// 模型带细节层次时(见 model_lod_build),按包围球在屏幕上的投影半径选用简化的模型
+// 共用同一模型的单元归为一组,一起变换顶点、依次遍历图元,组间按各模型首次出现的单元序号先后绘制
+// 开启插值时(默认),画面比运动计算晚一步: 按距最近一步的时间在前后两步的状态之间插值,抓拍频率高于运动计算时画面依然平滑
 void engine_photo(_3D_Engine *engine, _3D_Camera *camera);
 
+// 抓拍时是否在最近两步运动计算之间插值,关闭时直接用最近一步的状态
+void engine_interpolate(_3D_Engine *engine, bool enable);
+
+// 读取调度统计
+void engine_stats(_3D_Engine *engine, _3D_EngineStats *stats);
+
+// 设置运动计算的并行线程数(含引擎线程),传0时按CPU核心数(默认),传1时单线程计算
+void engine_tick_threads(_3D_Engine *engine, uint32_t threadTotal);
+
+// 设置相机抓拍的并行绘制线程数(含调用者线程),传0时按CPU核心数(默认),传1时单线程绘制
+void engine_photo_threads(_3D_Engine *engine, uint32_t threadTotal);
+
+// 最近一次抓拍过程中的堆分配次数(图元缓存、顶点缓存、实例分组扩容),首帧之后应为0
+uint32_t engine_photo_allocs(_3D_Engine *engine);
+
+/*
+ *  开启碰撞/接近检测: 每次运动计算后检测单元间的接触(包围球、有向包围盒外扩 margin 后相交)
+ *  参数:
+ *      margin: 接近距离, 0/只报告包围体相交; 重复调用时替换之前的设置
+ *      priv, callback: 接触回调(可以置NULL,只用 engine_contact_get() 读取)
+ */
+void engine_collide_enable(_3D_Engine *engine, float margin, void *priv, EngineContactCallback callback);
+
+// 关闭碰撞/接近检测
+void engine_collide_disable(_3D_Engine *engine);
+
+/*
+ *  读取最近一次检测的接触对
+ *  参数:
+ *      contact: 返回接触对,最多 max 对(可以置NULL,只查数量)
+ *
+ *  返回: 接触对总数(可能大于 max)
+ */
+uint32_t engine_contact_get(_3D_Engine *engine, _3D_Contact *contact, uint32_t max);
+
 // 开始
 void engine_start(_3D_Engine *engine);
 
@@ -0,0 +1,1172 @@
+/*
+ *  模型导入: Wavefront OBJ、STL(二进制/ASCII)、PLY(ASCII/二进制)
+ *  文件按块读入,每块拆成若干段由线程池并行解析,再按文件顺序追加到模型,多边形在导入时按扇形拆成三角形
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "3d_import.h"
+#include "3d_optimize.h"
+#include "3d_pool.h"
+
+// OBJ 的负数(相对)序号解析时还不知道本段之前有多少顶点,先换算为相对本段起点的序号再减去此偏移存为负数,合并时还原
+#define IMPORT_RELATIVE ((int64_t)1 << 40)
+
+// PLY 属性的数据类型
+#define IMPORT_PLY_INT8 0
+#define IMPORT_PLY_UINT8 1
+#define IMPORT_PLY_INT16 2
+#define IMPORT_PLY_UINT16 3
+#define IMPORT_PLY_INT32 4
+#define IMPORT_PLY_UINT32 5
+#define IMPORT_PLY_FLOAT32 6
+#define IMPORT_PLY_FLOAT64 7
+
+// PLY 元素、属性的用途
+#define IMPORT_PLY_OTHER 0
+#define IMPORT_PLY_VERTEX 1 //元素: 顶点
+#define IMPORT_PLY_FACE 2   //元素: 多边形
+#define IMPORT_PLY_X 3      //属性: 顶点坐标
+#define IMPORT_PLY_Y 4
+#define IMPORT_PLY_Z 5
+#define IMPORT_PLY_INDEX 6  //属性: 多边形的顶点序号列表
+
+// PLY 各数据类型的字节数
+static const uint8_t import_ply_size[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+// PLY 数据类型名称
+static const struct
+{
+    char *name;
+    uint8_t type;
+} import_ply_type[] = {
+    {"char", IMPORT_PLY_INT8}, {"int8", IMPORT_PLY_INT8},
+    {"uchar", IMPORT_PLY_UINT8}, {"uint8", IMPORT_PLY_UINT8},
+    {"short", IMPORT_PLY_INT16}, {"int16", IMPORT_PLY_INT16},
+    {"ushort", IMPORT_PLY_UINT16}, {"uint16", IMPORT_PLY_UINT16},
+    {"int", IMPORT_PLY_INT32}, {"int32", IMPORT_PLY_INT32},
+    {"uint", IMPORT_PLY_UINT32}, {"uint32", IMPORT_PLY_UINT32},
+    {"float", IMPORT_PLY_FLOAT32}, {"float32", IMPORT_PLY_FLOAT32},
+    {"double", IMPORT_PLY_FLOAT64}, {"float64", IMPORT_PLY_FLOAT64},
+};
+
+// PLY 属性
+typedef struct _3DImportPlyProperty
+{
+    uint8_t type;      //数据类型 IMPORT_PLY_XXX, 列表时为列表元素的类型
+    uint8_t countType; //(列表)元素个数的数据类型
+    bool list;
+    uint8_t usage;     //用途 IMPORT_PLY_X/Y/Z/INDEX/OTHER
+    uint32_t offset;   //(定长记录)在记录中的字节偏移
+} _3D_ImportPlyProperty;
+
+// PLY 元素
+typedef struct _3DImportPlyElement
+{
+    uint8_t usage;  //用途 IMPORT_PLY_VERTEX/FACE/OTHER
+    uint64_t count; //记录数
+    uint64_t line;  //(ASCII)第一条记录的数据行号
+    uint32_t size;  //每条记录的字节数, 0/含列表属性,记录不定长
+    _3D_ImportPlyProperty property[IMPORT_PLY_PROPERTY_MAX];
+    uint32_t propertyTotal;
+} _3D_ImportPlyElement;
+
+// 并行解析的一段数据及其解析结果
+typedef struct _3DImportPart
+{
+    char *begin, *end; //数据范围
+    uint64_t line;     //(PLY ASCII)第一行的数据行号
+
+    float *xyz;        //顶点 xyz[3 * xyzTotal]
+    uint32_t xyzTotal, xyzMax;
+    int64_t *plane;    //三角平面顶点序号 plane[3 * planeTotal], 负数为 OBJ 相对序号
+    uint32_t planeTotal, planeMax;
+    int64_t *line2;    //线条顶点序号 line2[2 * lineTotal]
+    uint32_t lineTotal, lineMax;
+    uint32_t *index;   //合并时换算好的序号
+    uint32_t indexMax;
+
+    bool error; //数据格式不对
+} _3D_ImportPart;
+
+typedef struct _3DImport
+{
+    FILE *fp;
+    char *buff;        //读入缓冲区,多分配1字节用于文件末尾补'\0'
+    size_t buffSize;   //缓冲区中的数据量
+    size_t buffUsed;   //其中已处理的数据量
+    size_t buffMax;
+    bool eof;
+    uint64_t fileSize;  //文件大小
+    uint64_t fileRead;  //已从文件读入缓冲区的字节数
+
+    _3D_Pool *pool;
+    _3D_ImportPart *part;
+    uint32_t partTotal;
+
+    _3D_Model *model;
+    uint32_t argbColor;
+    uint32_t triangleDone; //(STL)已组成三角平面的顶点数
+
+    bool swap; //(二进制)文件字节序与本机不同
+    _3D_ImportPlyElement element[IMPORT_PLY_ELEMENT_MAX];
+    uint32_t elementTotal;
+    _3D_ImportPlyElement *elementNow; //(PLY 二进制)正在并行解析的元素
+
+    bool error;
+} _3D_Import;
+
+//本机是否大端字节序
+static bool import_big_endian(void)
+{
+    uint16_t value = 1;
+    return *(uint8_t *)&value == 0;
+}
+
+//字节序翻转
+static void import_swap(void *data, uint32_t size)
+{
+    uint8_t *p = (uint8_t *)data, tmp;
+    uint32_t i;
+    for (i = 0; i < size / 2; i++)
+    {
+        tmp = p[i];
+        p[i] = p[size - 1 - i];
+        p[size - 1 - i] = tmp;
+    }
+}
+
+//打开文件,准备线程池和空模型
+static _3D_Import *import_init(char *filePath, uint32_t argbColor, uint32_t threadTotal)
+{
+    _3D_Import *imp;
+    FILE *fp;
+    if (!filePath)
+        return NULL;
+    fp = fopen(filePath, "rb");
+    if (!fp)
+        return NULL;
+    imp = (_3D_Import *)calloc(1, sizeof(_3D_Import));
+    imp->fp = fp;
+    fseek(fp, 0, SEEK_END);
+    imp->fileSize = (uint64_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    imp->buffMax = IMPORT_CHUNK_SIZE;
+    imp->buff = (char *)malloc(imp->buffMax + 1);
+    imp->pool = pool_init(threadTotal);
+    imp->partTotal = pool_threads(imp->pool) * IMPORT_PART_PER_THREAD;
+    imp->part = (_3D_ImportPart *)calloc(imp->partTotal, sizeof(_3D_ImportPart));
+    imp->model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    imp->argbColor = argbColor;
+    return imp;
+}
+
+//关闭文件并回收内存,返回导入的模型(出错时销毁模型返回NULL)
+static _3D_Model *import_release(_3D_Import *imp)
+{
+    _3D_Model *model = imp->model;
+    uint32_t i;
+    if (imp->error)
+        model_release(&model);
+    //文件里的图元顺序是任意的,重排三角平面和顶点
+    else
+        model_optimize(model, 0, NULL);
+    for (i = 0; i < imp->partTotal; i++)
+    {
+        if (imp->part[i].xyz)
+            free(imp->part[i].xyz);
+        if (imp->part[i].plane)
+            free(imp->part[i].plane);
+        if (imp->part[i].line2)
+            free(imp->part[i].line2);
+        if (imp->part[i].index)
+            free(imp->part[i].index);
+    }
+    free(imp->part);
+    pool_release(&imp->pool);
+    free(imp->buff);
+    fclose(imp->fp);
+    free(imp);
+    return model;
+}
+
+//把未处理的数据移到缓冲区开头,再从文件读入,直到缓冲区有 need 字节或文件结束
+static void import_read(_3D_Import *imp, size_t need)
+{
+    size_t ret;
+    char *buff;
+    if (imp->buffUsed > 0)
+    {
+        memmove(imp->buff, imp->buff + imp->buffUsed, imp->buffSize - imp->buffUsed);
+        imp->buffSize -= imp->buffUsed;
+        imp->buffUsed = 0;
+    }
+    if (need > imp->buffMax)
+    {
+        //扩容失败时保留原缓冲区,按文件提前结束处理
+        buff = (char *)realloc(imp->buff, need + 1);
+        if (!buff)
+        {
+            imp->error = true;
+            imp->eof = true;
+            return;
+        }
+        imp->buff = buff;
+        imp->buffMax = need;
+    }
+    while (!imp->eof && imp->buffSize < need)
+    {
+        ret = fread(imp->buff + imp->buffSize, 1, imp->buffMax - imp->buffSize, imp->fp);
+        if (ret < 1)
+            imp->eof = true;
+        imp->buffSize += ret;
+        imp->fileRead += ret;
+    }
+}
+
+/*
+ *  取下一块完整的文本行
+ *  参数:
+ *      len: 返回文本长度,除文件末尾外都以'\n'结尾,文件末尾补了'\0'
+ *
+ *  返回: 文本起始位置, NULL/文件结束
+ */
+static char *import_text(_3D_Import *imp, size_t *len)
+{
+    size_t need = IMPORT_CHUNK_SIZE, i;
+    while (1)
+    {
+        import_read(imp, need);
+        if (imp->buffSize < 1)
+            return NULL;
+        if (imp->eof)
+        {
+            imp->buff[imp->buffSize] = '\0';
+            *len = imp->buffUsed = imp->buffSize;
+            return imp->buff;
+        }
+        //最后一个换行符之后的半行留到下一块
+        for (i = imp->buffSize; i > 0 && imp->buff[i - 1] != '\n'; i--)
+            ;
+        if (i > 0)
+        {
+            *len = imp->buffUsed = i;
+            return imp->buff;
+        }
+        //一行比缓冲区还长
+        need = imp->buffSize * 2;
+    }
+}
+
+/*
+ *  取二进制数据
+ *  注意: 返回的指针在下一次读取后失效
+ *
+ *  返回: 数据起始位置, NULL/文件提前结束
+ */
+static uint8_t *import_bytes(_3D_Import *imp, size_t size)
+{
+    uint8_t *ret;
+    if (imp->buffSize - imp->buffUsed < size)
+    {
+        import_read(imp, size > IMPORT_CHUNK_SIZE ? size : IMPORT_CHUNK_SIZE);
+        if (imp->buffSize < size)
+            return NULL;
+    }
+    ret = (uint8_t *)imp->buff + imp->buffUsed;
+    imp->buffUsed += size;
+    return ret;
+}
+
+//文件中还没取走的字节数(缓冲区里的加上还没读入的)
+static uint64_t import_left(_3D_Import *imp)
+{
+    uint64_t left = imp->buffSize - imp->buffUsed;
+    if (imp->fileSize > imp->fileRead)
+        left += imp->fileSize - imp->fileRead;
+    return left;
+}
+
+//把一块文本按行边界均分给各段
+static void import_split_text(_3D_Import *imp, char *text, size_t len)
+{
+    char *p = text, *q, *end = text + len;
+    uint32_t i;
+    for (i = 0; i < imp->partTotal; i++)
+    {
+        q = text + len * (i + 1) / imp->partTotal;
+        if (i + 1 == imp->partTotal || q >= end)
+            q = end;
+        else
+        {
+            if (q < p)
+                q = p;
+            q = (char *)memchr(q, '\n', end - q);
+            q = q ? q + 1 : end;
+        }
+        imp->part[i].begin = p;
+        imp->part[i].end = q;
+        p = q;
+    }
+}
+
+//把 total 条定长记录均分给各段
+static void import_split_record(_3D_Import *imp, char *data, uint64_t total, uint32_t size)
+{
+    uint32_t i;
+    for (i = 0; i < imp->partTotal; i++)
+    {
+        imp->part[i].begin = data + total * i / imp->partTotal * size;
+        imp->part[i].end = data + total * (i + 1) / imp->partTotal * size;
+    }
+}
+
+/*
+ *  数组扩容,保证能放下 need 个元素(每个元素 size 字节)
+ *
+ *  返回: false/内存不足,原数组和容量不变
+ */
+static bool import_grow(void **array, uint32_t *max, uint32_t need, uint32_t size)
+{
+    uint64_t newMax;
+    void *ret;
+    if (need <= *max)
+        return true;
+    for (newMax = *max < 1024 ? 1024 : *max; newMax < need; newMax *= 2)
+        ;
+    if (newMax > UINT32_MAX)
+        newMax = UINT32_MAX;
+    ret = realloc(*array, (size_t)newMax * size);
+    if (!ret)
+        return false;
+    *array = ret;
+    *max = (uint32_t)newMax;
+    return true;
+}
+
+static void import_xyz(_3D_ImportPart *part, float xyz[3])
+{
+    if (!import_grow((void **)&part->xyz, &part->xyzMax, part->xyzTotal + 1, sizeof(float) * 3))
+    {
+        part->error = true;
+        return;
+    }
+    memcpy(&part->xyz[part->xyzTotal * 3], xyz, sizeof(float) * 3);
+    part->xyzTotal += 1;
+}
+
+static void import_triangle(_3D_ImportPart *part, int64_t a, int64_t b, int64_t c)
+{
+    if (!import_grow((void **)&part->plane, &part->planeMax, part->planeTotal + 1, sizeof(int64_t) * 3))
+    {
+        part->error = true;
+        return;
+    }
+    part->plane[part->planeTotal * 3] = a;
+    part->plane[part->planeTotal * 3 + 1] = b;
+    part->plane[part->planeTotal * 3 + 2] = c;
+    part->planeTotal += 1;
+}
+
+static void import_line(_3D_ImportPart *part, int64_t a, int64_t b)
+{
+    if (!import_grow((void **)&part->line2, &part->lineMax, part->lineTotal + 1, sizeof(int64_t) * 2))
+    {
+        part->error = true;
+        return;
+    }
+    part->line2[part->lineTotal * 2] = a;
+    part->line2[part->lineTotal * 2 + 1] = b;
+    part->lineTotal += 1;
+}
+
+/*
+ *  把顶点序号换算到 part->index
+ *  参数:
+ *      base: 本段第一个顶点在模型中的序号
+ *
+ *  返回: false/序号超出已有的顶点或内存不足
+ */
+static bool import_resolve(_3D_Import *imp, _3D_ImportPart *part, int64_t *corner, uint32_t total, uint32_t base)
+{
+    int64_t value;
+    uint32_t i;
+    if (!import_grow((void **)&part->index, &part->indexMax, total, sizeof(uint32_t)))
+        return false;
+    for (i = 0; i < total; i++)
+    {
+        value = corner[i];
+        if (value < 0)
+            value += base + IMPORT_RELATIVE;
+        if (value < 0 || value >= imp->model->xyzTotal)
+            return false;
+        part->index[i] = (uint32_t)value;
+    }
+    return true;
+}
+
+//按文件顺序把一段的解析结果追加到模型,然后清空该段
+static void import_merge(_3D_Import *imp, _3D_ImportPart *part)
+{
+    uint32_t base = imp->model->xyzTotal;
+    if (part->error)
+        imp->error = true;
+    if (!imp->error)
+    {
+        if (part->xyzTotal > 0)
+            model_xyz_add(imp->model, part->xyz, part->xyzTotal);
+        if (!import_resolve(imp, part, part->plane, part->planeTotal * 3, base))
+            imp->error = true;
+        else
+            model_plane_add_index(imp->model, imp->argbColor, part->index, part->planeTotal, false);
+        if (!import_resolve(imp, part, part->line2, part->lineTotal * 2, base))
+            imp->error = true;
+        else
+            model_line_add_index(imp->model, imp->argbColor, part->index, part->lineTotal);
+    }
+    part->xyzTotal = part->planeTotal = part->lineTotal = 0;
+    part->error = false;
+}
+
+//(STL)追加顶点,每3个顶点组成一个三角平面
+static void import_merge_triangle(_3D_Import *imp, _3D_ImportPart *part)
+{
+    uint32_t total = 0;
+    if (part->error)
+        imp->error = true;
+    if (!imp->error && part->xyzTotal > 0 &&
+        !import_grow((void **)&part->index, &part->indexMax, part->xyzTotal + 3, sizeof(uint32_t)))
+        imp->error = true;
+    if (!imp->error && part->xyzTotal > 0)
+    {
+        model_xyz_add(imp->model, part->xyz, part->xyzTotal);
+        for (; imp->triangleDone + 3 <= imp->model->xyzTotal; imp->triangleDone += 3, total += 3)
+        {
+            part->index[total] = imp->triangleDone;
+            part->index[total + 1] = imp->triangleDone + 1;
+            part->index[total + 2] = imp->triangleDone + 2;
+        }
+        model_plane_add_index(imp->model, imp->argbColor, part->index, total / 3, false);
+    }
+    part->xyzTotal = 0;
+    part->error = false;
+}
+
+//下一行的起始位置
+static char *import_line_next(char *p, char *end)
+{
+    char *q = (char *)memchr(p, '\n', end - p);
+    return q ? q + 1 : end;
+}
+
+//跳过行内空白
+static char *import_space(char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    return p;
+}
+
+//读一个浮点数,不会越过行尾
+static bool import_float(char **p, float *value)
+{
+    char *end;
+    *p = import_space(*p);
+    if (**p == '\n' || **p == '\0')
+        return false;
+    *value = strtof(*p, &end);
+    if (end == *p)
+        return false;
+    *p = end;
+    return true;
+}
+
+static bool import_double(char **p, double *value)
+{
+    char *end;
+    *p = import_space(*p);
+    if (**p == '\n' || **p == '\0')
+        return false;
+    *value = strtod(*p, &end);
+    if (end == *p)
+        return false;
+    *p = end;
+    return true;
+}
+
+//行首关键字是否为 key (后面跟空白)
+static bool import_key(char *p, char *key, uint32_t len)
+{
+    return !strncmp(p, key, len) && (p[len] == ' ' || p[len] == '\t');
+}
+
+/*
+ *  读 OBJ 的一个顶点序号,格式为 v、v/vt、v//vn 或 v/vt/vn,只取 v
+ *
+ *  返回: false/本行没有更多序号或格式不对(置 part->error)
+ */
+static bool import_obj_index(_3D_ImportPart *part, char **p, int64_t *index)
+{
+    char *end;
+    long long value;
+    *p = import_space(*p);
+    if (**p == '\n' || **p == '\0' || **p == '#')
+        return false;
+    value = strtoll(*p, &end, 10);
+    if (end == *p || value == 0)
+    {
+        part->error = true;
+        return false;
+    }
+    //跳过纹理、法线序号
+    while (*end != ' ' && *end != '\t' && *end != '\r' && *end != '\n' && *end != '\0')
+        end++;
+    *p = end;
+    //正数从1开始,负数为相对本行之前最后一个顶点的序号
+    if (value > 0)
+        *index = value - 1;
+    else
+        *index = (int64_t)part->xyzTotal + value - IMPORT_RELATIVE;
+    return true;
+}
+
+//线程池任务: 解析一段 OBJ 文本
+static void import_obj_part(void *argv, uint32_t index)
+{
+    _3D_Import *imp = (_3D_Import *)argv;
+    _3D_ImportPart *part = &imp->part[index];
+    char *p, *next;
+    float xyz[3];
+    int64_t corner, first = 0, prev = 0;
+    uint32_t n;
+    bool isLine;
+    for (p = part->begin; p < part->end && !part->error; p = next)
+    {
+        next = import_line_next(p, part->end);
+        p = import_space(p);
+        //顶点
+        if (import_key(p, "v", 1))
+        {
+            p += 1;
+            if (import_float(&p, &xyz[0]) && import_float(&p, &xyz[1]) && import_float(&p, &xyz[2]))
+                import_xyz(part, xyz);
+            else
+                part->error = true;
+        }
+        //多边形按扇形拆成三角形,折线拆成线段
+        else if (import_key(p, "f", 1) || import_key(p, "l", 1))
+        {
+            isLine = p[0] == 'l';
+            p += 1;
+            for (n = 0; import_obj_index(part, &p, &corner); n++)
+            {
+                if (n == 0)
+                    first = corner;
+                else if (isLine)
+                    import_line(part, prev, corner);
+                else if (n >= 2)
+                    import_triangle(part, first, prev, corner);
+                prev = corner;
+            }
+        }
+    }
+}
+
+/*
+ *  按格式导入,参数同 model_import
+ *  obj: 导入 v/f/l, 负数(相对)序号可用, vt/vn/o/g/usemtl 等忽略
+ */
+_3D_Model *model_import_obj(char *filePath, uint32_t argbColor, uint32_t threadTotal)
+{
+    _3D_Import *imp;
+    char *text;
+    size_t len;
+    uint32_t i;
+    imp = import_init(filePath, argbColor, threadTotal);
+    if (!imp)
+        return NULL;
+    while (!imp->error && (text = import_text(imp, &len)))
+    {
+        import_split_text(imp, text, len);
+        pool_run(imp->pool, &import_obj_part, imp, imp->partTotal);
+        for (i = 0; i < imp->partTotal; i++)
+            import_merge(imp, &imp->part[i]);
+    }
+    return import_release(imp);
+}
+
+//线程池任务: 解析一段 ASCII STL 文本,只取 vertex 行
+static void import_stl_text_part(void *argv, uint32_t index)
+{
+    _3D_Import *imp = (_3D_Import *)argv;
+    _3D_ImportPart *part = &imp->part[index];
+    char *p, *next;
+    float xyz[3];
+    for (p = part->begin; p < part->end && !part->error; p = next)
+    {
+        next = import_line_next(p, part->end);
+        p = import_space(p);
+        if (import_key(p, "vertex", 6))
+        {
+            p += 6;
+            if (import_float(&p, &xyz[0]) && import_float(&p, &xyz[1]) && import_float(&p, &xyz[2]))
+                import_xyz(part, xyz);
+            else
+                part->error = true;
+        }
+    }
+}
+
+//线程池任务: 解析一段二进制 STL 记录(每条50字节: 法向量、3个顶点、属性)
+static void import_stl_binary_part(void *argv, uint32_t index)
+{
+    _3D_Import *imp = (_3D_Import *)argv;
+    _3D_ImportPart *part = &imp->part[index];
+    char *p;
+    float xyz[3];
+    uint32_t i, j;
+    for (p = part->begin; p < part->end; p += 50)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            memcpy(xyz, p + 12 + i * 12, sizeof(xyz));
+            if (imp->swap)
+            {
+                for (j = 0; j < 3; j++)
+                    import_swap(&xyz[j], sizeof(float));
+            }
+            import_xyz(part, xyz);
+        }
+    }
+}
+
+/*
+ *  按格式导入,参数同 model_import
+ *  stl: 按文件大小区分二进制和ASCII, STL 没有共享顶点,导入后自动 model_weld
+ */
+_3D_Model *model_import_stl(char *filePath, uint32_t argbColor, uint32_t threadTotal)
+{
+    _3D_Import *imp;
+    char *text;
+    size_t len;
+    uint64_t left, total;
+    uint32_t count, i;
+
+    imp = import_init(filePath, argbColor, threadTotal);
+    if (!imp)
+        return NULL;
+
+    //二进制: 80字节文件头 + 4字节三角形数量 + 每个三角形50字节,文件大小必须刚好吻合
+    import_read(imp, 84);
+    count = 0;
+    if (imp->buffSize >= 84)
+    {
+        memcpy(&count, imp->buff + 80, sizeof(count));
+        imp->swap = import_big_endian();
+        if (imp->swap)
+            import_swap(&count, sizeof(count));
+    }
+    if (imp->buffSize >= 84 && imp->fileSize == 84 + (uint64_t)count * 50)
+    {
+        import_bytes(imp, 84);
+        for (left = count; left > 0 && !imp->error; left -= total)
+        {
+            import_read(imp, IMPORT_CHUNK_SIZE / 50 * 50);
+            total = imp->buffSize / 50;
+            if (total > left)
+                total = left;
+            if (total < 1)
+            {
+                imp->error = true;
+                break;
+            }
+            import_split_record(imp, imp->buff, total, 50);
+            pool_run(imp->pool, &import_stl_binary_part, imp, imp->partTotal);
+            for (i = 0; i < imp->partTotal; i++)
+                import_merge_triangle(imp, &imp->part[i]);
+            imp->buffUsed = total * 50;
+        }
+    }
+    //ASCII: 以 solid 开头
+    else if (imp->buffSize >= 5 && !strncmp(imp->buff, "solid", 5))
+    {
+        while (!imp->error && (text = import_text(imp, &len)))
+        {
+            import_split_text(imp, text, len);
+            pool_run(imp->pool, &import_stl_text_part, imp, imp->partTotal);
+            for (i = 0; i < imp->partTotal; i++)
+                import_merge_triangle(imp, &imp->part[i]);
+        }
+    }
+    else
+        imp->error = true;
+
+    if (!imp->error)
+        model_weld(imp->model);
+    return import_release(imp);
+}
+
+//PLY 按数据类型读一个数值
+static double import_ply_value(uint8_t *data, uint8_t type, bool swap)
+{
+    uint8_t buff[8];
+    int8_t i8;
+    int16_t i16;
+    uint16_t u16;
+    int32_t i32;
+    uint32_t u32;
+    float f32;
+    double f64;
+    memcpy(buff, data, import_ply_size[type]);
+    if (swap)
+        import_swap(buff, import_ply_size[type]);
+    switch (type)
+    {
+    case IMPORT_PLY_INT8:
+        memcpy(&i8, buff, sizeof(i8));
+        return i8;
+    case IMPORT_PLY_UINT8:
+        return buff[0];
+    case IMPORT_PLY_INT16:
+        memcpy(&i16, buff, sizeof(i16));
+        return i16;
+    case IMPORT_PLY_UINT16:
+        memcpy(&u16, buff, sizeof(u16));
+        return u16;
+    case IMPORT_PLY_INT32:
+        memcpy(&i32, buff, sizeof(i32));
+        return i32;
+    case IMPORT_PLY_UINT32:
+        memcpy(&u32, buff, sizeof(u32));
+        return u32;
+    case IMPORT_PLY_FLOAT32:
+        memcpy(&f32, buff, sizeof(f32));
+        return f32;
+    default:
+        memcpy(&f64, buff, sizeof(f64));
+        return f64;
+    }
+}
+
+//PLY 按数据类型读一个整数(列表长度、顶点序号), 返回 false/浮点类型
+static bool import_ply_integer(uint8_t *data, uint8_t type, bool swap, int64_t *value)
+{
+    if (type == IMPORT_PLY_FLOAT32 || type == IMPORT_PLY_FLOAT64)
+        return false;
+    //整数类型不超过32位, double 能精确表示
+    *value = (int64_t)import_ply_value(data, type, swap);
+    return true;
+}
+
+//PLY 数据类型名称转 IMPORT_PLY_XXX, 返回 false/不认识
+static bool import_ply_type_get(char *name, uint8_t *type)
+{
+    uint32_t i;
+    for (i = 0; i < sizeof(import_ply_type) / sizeof(import_ply_type[0]); i++)
+    {
+        if (!strcmp(name, import_ply_type[i].name))
+        {
+            *type = import_ply_type[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ *  解析 PLY 文件头
+ *  参数:
+ *      binary: 返回 true/二进制格式
+ *
+ *  返回: false/格式不对
+ */
+static bool import_ply_head(_3D_Import *imp, bool *binary)
+{
+    _3D_ImportPlyElement *element = NULL;
+    _3D_ImportPlyProperty *property;
+    char line[256], word[4][64];
+    char *p, *next, *end;
+    uint64_t count, lineTotal = 0;
+    uint32_t i, offset;
+    int ret; //sscanf 遇到空行返回 EOF(-1)
+    bool format = false, xyz[3] = {false};
+
+    import_read(imp, IMPORT_CHUNK_SIZE);
+    end = imp->buff + imp->buffSize;
+    if (imp->buffSize < 4 || strncmp(imp->buff, "ply", 3) || (imp->buff[3] != '\n' && imp->buff[3] != '\r'))
+        return false;
+    for (p = imp->buff; p < end; p = next)
+    {
+        next = import_line_next(p, end);
+        if (next == end && end[-1] != '\n')
+            return false;
+        //拷出一行再拆分
+        i = next - p < (long)sizeof(line) ? next - p : sizeof(line) - 1;
+        memcpy(line, p, i);
+        line[i] = '\0';
+        ret = sscanf(line, "%63s %63s %63s %63s", word[0], word[1], word[2], word[3]);
+        if (ret < 1)
+            continue;
+        if (!strcmp(word[0], "end_header"))
+        {
+            imp->buffUsed = next - imp->buff;
+            break;
+        }
+        else if (!strcmp(word[0], "format") && ret >= 2)
+        {
+            if (!strcmp(word[1], "ascii"))
+                *binary = false;
+            else if (!strcmp(word[1], "binary_little_endian"))
+            {
+                *binary = true;
+                imp->swap = import_big_endian();
+            }
+            else if (!strcmp(word[1], "binary_big_endian"))
+            {
+                *binary = true;
+                imp->swap = !import_big_endian();
+            }
+            else
+                return false;
+            format = true;
+        }
+        else if (!strcmp(word[0], "element") && ret >= 3)
+        {
+            if (imp->elementTotal >= IMPORT_PLY_ELEMENT_MAX || sscanf(word[2], "%llu", (unsigned long long *)&count) != 1)
+                return false;
+            element = &imp->element[imp->elementTotal++];
+            element->count = count;
+            element->line = lineTotal;
+            lineTotal += count;
+            if (!strcmp(word[1], "vertex"))
+                element->usage = IMPORT_PLY_VERTEX;
+            else if (!strcmp(word[1], "face"))
+                element->usage = IMPORT_PLY_FACE;
+        }
+        else if (!strcmp(word[0], "property") && ret >= 3)
+        {
+            if (!element || element->propertyTotal >= IMPORT_PLY_PROPERTY_MAX)
+                return false;
+            property = &element->property[element->propertyTotal++];
+            if (!strcmp(word[1], "list"))
+            {
+                //property list <个数类型> <元素类型> <名称>
+                if (ret < 4 || sscanf(line, "%*s %*s %63s %63s %63s", word[1], word[2], word[3]) != 3)
+                    return false;
+                if (!import_ply_type_get(word[1], &property->countType) || !import_ply_type_get(word[2], &property->type))
+                    return false;
+                property->list = true;
+                if (element->usage == IMPORT_PLY_FACE && (!strcmp(word[3], "vertex_indices") || !strcmp(word[3], "vertex_index")))
+                    property->usage = IMPORT_PLY_INDEX;
+            }
+            else
+            {
+                if (!import_ply_type_get(word[1], &property->type))
+                    return false;
+                if (element->usage == IMPORT_PLY_VERTEX && word[2][0] >= 'x' && word[2][0] <= 'z' && word[2][1] == '\0')
+                {
+                    property->usage = IMPORT_PLY_X + word[2][0] - 'x';
+                    xyz[word[2][0] - 'x'] = true;
+                }
+            }
+        }
+    }
+    if (p >= end || !format)
+        return false;
+    //顶点元素必须有 x/y/z
+    for (i = 0; i < imp->elementTotal; i++)
+    {
+        if (imp->element[i].usage == IMPORT_PLY_VERTEX && !(xyz[0] && xyz[1] && xyz[2]))
+            return false;
+    }
+    //定长记录的字节数和各属性偏移
+    for (i = 0; i < imp->elementTotal; i++)
+    {
+        element = &imp->element[i];
+        for (ret = 0, offset = 0; ret < element->propertyTotal; ret++)
+        {
+            if (element->property[ret].list)
+                break;
+            element->property[ret].offset = offset;
+            offset += import_ply_size[element->property[ret].type];
+        }
+        element->size = ret < element->propertyTotal ? 0 : offset;
+    }
+    return true;
+}
+
+//(PLY ASCII)解析一条记录
+static void import_ply_text_record(_3D_ImportPart *part, _3D_ImportPlyElement *element, char *p)
+{
+    _3D_ImportPlyProperty *property;
+    double value, count;
+    float xyz[3] = {0};
+    int64_t first = 0, prev = 0;
+    uint32_t i, n;
+    for (i = 0; i < element->propertyTotal; i++)
+    {
+        property = &element->property[i];
+        if (!property->list)
+        {
+            if (!import_double(&p, &value))
+                break;
+            if (property->usage >= IMPORT_PLY_X && property->usage <= IMPORT_PLY_Z)
+                xyz[property->usage - IMPORT_PLY_X] = (float)value;
+            continue;
+        }
+        if (!import_double(&p, &count) || count < 0)
+            break;
+        for (n = 0; n < count; n++)
+        {
+            if (!import_double(&p, &value))
+                break;
+            if (property->usage != IMPORT_PLY_INDEX)
+                continue;
+            if (n == 0)
+                first = (int64_t)value;
+            else if (n >= 2)
+                import_triangle(part, first, prev, (int64_t)value);
+            prev = (int64_t)value;
+        }
+        if (n < count)
+            break;
+    }
+    if (i < element->propertyTotal)
+        part->error = true;
+    else if (element->usage == IMPORT_PLY_VERTEX)
+        import_xyz(part, xyz);
+}
+
+//线程池任务: 解析一段 PLY ASCII 数据,每行一条记录
+static void import_ply_text_part(void *argv, uint32_t index)
+{
+    _3D_Import *imp = (_3D_Import *)argv;
+    _3D_ImportPart *part = &imp->part[index];
+    _3D_ImportPlyElement *element = imp->element;
+    _3D_ImportPlyElement *elementEnd = imp->element + imp->elementTotal;
+    uint64_t line = part->line;
+    char *p, *next;
+    for (p = part->begin; p < part->end && !part->error; p = next, line++)
+    {
+        next = import_line_next(p, part->end);
+        //找到该行所属的元素,超出所有元素的行忽略
+        while (element < elementEnd && line >= element->line + element->count)
+            element++;
+        if (element >= elementEnd)
+            break;
+        if (element->usage != IMPORT_PLY_OTHER)
+            import_ply_text_record(part, element, p);
+    }
+}
+
+//线程池任务: 解析一段 PLY 二进制定长顶点记录
+static void import_ply_binary_part(void *argv, uint32_t index)
+{
+    _3D_Import *imp = (_3D_Import *)argv;
+    _3D_ImportPart *part = &imp->part[index];
+    _3D_ImportPlyElement *element = imp->elementNow;
+    _3D_ImportPlyProperty *property;
+    float xyz[3];
+    char *p;
+    uint32_t i;
+    for (p = part->begin; p < part->end; p += element->size)
+    {
+        for (i = 0; i < element->propertyTotal; i++)
+        {
+            property = &element->property[i];
+            if (property->usage >= IMPORT_PLY_X && property->usage <= IMPORT_PLY_Z)
+                xyz[property->usage - IMPORT_PLY_X] = (float)import_ply_value((uint8_t *)p + property->offset, property->type, imp->swap);
+        }
+        import_xyz(part, xyz);
+    }
+}
+
+//(PLY 二进制)逐条解析不定长记录,结果放在第一段,攒够一批就合并到模型
+static void import_ply_binary_serial(_3D_Import *imp, _3D_ImportPlyElement *element)
+{
+    _3D_ImportPart *part = &imp->part[0];
+    _3D_ImportPlyProperty *property;
+    uint8_t *data;
+    float xyz[3] = {0};
+    int64_t value, count, first = 0, prev = 0;
+    uint64_t record, n;
+    uint32_t i, size;
+    for (record = 0; record < element->count && !imp->error; record++)
+    {
+        for (i = 0; i < element->propertyTotal; i++)
+        {
+            property = &element->property[i];
+            if (!property->list)
+            {
+                data = import_bytes(imp, import_ply_size[property->type]);
+                if (!data)
+                    break;
+                if (property->usage >= IMPORT_PLY_X && property->usage <= IMPORT_PLY_Z)
+                    xyz[property->usage - IMPORT_PLY_X] = (float)import_ply_value(data, property->type, imp->swap);
+                continue;
+            }
+            data = import_bytes(imp, import_ply_size[property->countType]);
+            if (!data)
+                break;
+            //列表长度必须是非负整数,且不超过文件剩下的数据
+            size = import_ply_size[property->type];
+            if (!import_ply_integer(data, property->countType, imp->swap, &count) ||
+                count < 0 || (uint64_t)count > import_left(imp) / size)
+                break;
+            data = import_bytes(imp, (size_t)count * size);
+            if (!data)
+                break;
+            if (property->usage != IMPORT_PLY_INDEX)
+                continue;
+            for (n = 0; n < (uint64_t)count; n++, data += size)
+            {
+                if (!import_ply_integer(data, property->type, imp->swap, &value))
+                    break;
+                if (n == 0)
+                    first = value;
+                else if (n >= 2)
+                    import_triangle(part, first, prev, value);
+                prev = value;
+            }
+            if (n < (uint64_t)count)
+                break;
+        }
+        if (i < element->propertyTotal)
+            imp->error = true;
+        else if (element->usage == IMPORT_PLY_VERTEX)
+            import_xyz(part, xyz);
+        if (part->xyzTotal + part->planeTotal >= IMPORT_CHUNK_SIZE / 16)
+            import_merge(imp, part);
+    }
+    import_merge(imp, part);
+}
+
+//(PLY 二进制)跳过不需要的元素
+static void import_ply_binary_skip(_3D_Import *imp, _3D_ImportPlyElement *element)
+{
+    uint64_t left, total;
+    //定长记录整块跳过
+    if (element->size > 0)
+    {
+        for (left = element->count; left > 0; left -= total)
+        {
+            total = IMPORT_CHUNK_SIZE / element->size;
+            if (total > left)
+                total = left;
+            if (total < 1)
+                total = 1;
+            if (!import_bytes(imp, total * element->size))
+            {
+                imp->error = true;
+                return;
+            }
+        }
+        return;
+    }
+    //不定长记录逐条跳过(用途为 OTHER 的属性只读不存)
+    import_ply_binary_serial(imp, element);
+}
+
+/*
+ *  按格式导入,参数同 model_import
+ *  ply: 导入 vertex 元素的 x/y/z 和 face 元素的 vertex_indices(或 vertex_index)列表,其它元素、属性跳过
+ */
+_3D_Model *model_import_ply(char *filePath, uint32_t argbColor, uint32_t threadTotal)
+{
+    _3D_Import *imp;
+    _3D_ImportPlyElement *element;
+    char *text, *p;
+    size_t len;
+    uint64_t line, left, total;
+    uint32_t i, e;
+    bool binary = false;
+
+    imp = import_init(filePath, argbColor, threadTotal);
+    if (!imp)
+        return NULL;
+    if (!import_ply_head(imp, &binary))
+    {
+        imp->error = true;
+        return import_release(imp);
+    }
+
+    //ASCII: 每行一条记录,先数出各段的起始行号再并行解析
+    if (!binary)
+    {
+        line = 0;
+        while (!imp->error && (text = import_text(imp, &len)))
+        {
+            import_split_text(imp, text, len);
+            for (i = 0; i < imp->partTotal; i++)
+            {
+                imp->part[i].line = line;
+                for (p = imp->part[i].begin; p < imp->part[i].end; line++)
+                    p = import_line_next(p, imp->part[i].end);
+            }
+            pool_run(imp->pool, &import_ply_text_part, imp, imp->partTotal);
+            for (i = 0; i < imp->partTotal; i++)
+                import_merge(imp, &imp->part[i]);
+        }
+        return import_release(imp);
+    }
+
+    //二进制: 按元素顺序处理,定长的顶点记录分块并行解析,其余逐条解析
+    for (e = 0; e < imp->elementTotal && !imp->error; e++)
+    {
+        element = &imp->element[e];
+        if (element->usage == IMPORT_PLY_OTHER)
+            import_ply_binary_skip(imp, element);
+        else if (element->usage == IMPORT_PLY_VERTEX && element->size > 0)
+        {
+            imp->elementNow = element;
+            for (left = element->count; left > 0 && !imp->error; left -= total)
+            {
+                import_read(imp, IMPORT_CHUNK_SIZE / element->size * element->size + element->size);
+                total = imp->buffSize / element->size;
+                if (total > left)
+                    total = left;
+                if (total < 1)
+                {
+                    imp->error = true;
+                    break;
+                }
+                import_split_record(imp, imp->buff, total, element->size);
+                pool_run(imp->pool, &import_ply_binary_part, imp, imp->partTotal);
+                for (i = 0; i < imp->partTotal; i++)
+                    import_merge(imp, &imp->part[i]);
+                imp->buffUsed = total * element->size;
+            }
+        }
+        else
+            import_ply_binary_serial(imp, element);
+    }
+    return import_release(imp);
+}
+
+/*
+ *  按文件后缀(.obj/.stl/.ply,不区分大小写)导入模型
+ *  参数:
+ *      filePath: 文件路径
+ *      argbColor: 线条、三角平面的颜色(文件里的颜色信息不导入)
+ *      threadTotal: 并行解析的线程数,传0时按CPU核心数
+ *
+ *  返回: 模型指针, NULL/打开失败或文件格式不对
+ */
+_3D_Model *model_import(char *filePath, uint32_t argbColor, uint32_t threadTotal)
+{
+    char *suffix;
+    if (!filePath || !(suffix = strrchr(filePath, '.')))
+        return NULL;
+    if (!strcasecmp(suffix, ".obj"))
+        return model_import_obj(filePath, argbColor, threadTotal);
+    if (!strcasecmp(suffix, ".stl"))
+        return model_import_stl(filePath, argbColor, threadTotal);
+    if (!strcasecmp(suffix, ".ply"))
+        return model_import_ply(filePath, argbColor, threadTotal);
+    return NULL;
+}
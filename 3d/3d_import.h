@@ -0,0 +1,48 @@
+/*
+ *  模型导入: Wavefront OBJ、STL(二进制/ASCII)、PLY(ASCII/二进制)
+ *  文件按块读入,每块拆成若干段由线程池并行解析,再按文件顺序追加到模型,多边形在导入时按扇形拆成三角形
+ *  导入完成后用 model_optimize 重排三角平面和顶点
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_IMPORT_H_
+#define _3D_IMPORT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "3d_model.h"
+
+// 每次从文件读入的块大小,单位:字节
+#define IMPORT_CHUNK_SIZE (8 * 1024 * 1024)
+
+// 每个线程分到的段数,多分几段让各线程负载更均匀
+#define IMPORT_PART_PER_THREAD 4
+
+// PLY 文件头中元素、属性个数上限
+#define IMPORT_PLY_ELEMENT_MAX 16
+#define IMPORT_PLY_PROPERTY_MAX 32
+
+/*
+ *  按文件后缀(.obj/.stl/.ply,不区分大小写)导入模型
+ *  参数:
+ *      filePath: 文件路径
+ *      argbColor: 线条、三角平面的颜色(文件里的颜色信息不导入)
+ *      threadTotal: 并行解析的线程数,传0时按CPU核心数
+ *
+ *  返回: 模型指针, NULL/打开失败或文件格式不对
+ */
+_3D_Model *model_import(char *filePath, uint32_t argbColor, uint32_t threadTotal);
+
+/*
+ *  按格式导入,参数同 model_import
+ *  obj: 导入 v/f/l, 负数(相对)序号可用, vt/vn/o/g/usemtl 等忽略
+ *  stl: 按文件大小区分二进制和ASCII, STL 没有共享顶点,导入后自动 model_weld
+ *  ply: 导入 vertex 元素的 x/y/z 和 face 元素的 vertex_indices(或 vertex_index)列表,其它元素、属性跳过
+ */
+_3D_Model *model_import_obj(char *filePath, uint32_t argbColor, uint32_t threadTotal);
+_3D_Model *model_import_stl(char *filePath, uint32_t argbColor, uint32_t threadTotal);
+_3D_Model *model_import_ply(char *filePath, uint32_t argbColor, uint32_t threadTotal);
+
+#endif
@@ -0,0 +1,722 @@
+/*
+ *  模型的细节层次(LOD): 用二次误差度量(quadric)的边折叠生成逐级简化的模型,抓拍时按包围球投影大小选用
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "3d_lod.h"
+
+/*
+ *  简化过程不用堆排序,而是逐轮放宽误差阈值,每轮折叠所有误差低于阈值的边:
+ *      阈值 = LOD_THRESHOLD * (轮次 + 3) ^ LOD_AGGRESSIVE
+ *  坐标先按包围球归一化,阈值与模型尺寸无关
+ */
+#define LOD_THRESHOLD 1e-9
+#define LOD_AGGRESSIVE 7
+#define LOD_ROUND_MAX 100
+#define LOD_ROUND_UPDATE 5 //每隔几轮整理一次三角平面和邻接表
+
+// 对称4x4矩阵(平面方程 ax+by+cz+d=0 的外积之和)的10个系数: aa ab ac ad bb bc bd cc cd dd
+typedef struct _3DLodQuadric
+{
+    double m[10];
+} _3D_LodQuadric;
+
+typedef struct _3DLodVertex
+{
+    double p[3];
+    _3D_LodQuadric q;
+    uint32_t refStart, refTotal; //邻接三角平面在 ref 数组中的范围
+    bool border;                 //开放网格的边界顶点,不参与折叠
+} _3D_LodVertex;
+
+typedef struct _3DLodTriangle
+{
+    uint32_t v[3];
+    double err[4]; //三条边的折叠误差,第4个为最小值
+    double n[3];   //单位法向量
+    uint32_t color;
+    bool deleted, dirty;
+} _3D_LodTriangle;
+
+typedef struct _3DLodRef
+{
+    uint32_t tri;    //三角平面序号
+    uint32_t corner; //顶点是该三角平面的第几个顶点
+} _3D_LodRef;
+
+typedef struct _3DLod
+{
+    _3D_LodVertex *vertex;
+    uint32_t vertexTotal;
+    _3D_LodTriangle *tri;
+    uint32_t triTotal, triDeleted;
+    _3D_LodRef *ref;
+    uint32_t refTotal, refMax;
+    uint32_t *parent; //顶点折叠去向(并查集),用于换算线条、注释的顶点
+    uint32_t *mark;   //检查公共相邻顶点时的标记
+    uint32_t markStamp;
+    uint8_t *deleted0, *deleted1;
+    uint32_t deletedMax;
+} _3D_Lod;
+
+static double lod_dot(double a[3], double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void lod_cross(double a[3], double b[3], double ret[3])
+{
+    ret[0] = a[1] * b[2] - a[2] * b[1];
+    ret[1] = a[2] * b[0] - a[0] * b[2];
+    ret[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//单位化,零向量保持为0
+static void lod_normalize(double v[3])
+{
+    double norm = sqrt(lod_dot(v, v));
+    if (norm > 0)
+    {
+        v[0] /= norm;
+        v[1] /= norm;
+        v[2] /= norm;
+    }
+}
+
+//平面 n·p + d = 0 累加到二次误差矩阵
+static void lod_quadric_plane(_3D_LodQuadric *q, double n[3], double d)
+{
+    q->m[0] += n[0] * n[0];
+    q->m[1] += n[0] * n[1];
+    q->m[2] += n[0] * n[2];
+    q->m[3] += n[0] * d;
+    q->m[4] += n[1] * n[1];
+    q->m[5] += n[1] * n[2];
+    q->m[6] += n[1] * d;
+    q->m[7] += n[2] * n[2];
+    q->m[8] += n[2] * d;
+    q->m[9] += d * d;
+}
+
+//按系数序号取3x3行列式
+static double lod_quadric_det(double *m,
+    int a11, int a12, int a13,
+    int a21, int a22, int a23,
+    int a31, int a32, int a33)
+{
+    return m[a11] * m[a22] * m[a33] + m[a13] * m[a21] * m[a32] + m[a12] * m[a23] * m[a31] -
+           m[a13] * m[a22] * m[a31] - m[a11] * m[a23] * m[a32] - m[a12] * m[a21] * m[a33];
+}
+
+//点到二次误差矩阵所代表的各平面的距离平方和
+static double lod_quadric_error(double *m, double p[3])
+{
+    double x = p[0], y = p[1], z = p[2];
+    return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+           m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+           m[7] * z * z + 2 * m[8] * z + m[9];
+}
+
+/*
+ *  折叠边 v1-v2 的误差
+ *  参数:
+ *      ret[3]: 返回折叠后的顶点位置,矩阵可逆时取误差最小的点,否则在两端点和中点中选
+ */
+static double lod_edge_error(_3D_Lod *lod, uint32_t v1, uint32_t v2, double ret[3])
+{
+    double m[10], det, err, err1, err2, err3, mid[3], d[3], e[3];
+    double *p1 = lod->vertex[v1].p, *p2 = lod->vertex[v2].p;
+    uint32_t i;
+    for (i = 0; i < 10; i++)
+        m[i] = lod->vertex[v1].q.m[i] + lod->vertex[v2].q.m[i];
+    for (i = 0; i < 3; i++)
+    {
+        mid[i] = (p1[i] + p2[i]) / 2;
+        e[i] = p2[i] - p1[i];
+    }
+    det = lod_quadric_det(m, 0, 1, 2, 1, 4, 5, 2, 5, 7);
+    if (det != 0)
+    {
+        ret[0] = -1 / det * lod_quadric_det(m, 1, 2, 3, 4, 5, 6, 5, 7, 8);
+        ret[1] = 1 / det * lod_quadric_det(m, 0, 2, 3, 1, 5, 6, 2, 7, 8);
+        ret[2] = -1 / det * lod_quadric_det(m, 0, 1, 3, 1, 4, 6, 2, 5, 8);
+        //近乎平坦处矩阵接近奇异,解出的点会沿平面跑远,离边中点超过边长时不用
+        for (i = 0; i < 3; i++)
+            d[i] = ret[i] - mid[i];
+        if (lod_dot(d, d) <= lod_dot(e, e))
+            return lod_quadric_error(m, ret);
+    }
+    err1 = lod_quadric_error(m, p1);
+    err2 = lod_quadric_error(m, p2);
+    err3 = lod_quadric_error(m, mid);
+    err = fmin(err1, fmin(err2, err3));
+    if (err == err1)
+        memcpy(ret, p1, sizeof(double) * 3);
+    else if (err == err2)
+        memcpy(ret, p2, sizeof(double) * 3);
+    else
+        memcpy(ret, mid, sizeof(double) * 3);
+    return err;
+}
+
+//三角平面的单位法向量
+static void lod_triangle_normal(_3D_Lod *lod, _3D_LodTriangle *t)
+{
+    double u[3], w[3];
+    uint32_t j;
+    for (j = 0; j < 3; j++)
+    {
+        u[j] = lod->vertex[t->v[1]].p[j] - lod->vertex[t->v[0]].p[j];
+        w[j] = lod->vertex[t->v[2]].p[j] - lod->vertex[t->v[0]].p[j];
+    }
+    lod_cross(u, w, t->n);
+    lod_normalize(t->n);
+}
+
+//计算三角平面三条边的折叠误差
+static void lod_triangle_error(_3D_Lod *lod, _3D_LodTriangle *t)
+{
+    double p[3];
+    uint32_t j;
+    for (j = 0; j < 3; j++)
+        t->err[j] = lod_edge_error(lod, t->v[j], t->v[(j + 1) % 3], p);
+    t->err[3] = fmin(t->err[0], fmin(t->err[1], t->err[2]));
+}
+
+/*
+ *  顶点 v 移到 p 后,其邻接三角平面是否会翻面或退化成线
+ *  比较的是简化开始时的法向量,防止多次小幅转动累积成翻面
+ *  参数:
+ *      other: 边的另一端,同时包含两端的三角平面折叠后被删除,在 deleted[] 中标记
+ */
+static bool lod_flipped(_3D_Lod *lod, double p[3], uint32_t other, _3D_LodVertex *v, uint8_t *deleted)
+{
+    _3D_LodRef *ref;
+    _3D_LodTriangle *t;
+    double d1[3], d2[3], n[3];
+    uint32_t k, id1, id2, i;
+    for (k = 0; k < v->refTotal; k++)
+    {
+        ref = &lod->ref[v->refStart + k];
+        t = &lod->tri[ref->tri];
+        if (t->deleted)
+            continue;
+        id1 = t->v[(ref->corner + 1) % 3];
+        id2 = t->v[(ref->corner + 2) % 3];
+        if (id1 == other || id2 == other)
+        {
+            deleted[k] = 1;
+            continue;
+        }
+        for (i = 0; i < 3; i++)
+        {
+            d1[i] = lod->vertex[id1].p[i] - p[i];
+            d2[i] = lod->vertex[id2].p[i] - p[i];
+        }
+        lod_normalize(d1);
+        lod_normalize(d2);
+        //只拦下几乎共线的: 原本就狭长的三角平面(如经纬球两极附近)也要能折叠,阈值取0.999时两极附近会全部卡住
+        if (fabs(lod_dot(d1, d2)) > 0.99999)
+            return true;
+        lod_cross(d1, d2, n);
+        lod_normalize(n);
+        deleted[k] = 0;
+        if (lod_dot(n, t->n) < 0.2)
+            return true;
+    }
+    return false;
+}
+
+/*
+ *  两端的公共相邻顶点超过2个时(边两侧三角平面的第三个顶点之外还有),
+ *  折叠会把网格捏出非流形的折痕,不折叠
+ */
+static bool lod_link_invalid(_3D_Lod *lod, _3D_LodVertex *v0, _3D_LodVertex *v1)
+{
+    _3D_LodTriangle *t;
+    uint32_t k, j, v, stamp, common = 0;
+    //标记值每次加2: stamp 为 v0 的相邻顶点, stamp + 1 为已计数的公共顶点
+    lod->markStamp += 2;
+    stamp = lod->markStamp;
+    for (k = 0; k < v0->refTotal; k++)
+    {
+        t = &lod->tri[lod->ref[v0->refStart + k].tri];
+        if (t->deleted)
+            continue;
+        for (j = 0; j < 3; j++)
+            lod->mark[t->v[j]] = stamp;
+    }
+    for (k = 0; k < v1->refTotal; k++)
+    {
+        t = &lod->tri[lod->ref[v1->refStart + k].tri];
+        if (t->deleted)
+            continue;
+        for (j = 0; j < 3; j++)
+        {
+            v = t->v[j];
+            if (lod->mark[v] == stamp && &lod->vertex[v] != v0 && &lod->vertex[v] != v1)
+            {
+                lod->mark[v] = stamp + 1;
+                if (++common > 2)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+//邻接表追加
+static void lod_ref_push(_3D_Lod *lod, _3D_LodRef *ref)
+{
+    if (lod->refTotal >= lod->refMax)
+    {
+        lod->refMax = lod->refMax ? lod->refMax * 2 : 1024;
+        lod->ref = (_3D_LodRef *)realloc(lod->ref, lod->refMax * sizeof(_3D_LodRef));
+    }
+    lod->ref[lod->refTotal++] = *ref;
+}
+
+//折叠后更新顶点 v 的邻接三角平面: 删除退化的,其余改指向 v0 并重算误差,邻接关系追加到 ref 末尾
+static void lod_update_triangle(_3D_Lod *lod, uint32_t v0, _3D_LodVertex *v, uint8_t *deleted)
+{
+    _3D_LodRef ref;
+    _3D_LodTriangle *t;
+    uint32_t k;
+    for (k = 0; k < v->refTotal; k++)
+    {
+        ref = lod->ref[v->refStart + k];
+        t = &lod->tri[ref.tri];
+        if (t->deleted)
+            continue;
+        if (deleted[k])
+        {
+            t->deleted = true;
+            lod->triDeleted += 1;
+            continue;
+        }
+        t->v[ref.corner] = v0;
+        t->dirty = true;
+        lod_triangle_error(lod, t);
+        lod_ref_push(lod, &ref);
+    }
+}
+
+//整理: 去掉已删除的三角平面,重建邻接表;首次调用时初始化二次误差矩阵、边误差和边界标记
+static void lod_update_mesh(_3D_Lod *lod, uint32_t round)
+{
+    _3D_LodTriangle *t;
+    _3D_LodRef ref;
+    uint32_t *count, *id;
+    uint32_t i, j, k, total, v, n, nMax;
+
+    //去掉已删除的三角平面
+    if (round > 0)
+    {
+        for (i = 0, total = 0; i < lod->triTotal; i++)
+        {
+            if (!lod->tri[i].deleted)
+                lod->tri[total++] = lod->tri[i];
+        }
+        lod->triTotal = total;
+        lod->triDeleted = 0;
+    }
+
+    //二次误差矩阵: 每个顶点累加相邻三角平面的平面方程
+    if (round == 0)
+    {
+        for (i = 0; i < lod->vertexTotal; i++)
+            memset(&lod->vertex[i].q, 0, sizeof(_3D_LodQuadric));
+        for (i = 0, t = lod->tri; i < lod->triTotal; i++, t++)
+        {
+            lod_triangle_normal(lod, t);
+            for (j = 0; j < 3; j++)
+                lod_quadric_plane(&lod->vertex[t->v[j]].q, t->n, -lod_dot(t->n, lod->vertex[t->v[0]].p));
+        }
+        for (i = 0, t = lod->tri; i < lod->triTotal; i++, t++)
+            lod_triangle_error(lod, t);
+    }
+
+    //邻接表: 先计数再填充
+    for (i = 0; i < lod->vertexTotal; i++)
+        lod->vertex[i].refTotal = 0;
+    for (i = 0, t = lod->tri; i < lod->triTotal; i++, t++)
+    {
+        for (j = 0; j < 3; j++)
+            lod->vertex[t->v[j]].refTotal += 1;
+    }
+    for (i = 0, total = 0; i < lod->vertexTotal; i++)
+    {
+        lod->vertex[i].refStart = total;
+        total += lod->vertex[i].refTotal;
+        lod->vertex[i].refTotal = 0;
+    }
+    if (total > lod->refMax)
+    {
+        lod->refMax = total;
+        lod->ref = (_3D_LodRef *)realloc(lod->ref, lod->refMax * sizeof(_3D_LodRef));
+    }
+    for (i = 0, t = lod->tri; i < lod->triTotal; i++, t++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ref.tri = i;
+            ref.corner = j;
+            v = t->v[j];
+            lod->ref[lod->vertex[v].refStart + lod->vertex[v].refTotal++] = ref;
+        }
+    }
+    lod->refTotal = total;
+
+    //边界: 只属于一个三角平面的边,两端顶点都是边界顶点
+    if (round == 0)
+    {
+        nMax = 64;
+        count = (uint32_t *)calloc(nMax, sizeof(uint32_t));
+        id = (uint32_t *)calloc(nMax, sizeof(uint32_t));
+        for (i = 0; i < lod->vertexTotal; i++)
+            lod->vertex[i].border = false;
+        for (i = 0; i < lod->vertexTotal; i++)
+        {
+            //统计相连的各顶点在该顶点邻接三角平面中出现的次数
+            n = 0;
+            for (k = 0; k < lod->vertex[i].refTotal; k++)
+            {
+                ref = lod->ref[lod->vertex[i].refStart + k];
+                t = &lod->tri[ref.tri];
+                for (j = 0; j < 3; j++)
+                {
+                    v = t->v[j];
+                    for (total = 0; total < n && id[total] != v; total++)
+                        ;
+                    if (total < n)
+                    {
+                        count[total] += 1;
+                        continue;
+                    }
+                    if (n >= nMax)
+                    {
+                        nMax *= 2;
+                        count = (uint32_t *)realloc(count, nMax * sizeof(uint32_t));
+                        id = (uint32_t *)realloc(id, nMax * sizeof(uint32_t));
+                    }
+                    id[n] = v;
+                    count[n++] = 1;
+                }
+            }
+            for (j = 0; j < n; j++)
+            {
+                if (count[j] == 1)
+                {
+                    lod->vertex[i].border = true;
+                    lod->vertex[id[j]].border = true;
+                }
+            }
+        }
+        free(count);
+        free(id);
+    }
+}
+
+//顶点最终折叠到的顶点
+static uint32_t lod_root(_3D_Lod *lod, uint32_t v)
+{
+    while (lod->parent[v] != v)
+    {
+        lod->parent[v] = lod->parent[lod->parent[v]];
+        v = lod->parent[v];
+    }
+    return v;
+}
+
+//逐轮折叠误差低于阈值的边,直到三角平面数不超过 target
+static void lod_collapse(_3D_Lod *lod, uint32_t target)
+{
+    _3D_LodTriangle *t;
+    _3D_LodVertex *v0, *v1;
+    double threshold, p[3];
+    uint32_t round, i, j, k, i0, i1, start, total, need;
+
+    for (round = 0; round < LOD_ROUND_MAX; round++)
+    {
+        if (lod->triTotal - lod->triDeleted <= target)
+            break;
+        if (round % LOD_ROUND_UPDATE == 0)
+            lod_update_mesh(lod, round);
+        for (i = 0; i < lod->triTotal; i++)
+            lod->tri[i].dirty = false;
+
+        threshold = LOD_THRESHOLD * pow(round + 3, LOD_AGGRESSIVE);
+        for (i = 0; i < lod->triTotal; i++)
+        {
+            t = &lod->tri[i];
+            if (t->err[3] > threshold || t->deleted || t->dirty)
+                continue;
+            for (j = 0; j < 3; j++)
+            {
+                if (t->err[j] >= threshold)
+                    continue;
+                i0 = t->v[j];
+                i1 = t->v[(j + 1) % 3];
+                v0 = &lod->vertex[i0];
+                v1 = &lod->vertex[i1];
+                if (v0->border || v1->border || lod_link_invalid(lod, v0, v1))
+                    continue;
+                lod_edge_error(lod, i0, i1, p);
+                //两端邻接三角平面的删除标记
+                need = v0->refTotal > v1->refTotal ? v0->refTotal : v1->refTotal;
+                if (need > lod->deletedMax)
+                {
+                    lod->deletedMax = need * 2;
+                    lod->deleted0 = (uint8_t *)realloc(lod->deleted0, lod->deletedMax);
+                    lod->deleted1 = (uint8_t *)realloc(lod->deleted1, lod->deletedMax);
+                }
+                memset(lod->deleted0, 0, v0->refTotal);
+                memset(lod->deleted1, 0, v1->refTotal);
+                if (lod_flipped(lod, p, i1, v0, lod->deleted0) ||
+                    lod_flipped(lod, p, i0, v1, lod->deleted1))
+                    continue;
+                //v1 折叠到 v0
+                memcpy(v0->p, p, sizeof(p));
+                for (k = 0; k < 10; k++)
+                    v0->q.m[k] += v1->q.m[k];
+                lod->parent[i1] = i0;
+                start = lod->refTotal;
+                lod_update_triangle(lod, i0, v0, lod->deleted0);
+                lod_update_triangle(lod, i0, v1, lod->deleted1);
+                total = lod->refTotal - start;
+                //新的邻接关系放得下就放回原位,否则直接用追加的部分
+                if (total <= v0->refTotal)
+                {
+                    if (total > 0)
+                        memmove(&lod->ref[v0->refStart], &lod->ref[start], total * sizeof(_3D_LodRef));
+                }
+                else
+                    v0->refStart = start;
+                v0->refTotal = total;
+                break;
+            }
+            if (lod->triTotal - lod->triDeleted <= target)
+                break;
+        }
+    }
+}
+
+/*
+ *  模型简化: 反复折叠误差最小的边,直到三角平面数不超过 planeTarget
+ *  开放网格的边界顶点保持不动,线条和注释的顶点随折叠移动,折叠后退化的线条被丢弃
+ *  参数:
+ *      planeTarget: 目标三角平面数(可能因边界或防翻面限制而达不到)
+ *
+ *  返回: 新的模型(不含细节层次), NULL/模型没有三角平面
+ */
+_3D_Model *model_simplify(_3D_Model *model, uint32_t planeTarget)
+{
+    _3D_Model *src, *ret;
+    _3D_Lod lod;
+    _3D_LodTriangle *t;
+    float *normal, xyz[3];
+    double u[3], w[3], n[3], scale;
+    uint32_t *remap, *index, tmp;
+    uint32_t i, j, total, start;
+
+    if (!model || model->planeTotal < 1)
+        return NULL;
+
+    //先焊接,共享顶点才能折叠
+    src = model_copy(model);
+    for (i = 0; i < src->lodTotal; i++)
+        model_release(&src->lod[i]);
+    src->lodTotal = 0;
+    model_dequantize(src);
+    model_weld(src);
+
+    memset(&lod, 0, sizeof(lod));
+    lod.vertexTotal = src->xyzTotal;
+    lod.vertex = (_3D_LodVertex *)calloc(lod.vertexTotal, sizeof(_3D_LodVertex));
+    lod.parent = (uint32_t *)calloc(lod.vertexTotal, sizeof(uint32_t));
+    lod.mark = (uint32_t *)calloc(lod.vertexTotal, sizeof(uint32_t));
+    lod.triTotal = src->planeTotal;
+    lod.tri = (_3D_LodTriangle *)calloc(lod.triTotal, sizeof(_3D_LodTriangle));
+
+    //坐标按包围球归一化
+    scale = src->bound.radius > 0 ? 1.0 / src->bound.radius : 1.0;
+    for (i = 0; i < lod.vertexTotal; i++)
+    {
+        for (j = 0; j < 3; j++)
+            lod.vertex[i].p[j] = (src->xyz[i * 3 + j] - src->bound.center[j]) * scale;
+        lod.parent[i] = i;
+    }
+    //三角平面统一为从正面看逆时针,焊接后有重复顶点的三角平面(面积为0)直接去掉
+    for (i = 0, t = lod.tri; i < src->planeTotal; i++)
+    {
+        memcpy(t->v, &src->planeIndex[i * 3], sizeof(uint32_t) * 3);
+        if (t->v[0] == t->v[1] || t->v[1] == t->v[2] || t->v[2] == t->v[0])
+            continue;
+        t->color = src->planeColor[i];
+        normal = &src->planeNormal[i * 4];
+        for (j = 0; j < 3; j++)
+        {
+            u[j] = lod.vertex[t->v[1]].p[j] - lod.vertex[t->v[0]].p[j];
+            w[j] = lod.vertex[t->v[2]].p[j] - lod.vertex[t->v[0]].p[j];
+        }
+        lod_cross(u, w, n);
+        if (n[0] * normal[0] + n[1] * normal[1] + n[2] * normal[2] < 0)
+        {
+            tmp = t->v[1];
+            t->v[1] = t->v[2];
+            t->v[2] = tmp;
+        }
+        t++;
+    }
+    lod.triTotal = t - lod.tri;
+
+    lod_collapse(&lod, planeTarget);
+
+    //输出: 只保留仍被引用的顶点
+    remap = (uint32_t *)calloc(lod.vertexTotal, sizeof(uint32_t));
+    for (i = 0, t = lod.tri; i < lod.triTotal; i++, t++)
+    {
+        if (!t->deleted)
+        {
+            for (j = 0; j < 3; j++)
+                remap[t->v[j]] = 1;
+        }
+    }
+    for (i = 0; i < src->lineTotal * 2; i++)
+        remap[lod_root(&lod, src->lineIndex[i])] = 1;
+    ret = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    for (i = 0, total = 0; i < lod.vertexTotal; i++)
+    {
+        if (!remap[i])
+            continue;
+        for (j = 0; j < 3; j++)
+            xyz[j] = (float)(lod.vertex[i].p[j] / scale + src->bound.center[j]);
+        model_xyz_add(ret, xyz, 1);
+        remap[i] = total++;
+    }
+    //三角平面,颜色相同的连续一批一起添加
+    index = (uint32_t *)calloc(lod.triTotal * 3 + 2, sizeof(uint32_t));
+    for (i = 0, total = 0, start = 0; i <= lod.triTotal; i++)
+    {
+        t = &lod.tri[i];
+        if (total > 0 && (i == lod.triTotal || (!t->deleted && t->color != lod.tri[start].color)))
+        {
+            model_plane_add_index(ret, lod.tri[start].color, index, total, false);
+            total = 0;
+        }
+        if (i == lod.triTotal || t->deleted)
+            continue;
+        if (total == 0)
+            start = i;
+        for (j = 0; j < 3; j++)
+            index[total * 3 + j] = remap[t->v[j]];
+        total += 1;
+    }
+    //线条,两端折叠到同一个顶点的丢弃
+    for (i = 0; i < src->lineTotal; i++)
+    {
+        index[0] = remap[lod_root(&lod, src->lineIndex[i * 2])];
+        index[1] = remap[lod_root(&lod, src->lineIndex[i * 2 + 1])];
+        if (index[0] != index[1])
+            model_line_add_index(ret, src->lineColor[i], index, 1);
+    }
+    //注释位置随顶点移动
+    for (i = 0; i < src->labelTotal; i++)
+    {
+        tmp = lod_root(&lod, src->labelIndex[i]);
+        for (j = 0; j < 3; j++)
+            xyz[j] = (float)(lod.vertex[tmp].p[j] / scale + src->bound.center[j]);
+        model_label_add(ret, src->labelColor[i], src->labelText[i], xyz);
+    }
+    ret->cull = src->cull;
+
+    free(index);
+    free(remap);
+    free(lod.vertex);
+    free(lod.tri);
+    free(lod.parent);
+    free(lod.mark);
+    if (lod.ref)
+        free(lod.ref);
+    if (lod.deleted0)
+        free(lod.deleted0);
+    if (lod.deleted1)
+        free(lod.deleted1);
+    model_release(&src);
+    return ret;
+}
+
+/*
+ *  生成细节层次,替换模型已有的细节层次
+ *  参数:
+ *      levels: 级数,不超过 MODEL_LOD_MAX
+ *      ratio: 每级三角平面数相对上一级的比例,如0.25
+ *      pixel: 第一级的切换阈值,包围球投影半径小于该像素数时使用;
+ *             之后每级阈值乘以 sqrt(ratio),使屏幕上每个三角形覆盖的像素数大致不变
+ *
+ *  返回: 实际生成的级数(某一级离目标太远,即三角平面数超过上一级的 (1 + ratio) / 2 时提前停止)
+ */
+uint32_t model_lod_build(_3D_Model *model, uint32_t levels, float ratio, float pixel)
+{
+    _3D_Model *src, *lod;
+    uint32_t i, target;
+    if (!model)
+        return 0;
+    for (i = 0; i < model->lodTotal; i++)
+        model_release(&model->lod[i]);
+    model->lodTotal = 0;
+    if (!(ratio > 0 && ratio < 1))
+        return 0;
+    //每级在上一级的基础上简化
+    for (i = 0, src = model; i < levels && i < MODEL_LOD_MAX; i++, src = lod)
+    {
+        target = (uint32_t)(src->planeTotal * ratio);
+        if (target < 1)
+            break;
+        lod = model_simplify(src, target);
+        if (!lod)
+            break;
+        //简化不动(边界、防翻面限制): 比目标多出一半以上的差距时,这一级和上一级差不多,不值得保留
+        if (lod->planeTotal > src->planeTotal * (1 + ratio) / 2)
+        {
+            model_release(&lod);
+            break;
+        }
+        model->lod[i] = lod;
+        model->lodPixel[i] = pixel * pow(sqrt(ratio), i);
+        model->lodTotal += 1;
+    }
+    return model->lodTotal;
+}
+
+/*
+ *  按包围球投影半径选择细节层次,带滞后
+ *  参数:
+ *      pixel: 包围球投影半径,单位:像素
+ *      level: 上次选用的级别
+ *
+ *  返回: 本次选用的级别, 0/原模型, i/model->lod[i - 1]
+ */
+uint32_t model_lod_level(_3D_Model *model, float pixel, uint32_t level)
+{
+    uint32_t down = 0, up = 0, i;
+    //阈值逐级减小: down 为收紧阈值后应降到的级别, up 为放宽阈值后最多保持的级别
+    for (i = 0; i < model->lodTotal; i++)
+    {
+        if (pixel < model->lodPixel[i] * (1 - LOD_HYSTERESIS))
+            down = i + 1;
+        if (pixel < model->lodPixel[i] * (1 + LOD_HYSTERESIS))
+            up = i + 1;
+    }
+    if (level < down)
+        return down;
+    if (level > up)
+        return up;
+    return level;
+}
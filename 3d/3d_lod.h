@@ -0,0 +1,50 @@
+/*
+ *  模型的细节层次(LOD): 用二次误差度量(quadric)的边折叠生成逐级简化的模型,抓拍时按包围球投影大小选用
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_LOD_H_
+#define _3D_LOD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "3d_model.h"
+
+// 切换细节层次的滞后比例: 投影半径要越过阈值的 ±15% 才切换,避免在阈值附近来回跳
+#define LOD_HYSTERESIS 0.15f
+
+/*
+ *  模型简化: 反复折叠误差最小的边,直到三角平面数不超过 planeTarget
+ *  开放网格的边界顶点保持不动,线条和注释的顶点随折叠移动,折叠后退化的线条被丢弃
+ *  参数:
+ *      planeTarget: 目标三角平面数(可能因边界或防翻面限制而达不到)
+ *
+ *  返回: 新的模型(不含细节层次), NULL/模型没有三角平面
+ */
+_3D_Model *model_simplify(_3D_Model *model, uint32_t planeTarget);
+
+/*
+ *  生成细节层次,替换模型已有的细节层次
+ *  参数:
+ *      levels: 级数,不超过 MODEL_LOD_MAX
+ *      ratio: 每级三角平面数相对上一级的比例,如0.25
+ *      pixel: 第一级的切换阈值,包围球投影半径小于该像素数时使用;
+ *             之后每级阈值乘以 sqrt(ratio),使屏幕上每个三角形覆盖的像素数大致不变
+ *
+ *  返回: 实际生成的级数(某一级离目标太远,即三角平面数超过上一级的 (1 + ratio) / 2 时提前停止)
+ */
+uint32_t model_lod_build(_3D_Model *model, uint32_t levels, float ratio, float pixel);
+
+/*
+ *  按包围球投影半径选择细节层次,带滞后
+ *  参数:
+ *      pixel: 包围球投影半径,单位:像素
+ *      level: 上次选用的级别
+ *
+ *  返回: 本次选用的级别, 0/原模型, i/model->lod[i - 1]
+ */
+uint32_t model_lod_level(_3D_Model *model, float pixel, uint32_t level);
+
+#endif
@@ -13,6 +13,8 @@
 #include <string.h>
 #include <math.h>
 
+#include "3d_math.h"
+
 #ifndef M_PI //理论上在 math.h 中有定义
 #define M_PI 3.14159265358979323846
 #endif
@@ -299,6 +301,116 @@ void quat_roll(float quat[4], float roll_vector[3], float roll_rad, float vector
     memcpy(vector, &ret[1], sizeof(float) * 3);
 }
 
+/*
+ *  四元数转旋转矩阵,矩阵乘向量的结果与 quat_roll(quat, NULL, 0, vector, T) 相同
+ *  参数:
+ *      quat[4]: 四元数(内部会单位化)
+ *      matrix[3][3]: 返回旋转矩阵
+ *      T: 转置(即逆旋转)
+ */
+void quat_to_matrix(float quat[4], float matrix[3][3], bool T)
+{
+    float w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+    float norm = sqrt(w * w + x * x + y * y + z * z);
+    float m[3][3];
+    int i, j;
+
+    // 单位化
+    if (norm > 0)
+    {
+        w /= norm;
+        x /= norm;
+        y /= norm;
+        z /= norm;
+    }
+
+    // q * v * q' 展开
+    m[0][0] = 1 - 2 * (y * y + z * z);
+    m[0][1] = 2 * (x * y - w * z);
+    m[0][2] = 2 * (x * z + w * y);
+    m[1][0] = 2 * (x * y + w * z);
+    m[1][1] = 1 - 2 * (x * x + z * z);
+    m[1][2] = 2 * (y * z - w * x);
+    m[2][0] = 2 * (x * z - w * y);
+    m[2][1] = 2 * (y * z + w * x);
+    m[2][2] = 1 - 2 * (x * x + y * y);
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            matrix[i][j] = T ? m[j][i] : m[i][j];
+}
+
+/*
+ *  批量坐标变换 retXyz = matrix * [xyz, 1] (3x4矩阵,前3列旋转/缩放,第4列平移)
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *      retXyz[3 * pointTotal]: 返回坐标点数组(可以和 xyz 相同)
+ *      pointTotal: 数组中坐标点的个数
+ */
+void matrix_transform(float matrix[3][4], float *xyz, float *retXyz, uint32_t pointTotal)
+{
+    float col[4][4]; //按列存放并补齐到4行,每个点的计算就是4列的向量加权和,便于编译器向量化
+    float ret[4];
+    float x, y, z;
+    uint32_t c, i;
+    for (i = 0; i < 4; i++)
+    {
+        col[i][0] = matrix[0][i];
+        col[i][1] = matrix[1][i];
+        col[i][2] = matrix[2][i];
+        col[i][3] = 0;
+    }
+    for (c = 0; c < pointTotal * 3; c += 3)
+    {
+        x = xyz[c];
+        y = xyz[c + 1];
+        z = xyz[c + 2];
+        for (i = 0; i < 4; i++)
+            ret[i] = col[0][i] * x + col[1][i] * y + col[2][i] * z + col[3][i];
+        retXyz[c] = ret[0];
+        retXyz[c + 1] = ret[1];
+        retXyz[c + 2] = ret[2];
+    }
+}
+
+void matrix_transform_q16(float matrix[3][4], float offset[3], float scale[3], uint16_t *xyz, float *retXyz, uint32_t pointTotal)
+{
+    float col[4][4]; //同 matrix_transform, 按列存放并补齐到4行
+    float ret[4];
+    float x, y, z;
+    uint32_t c, i;
+    for (i = 0; i < 4; i++)
+    {
+        col[3][i] = i < 3 ? matrix[i][3] + matrix[i][0] * offset[0] + matrix[i][1] * offset[1] + matrix[i][2] * offset[2] : 0;
+        col[0][i] = i < 3 ? matrix[i][0] * scale[0] : 0;
+        col[1][i] = i < 3 ? matrix[i][1] * scale[1] : 0;
+        col[2][i] = i < 3 ? matrix[i][2] * scale[2] : 0;
+    }
+    for (c = 0; c < pointTotal * 3; c += 3)
+    {
+        x = xyz[c];
+        y = xyz[c + 1];
+        z = xyz[c + 2];
+        for (i = 0; i < 4; i++)
+            ret[i] = col[0][i] * x + col[1][i] * y + col[2][i] * z + col[3][i];
+        retXyz[c] = ret[0];
+        retXyz[c + 1] = ret[1];
+        retXyz[c + 2] = ret[2];
+    }
+}
+
+void matrix_transform_batch(float (*matrix)[3][4], uint32_t matrixTotal, float *xyz, float *retXyz, uint32_t pointTotal)
+{
+    uint32_t start, total, i;
+    //点数多时分段,每段依次交给所有矩阵,小模型就是逐个矩阵整体变换
+    for (start = 0; start < pointTotal; start += MATRIX_BATCH_BLOCK)
+    {
+        total = pointTotal - start < MATRIX_BATCH_BLOCK ? pointTotal - start : MATRIX_BATCH_BLOCK;
+        for (i = 0; i < matrixTotal; i++)
+            matrix_transform(matrix[i], &xyz[start * 3], &retXyz[((size_t)i * pointTotal + start) * 3], total);
+    }
+}
+
 static void _quat_roll_xyz(float roll_xyz[3], float xyz[3], float retXyz[3], bool zyx)
 {
     float qx[4] = {0}, qy[4] = {0}, qz[4] = {0};
@@ -689,6 +801,7 @@ bool projection(
 {
     float hMax, hMin, wMax, wMin;
     float retX, retY, retZ;
+    float tanHalf;
 
     //快速检查
     if (openAngle >= 180 || openAngle < 1)
@@ -702,6 +815,7 @@ bool projection(
 
     //度转rad
     openAngle = openAngle * M_PI / 180;
+    tanHalf = tan(openAngle / 2);
 
     //屏幕高、宽范围(这里是假设屏幕高为2时的数值)
     hMax = 1;
@@ -732,8 +846,8 @@ bool projection(
     */
 
     //这里把XYZ轴顺序调换为YZX了
-    retX = -xyz[1] / ar / tan(openAngle / 2) / xyz[0];
-    retY = xyz[2] / tan(openAngle / 2) / xyz[0];
+    retX = -xyz[1] / ar / tanHalf / xyz[0];
+    retY = xyz[2] / tanHalf / xyz[0];
     retZ = ((-nearZ) - farZ) / (nearZ - farZ) + 2 * farZ * nearZ / (nearZ - farZ) / xyz[0];
 
     //返回二维坐标
@@ -755,6 +869,116 @@ bool projection(
     return false;
 }
 
+/*
+ *  计算透视投影参数
+ *  参数:
+ *      openAngle: 相机开角(单位:度,范围:(0,180))
+ *      width, height: 屏幕宽高,单位:像素
+ *      nearZ, farZ: 相机近端、远端距离
+ *
+ *  返回: false/参数错误
+ */
+bool projection_setup(
+    _3D_Projection *proj,
+    float openAngle,
+    uint32_t width,
+    uint32_t height,
+    uint32_t nearZ,
+    uint32_t farZ)
+{
+    float ar;
+    float n = nearZ, f = farZ;
+
+    //参数检查
+    if (!proj || openAngle >= 180 || openAngle < 1 ||
+        width < 1 || height < 1 || nearZ >= farZ)
+        return false;
+
+    ar = (float)width / height;
+    proj->tanHalf = tan(openAngle * M_PI / 180 / 2);
+    proj->tanHalfW = proj->tanHalf * ar;
+    proj->cosHalf = 1 / sqrt(1 + proj->tanHalf * proj->tanHalf);
+    proj->cosHalfW = 1 / sqrt(1 + proj->tanHalfW * proj->tanHalfW);
+
+    //屏幕高为2时 tan(openAngle/2) 对应屏幕上沿,换算到像素
+    proj->scale = height / 2.0f / proj->tanHalf;
+    proj->offset[0] = width / 2.0f;
+    proj->offset[1] = height / 2.0f;
+
+    proj->near = n;
+    proj->far = f;
+    proj->width = width;
+    proj->height = height;
+    return true;
+}
+
+/*
+ *  批量透视投影: 相机坐标系中的点(x为深度)映射到屏幕像素坐标
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *      pointTotal: 数组中坐标点的个数
+ *      xy[2 * pointTotal]: 返回像素坐标,不在屏幕内的点返回0
+ *      depth[pointTotal]: 返回深度信息(到相机的距离),单位:点
+ *      inside[pointTotal]: 返回是否在屏幕内且在可视深度范围内
+ *
+ *  返回: 在屏幕内的点的个数
+ */
+uint32_t projection_batch(
+    _3D_Projection *proj,
+    float *xyz,
+    uint32_t pointTotal,
+    uint32_t *xy,
+    float *depth,
+    bool *inside)
+{
+    float k, sx, sy;
+    uint32_t c, ret = 0;
+    for (c = 0; c < pointTotal; c++, xyz += 3, xy += 2)
+    {
+        depth[c] = xyz[0];
+        //近端之前、远端之后(注意 NaN 也在这里被排除)
+        if (!(xyz[0] > proj->near && xyz[0] < proj->far))
+        {
+            inside[c] = false;
+            xy[0] = xy[1] = 0;
+            continue;
+        }
+        //这里把XYZ轴顺序调换为YZX了,且屏幕y轴向下
+        k = proj->scale / xyz[0];
+        sx = proj->offset[0] - xyz[1] * k;
+        sy = proj->offset[1] - xyz[2] * k;
+        inside[c] = sx > 0 && sx < proj->width && sy > 0 && sy < proj->height;
+        if (inside[c])
+        {
+            xy[0] = (uint32_t)sx;
+            xy[1] = (uint32_t)sy;
+            ret += 1;
+        }
+        else
+            xy[0] = xy[1] = 0;
+    }
+    return ret;
+}
+
+// 浮点屏幕坐标版本(不做范围检查,要求深度大于0),用于后续光栅化
+void projection_batch_float(
+    _3D_Projection *proj,
+    float *xyz,
+    uint32_t pointTotal,
+    float *xy,
+    float *depth)
+{
+    float k;
+    uint32_t c;
+    for (c = 0; c < pointTotal; c++, xyz += 3, xy += 2)
+    {
+        k = proj->scale / xyz[0];
+        xy[0] = proj->offset[0] - xyz[1] * k;
+        xy[1] = proj->offset[1] - xyz[2] * k;
+        depth[c] = xyz[0];
+    }
+}
+
 //获取平面三角形最长边
 float triangle_max_line(float xy[6])
 {
@@ -798,19 +1022,37 @@ float triangle_max_line3D(float xy[9])
 }
 
 /*
- *  遍历平面三角形里面的每一个点
- *  参数:
- *      xy[6]: 3个二维坐标
- *      retXy: 返回二维坐标数组指针 !! 用完记得释放 !!
+ *  坐标缓存扩容,保证能放下 size 个 float
  *
- *  返回: retXy数组里的坐标个数
- *  参考: https://blog.csdn.net/weixin_34304013/article/details/89063136
+ *  返回: 缓存数组
  */
-int triangle_enum(float xy[6], float **retXy)
+static float *enum_buffer_reserve(_3D_EnumBuffer *buff, uint32_t size)
 {
-    int cMax, c = 0;
-    float div;
-    float i, j, k;
+    if (size > buff->max)
+    {
+        //按2倍扩容,稳定后不再分配
+        buff->max = size > buff->max * 2 ? size : buff->max * 2;
+        buff->data = (float *)realloc(buff->data, buff->max * sizeof(float));
+        buff->allocs += 1;
+    }
+    return buff->data;
+}
+
+// 释放坐标缓存中的内存(结构体本身由调用者管理)
+void enum_buffer_release(_3D_EnumBuffer *buff)
+{
+    if (buff && buff->data)
+    {
+        free(buff->data);
+        buff->data = NULL;
+        buff->max = 0;
+    }
+}
+
+//平面三角形遍历的点数上限(单位:float),并返回分度格
+static int _triangle_enum_max(float xy[6], float *div)
+{
+    int cMax;
     float maxLine = triangle_max_line(xy);
 
     //返回点个数估算
@@ -819,12 +1061,17 @@ int triangle_enum(float xy[6], float **retXy)
     //1+2+3+4+5...+100=? 等差数列求和问题
     cMax = cMax * (cMax + 1) / 2;
 
-    //数组内存分配
-    cMax *= 2;
-    *retXy = (float *)calloc(cMax, sizeof(float));
-
     //分度格
-    div = 1 / maxLine;
+    *div = 1 / maxLine;
+
+    return cMax * 2;
+}
+
+//平面三角形遍历,结果写入 retXy[cMax],返回写入的float个数
+static int _triangle_enum_fill(float xy[6], float *retXy, int cMax, float div)
+{
+    int c = 0;
+    float i, j, k;
 
     //三角形ABC内一点P
     //有 P = i*A + j*B + k*C, 且 i + j + k = 1
@@ -834,20 +1081,46 @@ int triangle_enum(float xy[6], float **retXy)
         for (j = 0; j < 1 - i && c < cMax; j += div)
         {
             k = 1 - i - j;
-            (*retXy)[c++] = i * xy[0] + j * xy[2] + k * xy[4];
-            (*retXy)[c++] = i * xy[1] + j * xy[3] + k * xy[5];
+            retXy[c++] = i * xy[0] + j * xy[2] + k * xy[4];
+            retXy[c++] = i * xy[1] + j * xy[3] + k * xy[5];
         }
     }
 
-    return c / 2;
+    return c;
 }
 
-//三维+密度调整参数pow: 0或者1时使用默认倍数
-int triangle_enum3Dp(float xyz[9], float **retXyz, float pow)
+/*
+ *  遍历平面三角形里面的每一个点
+ *  参数:
+ *      xy[6]: 3个二维坐标
+ *      retXy: 返回二维坐标数组指针 !! 用完记得释放 !!
+ *
+ *  返回: retXy数组里的坐标个数
+ *  参考: https://blog.csdn.net/weixin_34304013/article/details/89063136
+ */
+int triangle_enum(float xy[6], float **retXy)
 {
-    int cMax, c = 0;
     float div;
-    float i, j, k;
+    int cMax = _triangle_enum_max(xy, &div);
+
+    //数组内存分配
+    *retXy = (float *)calloc(cMax, sizeof(float));
+
+    return _triangle_enum_fill(xy, *retXy, cMax, div) / 2;
+}
+
+//结果写入调用者持有的缓存 buff->data
+int triangle_enum_b(float xy[6], _3D_EnumBuffer *buff)
+{
+    float div;
+    int cMax = _triangle_enum_max(xy, &div);
+    return _triangle_enum_fill(xy, enum_buffer_reserve(buff, cMax), cMax, div) / 2;
+}
+
+//三维三角形遍历的点数上限(单位:float),并返回分度格
+static int _triangle_enum3Dp_max(float xyz[9], float pow, float *div)
+{
+    int cMax;
     float maxLine = triangle_max_line3D(xyz);
 
     //通过乘以X倍,以降低、提高密度
@@ -860,12 +1133,18 @@ int triangle_enum3Dp(float xyz[9], float **retXyz, float pow)
     //1+2+3+4+5...+100=? 等差数列求和问题
     cMax = cMax * (cMax + 1) / 2;
 
-    //数组内存分配
-    cMax *= 3;
-    *retXyz = (float *)calloc(cMax, sizeof(float));
-
     //分度格
-    div = 1 / maxLine;
+    *div = 1 / maxLine;
+
+    return cMax * 3;
+}
+
+//三维三角形遍历,每个点写入 retXyz 或交给 callback (retXyz 为NULL时),返回遍历的float个数
+static int _triangle_enum3Dp_fill(float xyz[9], float *retXyz, int cMax, float div, EnumCallback callback, void *argv)
+{
+    int c = 0;
+    float i, j, k;
+    float point[3];
 
     //三角形ABC内一点P
     //有 P = i*A + j*B + k*C, 且 i + j + k = 1
@@ -875,13 +1154,30 @@ int triangle_enum3Dp(float xyz[9], float **retXyz, float pow)
         for (j = 0; j < 1 - i && c < cMax; j += div)
         {
             k = 1 - i - j;
-            (*retXyz)[c++] = i * xyz[0] + j * xyz[3] + k * xyz[6];
-            (*retXyz)[c++] = i * xyz[1] + j * xyz[4] + k * xyz[7];
-            (*retXyz)[c++] = i * xyz[2] + j * xyz[5] + k * xyz[8];
+            point[0] = i * xyz[0] + j * xyz[3] + k * xyz[6];
+            point[1] = i * xyz[1] + j * xyz[4] + k * xyz[7];
+            point[2] = i * xyz[2] + j * xyz[5] + k * xyz[8];
+            if (retXyz)
+                memcpy(&retXyz[c], point, sizeof(point));
+            else
+                callback(argv, point);
+            c += 3;
         }
     }
 
-    return c / 3;
+    return c;
+}
+
+//三维+密度调整参数pow: 0或者1时使用默认倍数
+int triangle_enum3Dp(float xyz[9], float **retXyz, float pow)
+{
+    float div;
+    int cMax = _triangle_enum3Dp_max(xyz, pow, &div);
+
+    //数组内存分配
+    *retXyz = (float *)calloc(cMax, sizeof(float));
+
+    return _triangle_enum3Dp_fill(xyz, *retXyz, cMax, div, NULL, NULL) / 3;
 }
 
 //三维版本
@@ -890,26 +1186,32 @@ int triangle_enum3D(float xyz[9], float **retXyz)
     return triangle_enum3Dp(xyz, retXyz, 0);
 }
 
+//结果写入调用者持有的缓存 buff->data
+int triangle_enum3Dp_b(float xyz[9], _3D_EnumBuffer *buff, float pow)
+{
+    float div;
+    int cMax = _triangle_enum3Dp_max(xyz, pow, &div);
+    return _triangle_enum3Dp_fill(xyz, enum_buffer_reserve(buff, cMax), cMax, div, NULL, NULL) / 3;
+}
+
+//每个点交给 callback 处理
+int triangle_enum3Dp_cb(float xyz[9], float pow, EnumCallback callback, void *argv)
+{
+    float div;
+    int cMax = _triangle_enum3Dp_max(xyz, pow, &div);
+    return _triangle_enum3Dp_fill(xyz, NULL, cMax, div, callback, argv) / 3;
+}
+
 static float _fabs(float f)
 {
     return f < 0 ? (-f) : f;
 }
 
-/*
- *  遍历平面直线所有的点
- *  参数:
- *      xy[4]: 2个二维坐标
- *      retXy: 返回二维坐标数组指针 !! 用完记得释放 !!
- *
- *  返回: retXy数组里的坐标个数
- */
-int line_enum(float xy[4], float **retXy)
+//平面直线遍历的点数上限(单位:float),并返回每次偏移量
+static int _line_enum_max(float xy[4], float *xDiv, float *yDiv)
 {
     float xErr, yErr;
-    float xDiv, yDiv;
-    float x, y;
     float maxLine;
-    int cMax, c = 0;
 
     //xy偏差
     xErr = _fabs(xy[2] - xy[0]);
@@ -921,33 +1223,60 @@ int line_enum(float xy[4], float **retXy)
     else
         maxLine = yErr;
 
-    cMax = (int)maxLine + 1;
+    //每次偏移量(水平、垂直时为0)
+    *xDiv = xErr == 0 ? 0 : ((xy[2] - xy[0]) / maxLine); //注意这里必须用[2]减[0]
+    *yDiv = yErr == 0 ? 0 : ((xy[3] - xy[1]) / maxLine); //同上
 
-    //内存准备
-    cMax *= 2;
-    *retXy = (float *)calloc(cMax, sizeof(float));
+    return ((int)maxLine + 1) * 2;
+}
 
-    //每次偏移量(水平、垂直时为0)
-    xDiv = xErr == 0 ? 0 : ((xy[2] - xy[0]) / maxLine); //注意这里必须用[2]减[0]
-    yDiv = yErr == 0 ? 0 : ((xy[3] - xy[1]) / maxLine); //同上
+//平面直线遍历,结果写入 retXy[cMax],返回写入的float个数
+static int _line_enum_fill(float xy[4], float *retXy, int cMax, float xDiv, float yDiv)
+{
+    float x, y;
+    int c = 0;
 
     for (x = xy[0], y = xy[1]; c < cMax; x += xDiv, y += yDiv)
     {
-        (*retXy)[c++] = x;
-        (*retXy)[c++] = y;
+        retXy[c++] = x;
+        retXy[c++] = y;
     }
 
-    return c / 2;
+    return c;
 }
 
-//三维+密度调整参数pow: 0或者1时使用默认倍数
-int line_enum3Dp(float xyz[6], float **retXyz, float pow)
+/*
+ *  遍历平面直线所有的点
+ *  参数:
+ *      xy[4]: 2个二维坐标
+ *      retXy: 返回二维坐标数组指针 !! 用完记得释放 !!
+ *
+ *  返回: retXy数组里的坐标个数
+ */
+int line_enum(float xy[4], float **retXy)
+{
+    float xDiv, yDiv;
+    int cMax = _line_enum_max(xy, &xDiv, &yDiv);
+
+    //内存准备
+    *retXy = (float *)calloc(cMax, sizeof(float));
+
+    return _line_enum_fill(xy, *retXy, cMax, xDiv, yDiv) / 2;
+}
+
+//结果写入调用者持有的缓存 buff->data
+int line_enum_b(float xy[4], _3D_EnumBuffer *buff)
+{
+    float xDiv, yDiv;
+    int cMax = _line_enum_max(xy, &xDiv, &yDiv);
+    return _line_enum_fill(xy, enum_buffer_reserve(buff, cMax), cMax, xDiv, yDiv) / 2;
+}
+
+//三维直线遍历的点数上限(单位:float),并返回每次偏移量
+static int _line_enum3Dp_max(float xyz[6], float pow, float div[3])
 {
     float xErr, yErr, zErr;
-    float xDiv, yDiv, zDiv;
-    float x, y, z;
     float maxLine;
-    int cMax, c = 0;
 
     //xy偏差
     xErr = _fabs(xyz[3] - xyz[0]);
@@ -974,25 +1303,43 @@ int line_enum3Dp(float xyz[6], float **retXyz, float pow)
     if (pow > 0)
         maxLine *= pow;
 
-    cMax = (int)maxLine + 1;
+    //每次偏移量(水平、垂直时为0)
+    div[0] = xErr == 0 ? 0 : ((xyz[3] - xyz[0]) / maxLine); //注意这里必须用[3]减[0]
+    div[1] = yErr == 0 ? 0 : ((xyz[4] - xyz[1]) / maxLine); //同上
+    div[2] = zErr == 0 ? 0 : ((xyz[5] - xyz[2]) / maxLine); //同上
 
-    //内存准备
-    cMax *= 3;
-    *retXyz = (float *)calloc(cMax, sizeof(float));
+    return ((int)maxLine + 1) * 3;
+}
 
-    //每次偏移量(水平、垂直时为0)
-    xDiv = xErr == 0 ? 0 : ((xyz[3] - xyz[0]) / maxLine); //注意这里必须用[3]减[0]
-    yDiv = yErr == 0 ? 0 : ((xyz[4] - xyz[1]) / maxLine); //同上
-    zDiv = zErr == 0 ? 0 : ((xyz[5] - xyz[2]) / maxLine); //同上
+//三维直线遍历,每个点写入 retXyz 或交给 callback (retXyz 为NULL时),返回遍历的float个数
+static int _line_enum3Dp_fill(float xyz[6], float *retXyz, int cMax, float div[3], EnumCallback callback, void *argv)
+{
+    float point[3];
+    int c = 0;
 
-    for (x = xyz[0], y = xyz[1], z = xyz[2]; c < cMax; x += xDiv, y += yDiv, z += zDiv)
+    for (point[0] = xyz[0], point[1] = xyz[1], point[2] = xyz[2]; c < cMax;
+         point[0] += div[0], point[1] += div[1], point[2] += div[2])
     {
-        (*retXyz)[c++] = x;
-        (*retXyz)[c++] = y;
-        (*retXyz)[c++] = z;
+        if (retXyz)
+            memcpy(&retXyz[c], point, sizeof(point));
+        else
+            callback(argv, point);
+        c += 3;
     }
 
-    return c / 3;
+    return c;
+}
+
+//三维+密度调整参数pow: 0或者1时使用默认倍数
+int line_enum3Dp(float xyz[6], float **retXyz, float pow)
+{
+    float div[3];
+    int cMax = _line_enum3Dp_max(xyz, pow, div);
+
+    //内存准备
+    *retXyz = (float *)calloc(cMax, sizeof(float));
+
+    return _line_enum3Dp_fill(xyz, *retXyz, cMax, div, NULL, NULL) / 3;
 }
 
 //三维版本
@@ -1000,3 +1347,19 @@ int line_enum3D(float xyz[6], float **retXyz)
 {
     return line_enum3Dp(xyz, retXyz, 0);
 }
+
+//结果写入调用者持有的缓存 buff->data
+int line_enum3Dp_b(float xyz[6], _3D_EnumBuffer *buff, float pow)
+{
+    float div[3];
+    int cMax = _line_enum3Dp_max(xyz, pow, div);
+    return _line_enum3Dp_fill(xyz, enum_buffer_reserve(buff, cMax), cMax, div, NULL, NULL) / 3;
+}
+
+//每个点交给 callback 处理
+int line_enum3Dp_cb(float xyz[6], float pow, EnumCallback callback, void *argv)
+{
+    float div[3];
+    int cMax = _line_enum3Dp_max(xyz, pow, div);
+    return _line_enum3Dp_fill(xyz, NULL, cMax, div, callback, argv) / 3;
+}
@@ -11,6 +11,7 @@
 #define _3D_MATH_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  *  quaternion解算
@@ -53,6 +54,45 @@ void quat_to_pry2(float q[4], float pry[3]);
  */
 void quat_roll(float quat[4], float roll_vector[3], float roll_rad, float vector[3], bool T);
 
+/*
+ *  四元数转旋转矩阵,矩阵乘向量的结果与 quat_roll(quat, NULL, 0, vector, T) 相同
+ *  参数:
+ *      quat[4]: 四元数(内部会单位化)
+ *      matrix[3][3]: 返回旋转矩阵
+ *      T: 转置(即逆旋转)
+ */
+void quat_to_matrix(float quat[4], float matrix[3][3], bool T);
+
+/*
+ *  批量坐标变换 retXyz = matrix * [xyz, 1] (3x4矩阵,前3列旋转/缩放,第4列平移)
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *      retXyz[3 * pointTotal]: 返回坐标点数组(可以和 xyz 相同)
+ *      pointTotal: 数组中坐标点的个数
+ */
+void matrix_transform(float matrix[3][4], float *xyz, float *retXyz, uint32_t pointTotal);
+
+/*
+ *  16位量化坐标的批量变换 retXyz = matrix * [offset + xyz * scale, 1]
+ *  反量化先合并进矩阵(按列乘 scale, 平移加上 matrix * offset),每个点的计算量与 matrix_transform 相同
+ *  参数:
+ *      offset[3], scale[3]: 量化参数
+ *      xyz[3 * pointTotal]: 量化坐标数组
+ */
+void matrix_transform_q16(float matrix[3][4], float offset[3], float scale[3], uint16_t *xyz, float *retXyz, uint32_t pointTotal);
+
+// matrix_transform_batch() 每次取多少个点轮流交给各矩阵变换,保证这段坐标一直留在L1缓存里
+#define MATRIX_BATCH_BLOCK 256
+
+/*
+ *  同一组坐标点按多个矩阵分别变换(同一模型的多个实例)
+ *  参数:
+ *      matrix[matrixTotal][3][4]: 变换矩阵数组
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *      retXyz[3 * pointTotal * matrixTotal]: 返回坐标点数组,按矩阵依次存放,不能和 xyz 相同
+ */
+void matrix_transform_batch(float (*matrix)[3][4], uint32_t matrixTotal, float *xyz, float *retXyz, uint32_t pointTotal);
+
 /*
  *  四元数依次三轴旋转
  *  参数:
@@ -109,11 +149,86 @@ bool projection(
     float *retXY,
     float *retDepth);
 
+// 预先算好的透视投影参数,参数变化时由 projection_setup() 重新计算
+typedef struct _3DProjection
+{
+    float tanHalf;      //tan(openAngle/2),垂直方向
+    float tanHalfW;     //水平方向 tanHalf * 宽高比
+    float cosHalf, cosHalfW; //两个方向半开角的余弦,用于计算到视锥侧面的距离
+    float scale;        //像素比例: 屏幕坐标 = offset - 相机坐标 * scale / 深度
+    float offset[2];    //视口偏移,即屏幕中心的像素坐标
+    float near, far;    //可视深度范围
+    float width, height; //屏幕宽高,单位:像素
+} _3D_Projection;
+
+/*
+ *  计算透视投影参数
+ *  参数:
+ *      openAngle: 相机开角(单位:度,范围:(0,180))
+ *      width, height: 屏幕宽高,单位:像素
+ *      nearZ, farZ: 相机近端、远端距离
+ *
+ *  返回: false/参数错误
+ */
+bool projection_setup(
+    _3D_Projection *proj,
+    float openAngle,
+    uint32_t width,
+    uint32_t height,
+    uint32_t nearZ,
+    uint32_t farZ);
+
+/*
+ *  批量透视投影: 相机坐标系中的点(x为深度)映射到屏幕像素坐标
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *      pointTotal: 数组中坐标点的个数
+ *      xy[2 * pointTotal]: 返回像素坐标,不在屏幕内的点返回0
+ *      depth[pointTotal]: 返回深度信息(到相机的距离),单位:点
+ *      inside[pointTotal]: 返回是否在屏幕内且在可视深度范围内
+ *
+ *  返回: 在屏幕内的点的个数
+ */
+uint32_t projection_batch(
+    _3D_Projection *proj,
+    float *xyz,
+    uint32_t pointTotal,
+    uint32_t *xy,
+    float *depth,
+    bool *inside);
+
+// 浮点屏幕坐标版本(不做范围检查,要求深度大于0),用于后续光栅化
+void projection_batch_float(
+    _3D_Projection *proj,
+    float *xyz,
+    uint32_t pointTotal,
+    float *xy,
+    float *depth);
+
 
 //获取平面三角形最长边
 float triangle_max_line(float xy[6]);
 float triangle_max_line3D(float xy[9]);
 
+// 调用者持有的可复用坐标缓存,容量不够时自动扩容,可以反复使用而不必每次释放
+typedef struct _3DEnumBuffer
+{
+    float *data;     //坐标数组
+    uint32_t max;    //容量,单位:float
+    uint32_t allocs; //累计扩容(堆分配)次数,用于确认稳定后不再分配内存
+} _3D_EnumBuffer;
+
+// 释放坐标缓存中的内存(结构体本身由调用者管理)
+void enum_buffer_release(_3D_EnumBuffer *buff);
+
+/*
+ *  遍历回调,每遍历到一个点调用一次
+ *  参数:
+ *      argv: 调用者传入的参数
+ *      point: 坐标点,二维或三维,只在回调期间有效
+ */
+typedef void (*EnumCallback)(void *argv, float *point);
+
 /*
  *  遍历平面三角形里面的每一个点
  *  参数:
@@ -126,6 +241,18 @@ int triangle_enum(float xy[6], float **retXy);
 int triangle_enum3D(float xyz[9], float **retXyz); //三维版本
 int triangle_enum3Dp(float xyz[9], float **retXyz, float pow); //三维+密度调整参数pow: 0或者1时使用默认倍数
 
+/*
+ *  遍历平面三角形里面的每一个点(不分配内存的版本)
+ *  参数:
+ *      buff: 结果写入 buff->data, 容量不够时自动扩容
+ *      callback, argv: 每个点交给回调处理,不保存结果
+ *
+ *  返回: 坐标个数
+ */
+int triangle_enum_b(float xy[6], _3D_EnumBuffer *buff);
+int triangle_enum3Dp_b(float xyz[9], _3D_EnumBuffer *buff, float pow);
+int triangle_enum3Dp_cb(float xyz[9], float pow, EnumCallback callback, void *argv);
+
 /*
  *  遍历平面直线所有的点
  *  参数:
@@ -138,4 +265,16 @@ int line_enum(float xy[4], float **retXy);
 int line_enum3D(float xyz[6], float **retXyz); //三维版本
 int line_enum3Dp(float xyz[6], float **retXyz, float pow); //三维+密度调整参数pow: 0或者1时使用默认倍数
 
+/*
+ *  遍历直线所有的点(不分配内存的版本)
+ *  参数:
+ *      buff: 结果写入 buff->data, 容量不够时自动扩容
+ *      callback, argv: 每个点交给回调处理,不保存结果
+ *
+ *  返回: 坐标个数
+ */
+int line_enum_b(float xy[4], _3D_EnumBuffer *buff);
+int line_enum3Dp_b(float xyz[6], _3D_EnumBuffer *buff, float pow);
+int line_enum3Dp_cb(float xyz[6], float pow, EnumCallback callback, void *argv);
+
 #endif
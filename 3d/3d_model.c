@@ -9,9 +9,285 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <sys/mman.h>
 
 #include "3d_model.h"
 
+/*
+ *  扩展包围体使其包含新的坐标点
+ *  包围球用逐点扩张的方式维护(点在球外时,把球扩大到刚好包含原球和该点),
+ *  不需要回头遍历已有的点,结果不是最小包围球但保证包含所有点
+ *  参数:
+ *      xyz[3 * pointTotal]: 坐标点数组
+ */
+static void model_bound_add(_3D_Model *model, float *xyz, uint32_t pointTotal)
+{
+    _3D_ModelBound *bound = &model->bound;
+    float d[3], dist, radius;
+    uint32_t c, i;
+    for (c = 0; c < pointTotal; c++, xyz += 3)
+    {
+        //第一个点
+        if (!bound->valid)
+        {
+            memcpy(bound->aabb, xyz, sizeof(float) * 3);
+            memcpy(&bound->aabb[3], xyz, sizeof(float) * 3);
+            memcpy(bound->center, xyz, sizeof(float) * 3);
+            bound->radius = 0;
+            bound->valid = true;
+            continue;
+        }
+        //包围盒
+        for (i = 0; i < 3; i++)
+        {
+            if (xyz[i] < bound->aabb[i])
+                bound->aabb[i] = xyz[i];
+            if (xyz[i] > bound->aabb[i + 3])
+                bound->aabb[i + 3] = xyz[i];
+        }
+        //包围球
+        d[0] = xyz[0] - bound->center[0];
+        d[1] = xyz[1] - bound->center[1];
+        d[2] = xyz[2] - bound->center[2];
+        dist = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if (dist > bound->radius)
+        {
+            radius = (bound->radius + dist) / 2;
+            //球心朝该点方向移动
+            for (i = 0; i < 3; i++)
+                bound->center[i] += d[i] * (radius - bound->radius) / dist;
+            bound->radius = radius;
+        }
+    }
+}
+
+//数组重新分配为 max 个元素(每个元素 size 字节)
+static void *model_grow(void *array, uint32_t max, uint32_t size)
+{
+    return realloc(array, (size_t)max * size);
+}
+
+//加倍扩容后的容量,保证不小于 need
+static uint32_t model_grow_max(uint32_t max, uint32_t need)
+{
+    if (max < 16)
+        max = 16;
+    while (max < need)
+        max *= 2;
+    return max;
+}
+
+// 各类修改用到的数组
+#define MODEL_WRITE_XYZ (1 << MODEL_ARRAY_XYZ)
+#define MODEL_WRITE_LINE (MODEL_WRITE_XYZ | (1 << MODEL_ARRAY_LINE_INDEX) | (1 << MODEL_ARRAY_LINE_COLOR))
+#define MODEL_WRITE_PLANE (MODEL_WRITE_XYZ | (1 << MODEL_ARRAY_PLANE_INDEX) | (1 << MODEL_ARRAY_PLANE_COLOR) | (1 << MODEL_ARRAY_PLANE_NORMAL))
+#define MODEL_WRITE_LABEL (MODEL_WRITE_XYZ | (1 << MODEL_ARRAY_LABEL_INDEX) | (1 << MODEL_ARRAY_LABEL_COLOR) | (1 << MODEL_ARRAY_LABEL_TEXT))
+#define MODEL_WRITE_INDEX (MODEL_WRITE_XYZ | (1 << MODEL_ARRAY_LINE_INDEX) | (1 << MODEL_ARRAY_PLANE_INDEX) | (1 << MODEL_ARRAY_LABEL_INDEX))
+#define MODEL_WRITE_COLOR ((1 << MODEL_ARRAY_LINE_COLOR) | (1 << MODEL_ARRAY_PLANE_COLOR))
+
+/*
+ *  按编号取模型的数组
+ *  参数:
+ *      size: 返回每个元素的字节数
+ *      total: 返回元素个数
+ *
+ *  返回: 数组指针的地址
+ */
+static void **model_array(_3D_Model *model, uint32_t id, uint32_t *size, uint32_t *total)
+{
+    switch (id)
+    {
+    case MODEL_ARRAY_XYZ:
+        *size = sizeof(float) * 3, *total = model->xyzTotal;
+        return (void **)&model->xyz;
+    case MODEL_ARRAY_LINE_INDEX:
+        *size = sizeof(uint32_t) * 2, *total = model->lineTotal;
+        return (void **)&model->lineIndex;
+    case MODEL_ARRAY_LINE_COLOR:
+        *size = sizeof(uint32_t), *total = model->lineTotal;
+        return (void **)&model->lineColor;
+    case MODEL_ARRAY_PLANE_INDEX:
+        *size = sizeof(uint32_t) * 3, *total = model->planeTotal;
+        return (void **)&model->planeIndex;
+    case MODEL_ARRAY_PLANE_COLOR:
+        *size = sizeof(uint32_t), *total = model->planeTotal;
+        return (void **)&model->planeColor;
+    case MODEL_ARRAY_PLANE_NORMAL:
+        *size = sizeof(float) * 4, *total = model->planeTotal;
+        return (void **)&model->planeNormal;
+    case MODEL_ARRAY_LABEL_INDEX:
+        *size = sizeof(uint32_t), *total = model->labelTotal;
+        return (void **)&model->labelIndex;
+    case MODEL_ARRAY_LABEL_COLOR:
+        *size = sizeof(uint32_t), *total = model->labelTotal;
+        return (void **)&model->labelColor;
+    case MODEL_ARRAY_LABEL_TEXT:
+        *size = sizeof(char *), *total = model->labelTotal;
+        return (void **)&model->labelText;
+    case MODEL_ARRAY_XYZ_Q:
+        *size = sizeof(uint16_t) * 3, *total = model->xyzTotal;
+        return (void **)&model->xyzQ;
+    case MODEL_ARRAY_LINE_INDEX_Q:
+        *size = sizeof(uint16_t) * 2, *total = model->lineTotal;
+        return (void **)&model->lineIndexQ;
+    case MODEL_ARRAY_LINE_COLOR_Q:
+        *size = sizeof(uint8_t), *total = model->lineTotal;
+        return (void **)&model->lineColorQ;
+    case MODEL_ARRAY_PLANE_INDEX_Q:
+        *size = sizeof(uint16_t) * 3, *total = model->planeTotal;
+        return (void **)&model->planeIndexQ;
+    case MODEL_ARRAY_PLANE_COLOR_Q:
+        *size = sizeof(uint8_t), *total = model->planeTotal;
+        return (void **)&model->planeColorQ;
+    case MODEL_ARRAY_LABEL_COLOR_Q:
+        *size = sizeof(uint8_t), *total = model->labelTotal;
+        return (void **)&model->labelColorQ;
+    default:
+        *size = sizeof(uint32_t), *total = model->paletteTotal;
+        return (void **)&model->palette;
+    }
+}
+
+//注释内容逐条释放
+static void model_text_free(char **text, uint32_t total)
+{
+    uint32_t i;
+    for (i = 0; i < total; i++)
+    {
+        if (text[i])
+            free(text[i]);
+    }
+}
+
+//共享的引用减1,归0时销毁
+static void model_share_release(_3D_ModelShare *share)
+{
+    if (__atomic_sub_fetch(&share->ref, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    //在映射里的数组只有注释内容指针数组是另外分配的,内容本身在映射里
+    if (share->parent)
+    {
+        if (share->text)
+            free(share->data);
+        model_share_release(share->parent);
+    }
+    else if (share->data)
+    {
+        if (share->text)
+            model_text_free((char **)share->data, share->total);
+        free(share->data);
+    }
+    if (share->map)
+        munmap(share->map, share->mapSize);
+    free(share);
+}
+
+/*
+ *  写时拷贝: 修改前把 mask 中还在共享的数组换成本模型私有的
+ *  只剩自己引用(且不在映射里)时直接接管,否则按实际个数拷贝一份
+ */
+static void model_write(_3D_Model *model, uint32_t mask)
+{
+    _3D_ModelShare *share;
+    void **array, *data;
+    char *text;
+    uint32_t id, size, total, i;
+    //量化编码的模型先还原
+    if (model->xyzQ && mask)
+        model_dequantize(model);
+    for (id = 0; id < MODEL_ARRAY_TOTAL; id++)
+    {
+        share = model->share[id];
+        if (!(mask & (1 << id)) || !share)
+            continue;
+        array = model_array(model, id, &size, &total);
+        if (!share->parent && __atomic_load_n(&share->ref, __ATOMIC_ACQUIRE) == 1)
+        {
+            share->data = NULL;
+            free(share);
+        }
+        else
+        {
+            data = malloc((size_t)(total > 0 ? total : 1) * size);
+            memcpy(data, *array, (size_t)total * size);
+            for (i = 0; share->text && i < total; i++)
+            {
+                text = ((char **)*array)[i];
+                if (text)
+                {
+                    ((char **)data)[i] = (char *)calloc(strlen(text) + 1, sizeof(char));
+                    strcpy(((char **)data)[i], text);
+                }
+            }
+            *array = data;
+            model_share_release(share);
+        }
+        model->share[id] = NULL;
+    }
+}
+
+/*
+ *  追加顶点(不添加图元),之后可用 model_xxx_add_index 按序号引用
+ *  参数:
+ *      model: 不能为NULL
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *
+ *  返回: 第一个顶点的序号
+ */
+uint32_t model_xyz_add(_3D_Model *model, float *xyz, uint32_t pointTotal)
+{
+    uint32_t index;
+    model_write(model, MODEL_WRITE_XYZ);
+    index = model->xyzTotal;
+    if (model->xyzTotal + pointTotal > model->xyzMax)
+    {
+        model->xyzMax = model_grow_max(model->xyzMax, model->xyzTotal + pointTotal);
+        model->xyz = (float *)model_grow(model->xyz, model->xyzMax, sizeof(float) * 3);
+    }
+    memcpy(&model->xyz[index * 3], xyz, sizeof(float) * 3 * pointTotal);
+    model->xyzTotal += pointTotal;
+    //包围体
+    model_bound_add(model, xyz, pointTotal);
+    return index;
+}
+
+/*
+ *  计算三角平面正面的法向量和平面方程
+ *  参数:
+ *      p[9]: 3个顶点
+ *      normal[4]: 返回单位法向量 nx,ny,nz 和平面常数 d
+ *      cw: false/顶点从正面看为逆时针 true/顺时针
+ */
+static void model_plane_normal(float p[9], float normal[4], bool cw)
+{
+    float u[3], v[3], n[3];
+    float norm;
+    //两条边叉乘
+    u[0] = p[3] - p[0];
+    u[1] = p[4] - p[1];
+    u[2] = p[5] - p[2];
+    v[0] = p[6] - p[0];
+    v[1] = p[7] - p[1];
+    v[2] = p[8] - p[2];
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+    norm = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    //退化三角形(三点共线)没有正反面
+    if (!(norm > 0))
+    {
+        memset(normal, 0, sizeof(float) * 4);
+        return;
+    }
+    if (cw)
+        norm = -norm;
+    normal[0] = n[0] / norm;
+    normal[1] = n[1] / norm;
+    normal[2] = n[2] / norm;
+    normal[3] = normal[0] * p[0] + normal[1] * p[1] + normal[2] * p[2];
+}
+
 /*
  *  模型初始化,添加线条
  *  参数:
@@ -24,40 +300,32 @@
  */
 _3D_Model *model_line_add(_3D_Model *model, uint32_t argbColor, float *xyz, uint32_t count)
 {
-    _3D_Line *line;
-    uint32_t i = 0;
+    uint32_t i, index;
 
     if (!model)
         model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    else
+        model_write(model, MODEL_WRITE_LINE);
 
     if (count < 1)
         return model;
-    
-    //取链表节点
-    if (!model->line)
-        model->line = line = (_3D_Line *)calloc(1, sizeof(_3D_Line));
-    else
+
+    //扩容
+    if (model->lineTotal + count > model->lineMax)
     {
-        line = model->line;
-        while(line->next)
-            line = line->next;
-        line->next = (_3D_Line *)calloc(1, sizeof(_3D_Line));
-        line = line->next;
+        model->lineMax = model_grow_max(model->lineMax, model->lineTotal + count);
+        model->lineIndex = (uint32_t *)model_grow(model->lineIndex, model->lineMax, sizeof(uint32_t) * 2);
+        model->lineColor = (uint32_t *)model_grow(model->lineColor, model->lineMax, sizeof(uint32_t));
     }
 
-    //逐个添加线条
-    while(line)
+    //顶点一次性追加,再逐个添加线条
+    index = model_xyz_add(model, xyz, count * 2);
+    for (i = 0; i < count; i++, index += 2)
     {
-        //参数拷贝
-        memcpy(line->xyz, xyz, sizeof(float) * 6);
-        line->argbColor = argbColor;
-        //下一个
-        if (++i < count)
-        {
-            xyz += 6;
-            line->next = (_3D_Line *)calloc(1, sizeof(_3D_Line));
-        }
-        line = line->next;
+        model->lineIndex[model->lineTotal * 2] = index;
+        model->lineIndex[model->lineTotal * 2 + 1] = index + 1;
+        model->lineColor[model->lineTotal] = argbColor;
+        model->lineTotal += 1;
     }
 
     return model;
@@ -90,45 +358,41 @@ _3D_Model *model_line_add3(_3D_Model *model, uint32_t argbColor,
  *      argbColor: 平面颜色
  *      xyz[9 * count]: 三个点的坐标数组
  *      count: 三角平面个数,决定 xyz 数组的字节长度: count * 9 * sizeof(float)
+ *      cw: 顶点顺序约定, false/从正面看为逆时针(右手定则,add2/add3 使用此约定) true/从正面看为顺时针
  * 
  *  返回: 更新后的模型指针
  */
-_3D_Model *model_plane_add(_3D_Model *model, uint32_t argbColor, float *xyz, uint32_t count)
+_3D_Model *model_plane_add(_3D_Model *model, uint32_t argbColor, float *xyz, uint32_t count, bool cw)
 {
-    _3D_Plane *plane;
-    uint32_t i = 0;
+    uint32_t i, index;
 
     if (!model)
         model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    else
+        model_write(model, MODEL_WRITE_PLANE);
 
     if (count < 1)
         return model;
-    
-    //取链表节点
-    if (!model->plane)
-        model->plane = plane = (_3D_Plane *)calloc(1, sizeof(_3D_Plane));
-    else
+
+    //扩容
+    if (model->planeTotal + count > model->planeMax)
     {
-        plane = model->plane;
-        while(plane->next)
-            plane = plane->next;
-        plane->next = (_3D_Plane *)calloc(1, sizeof(_3D_Plane));
-        plane = plane->next;
+        model->planeMax = model_grow_max(model->planeMax, model->planeTotal + count);
+        model->planeIndex = (uint32_t *)model_grow(model->planeIndex, model->planeMax, sizeof(uint32_t) * 3);
+        model->planeColor = (uint32_t *)model_grow(model->planeColor, model->planeMax, sizeof(uint32_t));
+        model->planeNormal = (float *)model_grow(model->planeNormal, model->planeMax, sizeof(float) * 4);
     }
 
-    //逐个添加平面
-    while(plane)
+    //顶点一次性追加,再逐个添加平面
+    index = model_xyz_add(model, xyz, count * 3);
+    for (i = 0; i < count; i++, index += 3, xyz += 9)
     {
-        //参数拷贝
-        memcpy(plane->xyz, xyz, sizeof(float) * 9);
-        plane->argbColor = argbColor;
-        //下一个
-        if (++i < count)
-        {
-            xyz += 9;
-            plane->next = (_3D_Plane *)calloc(1, sizeof(_3D_Plane));
-        }
-        plane = plane->next;
+        model->planeIndex[model->planeTotal * 3] = index;
+        model->planeIndex[model->planeTotal * 3 + 1] = index + 1;
+        model->planeIndex[model->planeTotal * 3 + 2] = index + 2;
+        model->planeColor[model->planeTotal] = argbColor;
+        model_plane_normal(xyz, &model->planeNormal[model->planeTotal * 4], cw);
+        model->planeTotal += 1;
     }
 
     return model;
@@ -141,7 +405,7 @@ _3D_Model *model_plane_add2(_3D_Model *model, uint32_t argbColor, float xyz1[3],
         xyz2[0], xyz2[1], xyz2[2],
         xyz3[0], xyz3[1], xyz3[2],
     };
-    return model_plane_add(model, argbColor, _xyz, 1);
+    return model_plane_add(model, argbColor, _xyz, 1, false);
 }
 
 _3D_Model *model_plane_add3(_3D_Model *model, uint32_t argbColor,
@@ -154,7 +418,98 @@ _3D_Model *model_plane_add3(_3D_Model *model, uint32_t argbColor,
         x2, y2, z2,
         x3, y3, z3,
     };
-    return model_plane_add(model, argbColor, _xyz, 1);
+    return model_plane_add(model, argbColor, _xyz, 1, false);
+}
+
+/*
+ *  按顶点序号添加线条,顶点需先用 model_xyz_add 添加
+ *  参数:
+ *      model: 传入为NULL时自动创建内存
+ *      argbColor: 线颜色
+ *      index[2 * count]: 顶点序号,超出顶点数的线条被跳过
+ *      count: 线条数
+ *
+ *  返回: 更新后的模型指针
+ */
+_3D_Model *model_line_add_index(_3D_Model *model, uint32_t argbColor, uint32_t *index, uint32_t count)
+{
+    uint32_t i;
+
+    if (!model)
+        model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    else
+        model_write(model, MODEL_WRITE_LINE);
+
+    if (count < 1)
+        return model;
+
+    //扩容
+    if (model->lineTotal + count > model->lineMax)
+    {
+        model->lineMax = model_grow_max(model->lineMax, model->lineTotal + count);
+        model->lineIndex = (uint32_t *)model_grow(model->lineIndex, model->lineMax, sizeof(uint32_t) * 2);
+        model->lineColor = (uint32_t *)model_grow(model->lineColor, model->lineMax, sizeof(uint32_t));
+    }
+
+    for (i = 0; i < count; i++, index += 2)
+    {
+        if (index[0] >= model->xyzTotal || index[1] >= model->xyzTotal)
+            continue;
+        model->lineIndex[model->lineTotal * 2] = index[0];
+        model->lineIndex[model->lineTotal * 2 + 1] = index[1];
+        model->lineColor[model->lineTotal] = argbColor;
+        model->lineTotal += 1;
+    }
+
+    return model;
+}
+
+/*
+ *  按顶点序号添加三角平面,顶点需先用 model_xyz_add 添加
+ *  参数:
+ *      model: 传入为NULL时自动创建内存
+ *      argbColor: 平面颜色
+ *      index[3 * count]: 顶点序号,超出顶点数的三角平面被跳过
+ *      count: 三角平面个数
+ *      cw: 顶点顺序约定,同 model_plane_add
+ *
+ *  返回: 更新后的模型指针
+ */
+_3D_Model *model_plane_add_index(_3D_Model *model, uint32_t argbColor, uint32_t *index, uint32_t count, bool cw)
+{
+    float p[9];
+    uint32_t i, j;
+
+    if (!model)
+        model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    else
+        model_write(model, MODEL_WRITE_PLANE);
+
+    if (count < 1)
+        return model;
+
+    //扩容
+    if (model->planeTotal + count > model->planeMax)
+    {
+        model->planeMax = model_grow_max(model->planeMax, model->planeTotal + count);
+        model->planeIndex = (uint32_t *)model_grow(model->planeIndex, model->planeMax, sizeof(uint32_t) * 3);
+        model->planeColor = (uint32_t *)model_grow(model->planeColor, model->planeMax, sizeof(uint32_t));
+        model->planeNormal = (float *)model_grow(model->planeNormal, model->planeMax, sizeof(float) * 4);
+    }
+
+    for (i = 0; i < count; i++, index += 3)
+    {
+        if (index[0] >= model->xyzTotal || index[1] >= model->xyzTotal || index[2] >= model->xyzTotal)
+            continue;
+        for (j = 0; j < 3; j++)
+            memcpy(&p[j * 3], &model->xyz[index[j] * 3], sizeof(float) * 3);
+        memcpy(&model->planeIndex[model->planeTotal * 3], index, sizeof(uint32_t) * 3);
+        model->planeColor[model->planeTotal] = argbColor;
+        model_plane_normal(p, &model->planeNormal[model->planeTotal * 4], cw);
+        model->planeTotal += 1;
+    }
+
+    return model;
 }
 
 /*
@@ -169,33 +524,30 @@ _3D_Model *model_plane_add3(_3D_Model *model, uint32_t argbColor,
  */
 _3D_Model *model_label_add(_3D_Model *model, uint32_t argbColor, char *text, float xyz[3])
 {
-    _3D_Label *label;
-
     if (!model)
         model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
-    
-    //取链表节点
-    if (!model->label)
-        model->label = label = (_3D_Label *)calloc(1, sizeof(_3D_Label));
     else
+        model_write(model, MODEL_WRITE_LABEL);
+
+    //扩容
+    if (model->labelTotal + 1 > model->labelMax)
     {
-        label = model->label;
-        while(label->next)
-            label = label->next;
-        label->next = (_3D_Label *)calloc(1, sizeof(_3D_Label));
-        label = label->next;
+        model->labelMax = model_grow_max(model->labelMax, model->labelTotal + 1);
+        model->labelIndex = (uint32_t *)model_grow(model->labelIndex, model->labelMax, sizeof(uint32_t));
+        model->labelColor = (uint32_t *)model_grow(model->labelColor, model->labelMax, sizeof(uint32_t));
+        model->labelText = (char **)model_grow(model->labelText, model->labelMax, sizeof(char *));
     }
 
     //参数拷贝
-    label->xyz[0] = xyz[0];
-    label->xyz[1] = xyz[1];
-    label->xyz[2] = xyz[2];
-    label->argbColor = argbColor;
+    model->labelIndex[model->labelTotal] = model_xyz_add(model, xyz, 1);
+    model->labelColor[model->labelTotal] = argbColor;
+    model->labelText[model->labelTotal] = NULL;
     if (text)
     {
-        label->text = (char *)calloc(strlen(text) + 1, 1);
-        strcpy(label->text, text);
+        model->labelText[model->labelTotal] = (char *)calloc(strlen(text) + 1, 1);
+        strcpy(model->labelText[model->labelTotal], text);
     }
+    model->labelTotal += 1;
 
     return model;
 }
@@ -206,120 +558,430 @@ _3D_Model *model_label_add2(_3D_Model *model, uint32_t argbColor, char *text, fl
     return model_label_add(model, argbColor, text, _xyz);
 }
 
-// 模型拷贝
-_3D_Model *model_copy(_3D_Model *model)
+//顶点坐标的哈希值(按位比较,-0 和 0 视为相同)
+static uint32_t model_weld_hash(float xyz[3], uint32_t key[3])
 {
-    _3D_Line *line, *line2;
-    _3D_Plane *plane, *plane2;
-    _3D_Label *label, *label2;
-    _3D_Model *model2 = (_3D_Model *)calloc(1, sizeof(_3D_Model));
-    //line链表拷贝
-    if (model->line)
+    float v;
+    uint32_t i, hash = 2166136261u;
+    for (i = 0; i < 3; i++)
     {
-        line = model->line;
-        line2 = model2->line = (_3D_Line *)calloc(1, sizeof(_3D_Line));
-        do
-        {
-            memcpy(line2->xyz, line->xyz, sizeof(float) * 6);
-            line2->argbColor = line->argbColor;
-            //下一个
-            line = line->next;
-            if (line)
-            {
-                line2->next = (_3D_Line *)calloc(1, sizeof(_3D_Line));
-                line2 = line2->next;
-            }
-        } while (line);
+        v = xyz[i] + 0.0f;
+        memcpy(&key[i], &v, sizeof(uint32_t));
+        hash = (hash ^ key[i]) * 16777619u;
+        hash ^= hash >> 15;
     }
-    //plane链表拷贝
-    if (model->plane)
+    return hash;
+}
+
+/*
+ *  顶点焊接: 合并坐标完全相同的顶点,各图元的顶点序号改为指向合并后的顶点
+ *  模型构建完成后调用一次,之后每个单元每次抓拍每个顶点只需变换、投影一次
+ *
+ *  返回: 合并后的顶点数
+ */
+uint32_t model_weld(_3D_Model *model)
+{
+    uint32_t *table; //哈希表,存合并后的顶点序号+1, 0为空
+    uint32_t *remap; //旧序号到新序号
+    uint32_t tableMask, total = 0;
+    uint32_t key[3], key2[3];
+    uint32_t i, pos;
+
+    if (!model || model->xyzTotal < 2)
+        return model ? model->xyzTotal : 0;
+    model_write(model, MODEL_WRITE_INDEX);
+
+    //哈希表大小取不小于2倍顶点数的2的幂
+    for (tableMask = 1; tableMask < model->xyzTotal * 2; tableMask <<= 1)
+        ;
+    table = (uint32_t *)calloc(tableMask, sizeof(uint32_t));
+    tableMask -= 1;
+    remap = (uint32_t *)calloc(model->xyzTotal, sizeof(uint32_t));
+
+    //逐个顶点查表,新顶点前移到数组前部(新序号不会超过旧序号,可以原地操作)
+    for (i = 0; i < model->xyzTotal; i++)
     {
-        plane = model->plane;
-        plane2 = model2->plane = (_3D_Plane *)calloc(1, sizeof(_3D_Plane));
-        do
+        pos = model_weld_hash(&model->xyz[i * 3], key) & tableMask;
+        while (table[pos])
         {
-            memcpy(plane2->xyz, plane->xyz, sizeof(float) * 9);
-            plane2->argbColor = plane->argbColor;
-            //下一个
-            plane = plane->next;
-            if (plane)
-            {
-                plane2->next = (_3D_Plane *)calloc(1, sizeof(_3D_Plane));
-                plane2 = plane2->next;
-            }
-        } while (plane);
+            model_weld_hash(&model->xyz[(table[pos] - 1) * 3], key2);
+            if (!memcmp(key, key2, sizeof(key)))
+                break;
+            pos = (pos + 1) & tableMask;
+        }
+        if (table[pos])
+            remap[i] = table[pos] - 1;
+        else
+        {
+            memmove(&model->xyz[total * 3], &model->xyz[i * 3], sizeof(float) * 3);
+            remap[i] = total;
+            table[pos] = ++total;
+        }
+    }
+
+    //更新各图元的顶点序号
+    for (i = 0; i < model->lineTotal * 2; i++)
+        model->lineIndex[i] = remap[model->lineIndex[i]];
+    for (i = 0; i < model->planeTotal * 3; i++)
+        model->planeIndex[i] = remap[model->planeIndex[i]];
+    for (i = 0; i < model->labelTotal; i++)
+        model->labelIndex[i] = remap[model->labelIndex[i]];
+    model->xyzTotal = total;
+
+    free(table);
+    free(remap);
+    return total;
+}
+
+// 设置三角平面剔除模式 MODEL_CULL_XXX
+void model_cull(_3D_Model *model, uint8_t mode)
+{
+    if (model)
+        model->cull = mode;
+}
+
+//按 order 重排数组: 新的第i个元素为原来的第 order[i] 个, size 为每个元素的字节数
+static void model_permute(void *array, uint32_t *order, uint32_t total, uint32_t size)
+{
+    uint8_t *tmp;
+    uint32_t i;
+    if (!array || total < 1)
+        return;
+    tmp = (uint8_t *)malloc((size_t)total * size);
+    for (i = 0; i < total; i++)
+        memcpy(&tmp[(size_t)i * size], (uint8_t *)array + (size_t)order[i] * size, size);
+    memcpy(array, tmp, (size_t)total * size);
+    free(tmp);
+}
+
+/*
+ *  重排三角平面和顶点(见 model_optimize),图元的形状、颜色不变
+ *  参数:
+ *      planeOrder[planeTotal]: 新的第i个三角平面为原来的第 planeOrder[i] 个, NULL/不重排
+ *      xyzOrder[xyzTotal]: 新的第i个顶点为原来的第 xyzOrder[i] 个, NULL/不重排
+ */
+void model_reorder(_3D_Model *model, uint32_t *planeOrder, uint32_t *xyzOrder)
+{
+    uint32_t *remap; //旧序号到新序号
+    uint32_t i;
+    if (!model)
+        return;
+    model_write(model, MODEL_WRITE_INDEX | MODEL_WRITE_PLANE);
+
+    if (planeOrder)
+    {
+        model_permute(model->planeIndex, planeOrder, model->planeTotal, sizeof(uint32_t) * 3);
+        model_permute(model->planeColor, planeOrder, model->planeTotal, sizeof(uint32_t));
+        model_permute(model->planeNormal, planeOrder, model->planeTotal, sizeof(float) * 4);
     }
-    //label链表拷贝
-    if (model->label)
+
+    if (xyzOrder && model->xyzTotal > 0)
+    {
+        model_permute(model->xyz, xyzOrder, model->xyzTotal, sizeof(float) * 3);
+        remap = (uint32_t *)calloc(model->xyzTotal, sizeof(uint32_t));
+        for (i = 0; i < model->xyzTotal; i++)
+            remap[xyzOrder[i]] = i;
+        for (i = 0; i < model->lineTotal * 2; i++)
+            model->lineIndex[i] = remap[model->lineIndex[i]];
+        for (i = 0; i < model->planeTotal * 3; i++)
+            model->planeIndex[i] = remap[model->planeIndex[i]];
+        for (i = 0; i < model->labelTotal; i++)
+            model->labelIndex[i] = remap[model->labelIndex[i]];
+        free(remap);
+    }
+}
+
+//释放一个数组(共享的减少引用计数)
+static void model_array_free(_3D_Model *model, uint32_t id)
+{
+    void **array;
+    uint32_t size, total;
+    array = model_array(model, id, &size, &total);
+    if (model->share[id])
+        model_share_release(model->share[id]);
+    else if (*array)
     {
-        label = model->label;
-        label2 = model2->label = (_3D_Label *)calloc(1, sizeof(_3D_Label));
-        do
+        if (id == MODEL_ARRAY_LABEL_TEXT)
+            model_text_free((char **)*array, total);
+        free(*array);
+    }
+    *array = NULL;
+    model->share[id] = NULL;
+}
+
+//颜色数组编入调色板,颜色超过 MODEL_PALETTE_MAX 种时返回false
+static bool model_palette_encode(uint32_t *palette, uint32_t *paletteTotal, uint32_t *color, uint32_t total, uint8_t **ret)
+{
+    uint32_t i, c, last = 0;
+    if (total < 1)
+        return true;
+    *ret = (uint8_t *)malloc(total);
+    for (i = 0; i < total; i++)
+    {
+        //相邻图元多数同色
+        if (last < *paletteTotal && palette[last] == color[i])
+            c = last;
+        else
         {
-            memcpy(label2->xyz, label->xyz, sizeof(float) * 3);
-            label2->argbColor = label->argbColor;
-            if (label->text)
+            for (c = 0; c < *paletteTotal && palette[c] != color[i]; c++)
+                ;
+            if (c == *paletteTotal)
             {
-                label2->text = (char *)calloc(strlen(label->text), sizeof(char));
-                strcpy(label2->text, label->text);
+                if (*paletteTotal >= MODEL_PALETTE_MAX)
+                    return false;
+                palette[(*paletteTotal)++] = color[i];
             }
-            //下一个
-            label = label->next;
-            if (label)
-            {
-                label2->next = (_3D_Label *)calloc(1, sizeof(_3D_Label));
-                label2 = label2->next;
-            }
-        } while (label);
+            last = c;
+        }
+        (*ret)[i] = (uint8_t)c;
     }
-    return model2;
+    return true;
 }
 
-// 内存销毁
-void model_release(_3D_Model **model)
+/*
+ *  量化编码: 顶点坐标按包围盒量化为16位整数,颜色存为调色板序号,三角平面不再存法向量,
+ *  顶点数不多时序号也存为16位,内存约为原来的 1/3~1/4,细节层次一并编码
+ *  抓拍时反量化合并进变换矩阵,正反面在相机坐标系中由顶点算出;
+ *  量化后的模型修改(添加图元、焊接、改颜色)前自动还原为浮点编码
+ *
+ *  返回: false/颜色超过 MODEL_PALETTE_MAX 种或模型为空,模型不变
+ */
+bool model_quantize(_3D_Model *model)
 {
-    _3D_Line *line, *lineNext;
-    _3D_Plane *plane, *planeNext;
-    _3D_Label *label, *labelNext;
-    if (model && (*model))
+    uint32_t palette[MODEL_PALETTE_MAX];
+    uint32_t paletteTotal = 0;
+    uint8_t *color[3] = {NULL, NULL, NULL};
+    uint16_t *indexQ = NULL;
+    uint32_t *index, tri[3], i, j;
+    float *p0, *p1, *p2, *normal, u[3], v[3], n[3], q;
+    bool small;
+
+    if (!model || !model->bound.valid || model->xyzTotal < 1)
+        return false;
+    for (i = 0; i < model->lodTotal; i++)
+        model_quantize(model->lod[i]);
+    if (model->xyzQ)
+        return true;
+
+    //调色板
+    if (!model_palette_encode(palette, &paletteTotal, model->lineColor, model->lineTotal, &color[0]) ||
+        !model_palette_encode(palette, &paletteTotal, model->planeColor, model->planeTotal, &color[1]) ||
+        !model_palette_encode(palette, &paletteTotal, model->labelColor, model->labelTotal, &color[2]))
     {
-        //释放链表
-        if ((*model)->line)
+        for (i = 0; i < 3; i++)
         {
-            lineNext = (*model)->line;
-            do
-            {
-                line = lineNext;
-                lineNext = lineNext->next;
-                free(line);
-            } while (lineNext);
+            if (color[i])
+                free(color[i]);
         }
-        //释放链表
-        if ((*model)->plane)
+        return false;
+    }
+
+    //三角平面统一为从正面看逆时针,之后正反面由顶点顺序决定
+    small = model->xyzTotal <= MODEL_INDEX_Q_MAX;
+    if (small && model->planeTotal > 0)
+        indexQ = (uint16_t *)malloc((size_t)model->planeTotal * sizeof(uint16_t) * 3);
+    else
+        model_write(model, 1 << MODEL_ARRAY_PLANE_INDEX);
+    for (i = 0; i < model->planeTotal; i++)
+    {
+        index = &model->planeIndex[i * 3];
+        normal = &model->planeNormal[i * 4];
+        p0 = &model->xyz[index[0] * 3];
+        p1 = &model->xyz[index[1] * 3];
+        p2 = &model->xyz[index[2] * 3];
+        for (j = 0; j < 3; j++)
         {
-            planeNext = (*model)->plane;
-            do
-            {
-                plane = planeNext;
-                planeNext = planeNext->next;
-                free(plane);
-            } while (planeNext);
+            u[j] = p1[j] - p0[j];
+            v[j] = p2[j] - p0[j];
         }
-        //释放链表
-        if ((*model)->label)
+        n[0] = u[1] * v[2] - u[2] * v[1];
+        n[1] = u[2] * v[0] - u[0] * v[2];
+        n[2] = u[0] * v[1] - u[1] * v[0];
+        tri[0] = index[0];
+        tri[1] = index[1];
+        tri[2] = index[2];
+        if (n[0] * normal[0] + n[1] * normal[1] + n[2] * normal[2] < 0)
         {
-            labelNext = (*model)->label;
-            do
-            {
-                label = labelNext;
-                labelNext = labelNext->next;
-                if (label->text)
-                    free(label->text);
-                free(label);
-            } while (labelNext);
+            tri[1] = index[2];
+            tri[2] = index[1];
+        }
+        for (j = 0; j < 3; j++)
+        {
+            if (indexQ)
+                indexQ[i * 3 + j] = (uint16_t)tri[j];
+            else
+                index[j] = tri[j];
+        }
+    }
+    if (indexQ)
+    {
+        model->planeIndexQ = indexQ;
+        model_array_free(model, MODEL_ARRAY_PLANE_INDEX);
+    }
+    if (small && model->lineTotal > 0)
+    {
+        model->lineIndexQ = (uint16_t *)malloc((size_t)model->lineTotal * sizeof(uint16_t) * 2);
+        for (i = 0; i < model->lineTotal * 2; i++)
+            model->lineIndexQ[i] = (uint16_t)model->lineIndex[i];
+        model_array_free(model, MODEL_ARRAY_LINE_INDEX);
+    }
+
+    //顶点: 坐标 = quantOffset + xyzQ * quantScale, 包围盒的两端正好是 0 和 65535
+    for (j = 0; j < 3; j++)
+    {
+        model->quantOffset[j] = model->bound.aabb[j];
+        model->quantScale[j] = (model->bound.aabb[j + 3] - model->bound.aabb[j]) / 65535;
+    }
+    model->xyzQ = (uint16_t *)malloc((size_t)model->xyzTotal * sizeof(uint16_t) * 3);
+    for (i = 0; i < model->xyzTotal * 3; i++)
+    {
+        j = i % 3;
+        q = model->quantScale[j] > 0 ? (model->xyz[i] - model->quantOffset[j]) / model->quantScale[j] : 0;
+        model->xyzQ[i] = (uint16_t)(q < 0 ? 0 : (q > 65535 ? 65535 : q + 0.5f));
+    }
+
+    //浮点编码的数组不再需要
+    model_array_free(model, MODEL_ARRAY_XYZ);
+    model_array_free(model, MODEL_ARRAY_LINE_COLOR);
+    model_array_free(model, MODEL_ARRAY_PLANE_COLOR);
+    model_array_free(model, MODEL_ARRAY_PLANE_NORMAL);
+    model_array_free(model, MODEL_ARRAY_LABEL_COLOR);
+    model->lineColorQ = color[0];
+    model->planeColorQ = color[1];
+    model->labelColorQ = color[2];
+    model->palette = (uint32_t *)malloc(sizeof(uint32_t) * paletteTotal);
+    memcpy(model->palette, palette, sizeof(uint32_t) * paletteTotal);
+    model->paletteTotal = paletteTotal;
+    model->xyzMax = model->xyzTotal;
+    model->lineMax = model->lineTotal;
+    model->planeMax = model->planeTotal;
+    model->labelMax = model->labelTotal;
+    return true;
+}
+
+//调色板序号还原为颜色数组
+static uint32_t *model_palette_decode(_3D_Model *model, uint8_t *colorQ, uint32_t total)
+{
+    uint32_t *ret, i;
+    if (total < 1)
+        return NULL;
+    ret = (uint32_t *)malloc((size_t)total * sizeof(uint32_t));
+    for (i = 0; i < total; i++)
+        ret[i] = model->palette[colorQ[i]];
+    return ret;
+}
+
+// 还原为浮点编码(坐标保留量化误差,法向量按顶点重新计算)
+void model_dequantize(_3D_Model *model)
+{
+    float p[9];
+    uint32_t i, j;
+    if (!model || !model->xyzQ)
+        return;
+    //顶点
+    model->xyz = (float *)malloc((size_t)model->xyzTotal * sizeof(float) * 3);
+    for (i = 0; i < model->xyzTotal * 3; i++)
+        model->xyz[i] = model->quantOffset[i % 3] + model->xyzQ[i] * model->quantScale[i % 3];
+    //序号
+    if (model->lineIndexQ)
+    {
+        model->lineIndex = (uint32_t *)malloc((size_t)model->lineTotal * sizeof(uint32_t) * 2);
+        for (i = 0; i < model->lineTotal * 2; i++)
+            model->lineIndex[i] = model->lineIndexQ[i];
+    }
+    if (model->planeIndexQ)
+    {
+        model->planeIndex = (uint32_t *)malloc((size_t)model->planeTotal * sizeof(uint32_t) * 3);
+        for (i = 0; i < model->planeTotal * 3; i++)
+            model->planeIndex[i] = model->planeIndexQ[i];
+    }
+    //颜色
+    model->lineColor = model_palette_decode(model, model->lineColorQ, model->lineTotal);
+    model->planeColor = model_palette_decode(model, model->planeColorQ, model->planeTotal);
+    model->labelColor = model_palette_decode(model, model->labelColorQ, model->labelTotal);
+    //法向量(量化时已统一为逆时针)
+    if (model->planeTotal > 0)
+    {
+        model->planeNormal = (float *)malloc((size_t)model->planeTotal * sizeof(float) * 4);
+        for (i = 0; i < model->planeTotal; i++)
+        {
+            for (j = 0; j < 3; j++)
+                memcpy(&p[j * 3], &model->xyz[model->planeIndex[i * 3 + j] * 3], sizeof(float) * 3);
+            model_plane_normal(p, &model->planeNormal[i * 4], false);
         }
-        //
+    }
+    for (i = MODEL_ARRAY_XYZ_Q; i <= MODEL_ARRAY_PALETTE; i++)
+        model_array_free(model, i);
+    model->paletteTotal = 0;
+    model->xyzMax = model->xyzTotal;
+    model->lineMax = model->lineTotal;
+    model->planeMax = model->planeTotal;
+    model->labelMax = model->labelTotal;
+}
+
+// 把所有线条和三角平面改为同一颜色(只拷贝颜色数组,顶点和序号仍与其它拷贝共享)
+void model_color(_3D_Model *model, uint32_t argbColor)
+{
+    uint32_t i;
+    if (!model)
+        return;
+    model_write(model, MODEL_WRITE_COLOR);
+    for (i = 0; i < model->lineTotal; i++)
+        model->lineColor[i] = argbColor;
+    for (i = 0; i < model->planeTotal; i++)
+        model->planeColor[i] = argbColor;
+}
+
+// 模型拷贝: 只增加各数组的引用计数,不拷贝数据,修改时才各自拷贝
+_3D_Model *model_copy(_3D_Model *model)
+{
+    _3D_Model *model2;
+    _3D_ModelShare *share;
+    void **array;
+    uint32_t id, size, total, i;
+    //私有的数组先转为共享,之后原模型修改它也要先拷贝
+    for (id = 0; id < MODEL_ARRAY_TOTAL; id++)
+    {
+        array = model_array(model, id, &size, &total);
+        if (!*array || model->share[id])
+            continue;
+        share = (_3D_ModelShare *)calloc(1, sizeof(_3D_ModelShare));
+        share->ref = 1;
+        share->data = *array;
+        share->total = total;
+        share->text = id == MODEL_ARRAY_LABEL_TEXT;
+        model->share[id] = share;
+    }
+    //共享的数组不能在原地扩容
+    model->xyzMax = model->xyzTotal;
+    model->lineMax = model->lineTotal;
+    model->planeMax = model->planeTotal;
+    model->labelMax = model->labelTotal;
+    //数组指针、个数、包围体、剔除模式原样复制
+    model2 = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    memcpy(model2, model, sizeof(_3D_Model));
+    for (id = 0; id < MODEL_ARRAY_TOTAL; id++)
+    {
+        if (model2->share[id])
+            __atomic_add_fetch(&model2->share[id]->ref, 1, __ATOMIC_RELAXED);
+    }
+    //细节层次
+    for (i = 0; i < model->lodTotal; i++)
+        model2->lod[i] = model_copy(model->lod[i]);
+    return model2;
+}
+
+// 内存销毁: 共享的数组只减少引用计数,最后一个引用销毁时才释放
+void model_release(_3D_Model **model)
+{
+    uint32_t id, i;
+    if (model && (*model))
+    {
+        for (i = 0; i < (*model)->lodTotal; i++)
+            model_release(&(*model)->lod[i]);
+        for (id = 0; id < MODEL_ARRAY_TOTAL; id++)
+            model_array_free(*model, id);
         free((*model));
         (*model) = NULL;
     }
-}
\ No newline at end of file
+}
@@ -10,38 +10,115 @@
 #define _3D_MODEL_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
-// 线条
-typedef struct _3DLine
+// 包围体(模型坐标系),由 model_xxx_add 添加图元时自动扩展
+typedef struct _3DModelBound
 {
-    float xyz[6]; //2个三维坐标
-    uint32_t argbColor; //线颜色
-    struct _3DLine *next;
-} _3D_Line;
+    bool valid;       //false/模型还没有任何坐标点
+    float aabb[6];    //轴对齐包围盒 xMin,yMin,zMin,xMax,yMax,zMax
+    float center[3];  //包围球球心
+    float radius;     //包围球半径
+} _3D_ModelBound;
 
-// 三维空间的三角平面(任意多边形可以通过"三角剖分"拆分为有限个三角形的组合)
-typedef struct _3DPlane
-{
-    float xyz[9]; //3个三维坐标
-    uint32_t argbColor; //面颜色
-    struct _3DPlane *next;
-} _3D_Plane;
+// 三角平面剔除模式
+#define MODEL_CULL_NONE 0  //不剔除(默认)
+#define MODEL_CULL_BACK 1  //剔除背面(封闭的实体模型使用,少画一半的面)
+#define MODEL_CULL_FRONT 2 //剔除正面
+
+// 细节层次(LOD)级数上限,不含原模型
+#define MODEL_LOD_MAX 4
+
+// 模型各数组的编号,共享和写时拷贝以数组为单位
+#define MODEL_ARRAY_XYZ 0
+#define MODEL_ARRAY_LINE_INDEX 1
+#define MODEL_ARRAY_LINE_COLOR 2
+#define MODEL_ARRAY_PLANE_INDEX 3
+#define MODEL_ARRAY_PLANE_COLOR 4
+#define MODEL_ARRAY_PLANE_NORMAL 5
+#define MODEL_ARRAY_LABEL_INDEX 6
+#define MODEL_ARRAY_LABEL_COLOR 7
+#define MODEL_ARRAY_LABEL_TEXT 8
+#define MODEL_ARRAY_XYZ_Q 9
+#define MODEL_ARRAY_LINE_INDEX_Q 10
+#define MODEL_ARRAY_LINE_COLOR_Q 11
+#define MODEL_ARRAY_PLANE_INDEX_Q 12
+#define MODEL_ARRAY_PLANE_COLOR_Q 13
+#define MODEL_ARRAY_LABEL_COLOR_Q 14
+#define MODEL_ARRAY_PALETTE 15
+#define MODEL_ARRAY_TOTAL 16
 
-// 点注释
-typedef struct _3DLabel
+// 量化编码的调色板容量(颜色序号为8位)
+#define MODEL_PALETTE_MAX 256
+// 顶点数不超过该值时,量化编码的线条、三角平面顶点序号存为16位
+#define MODEL_INDEX_Q_MAX 65536
+
+/*
+ *  共享数组: model_copy 得到的模型与原模型共用同一份只读数组,引用计数归0时销毁
+ *  某个模型要修改时先拷贝一份自己的(只剩自己引用时直接接管,不拷贝)
+ */
+typedef struct _3DModelShare
 {
-    float xyz[3]; //位置
-    char *text; //注释内容
-    uint32_t argbColor; //文字颜色
-    struct _3DLabel *next;
-} _3D_Label;
+    uint32_t ref;   //引用计数
+    void *data;     //数组
+    uint32_t total; //元素个数
+    bool text;      //data 为注释内容指针数组
+    struct _3DModelShare *parent; //数组在文件映射里时,指向持有映射的共享(其 data 为NULL)
+    void *map;      //model_load 的文件映射
+    size_t mapSize;
+} _3D_ModelShare;
 
-// 主结构体
+/*
+ *  主结构体
+ *  所有图元共用一个顶点数组,各类图元只记录顶点序号,数组容量不够时加倍扩容
+ *  线条(line): 2个顶点
+ *  三角平面(plane): 3个顶点(任意多边形可以通过"三角剖分"拆分为有限个三角形的组合)
+ *  注释(label): 1个顶点
+ */
 typedef struct _3DModel
 {
-    _3D_Line *line; //线条链表
-    _3D_Plane *plane; //三角平面链表
-    _3D_Label *label; //注释链表
+    float *xyz;                 //顶点数组 xyz[3 * xyzTotal]
+    uint32_t xyzTotal, xyzMax;
+
+    uint32_t *lineIndex;        //线条顶点序号 lineIndex[2 * lineTotal]
+    uint32_t *lineColor;        //线颜色
+    uint32_t lineTotal, lineMax;
+
+    uint32_t *planeIndex;       //三角平面顶点序号 planeIndex[3 * planeTotal]
+    uint32_t *planeColor;       //面颜色
+    float *planeNormal;         //正面的单位法向量及平面常数 nx,ny,nz,d (normal·p = d, 退化三角形为0),添加时按顶点顺序算好
+    uint32_t planeTotal, planeMax;
+
+    uint32_t *labelIndex;       //注释位置的顶点序号
+    uint32_t *labelColor;       //文字颜色
+    char **labelText;           //注释内容(可能为NULL)
+    uint32_t labelTotal, labelMax;
+
+    _3D_ModelBound bound; //包围体
+    uint8_t cull; //三角平面剔除模式 MODEL_CULL_XXX
+
+    //量化编码(见 model_quantize): 以下数组取代 xyz、各颜色数组和 planeNormal(这些为NULL),
+    //顶点数不超过 MODEL_INDEX_Q_MAX 时 lineIndexQ/planeIndexQ 取代 lineIndex/planeIndex
+    uint16_t *xyzQ;         //顶点 xyzQ[3 * xyzTotal], 坐标 = quantOffset + xyzQ * quantScale
+    float quantOffset[3];
+    float quantScale[3];
+    uint16_t *lineIndexQ;   //16位顶点序号
+    uint16_t *planeIndexQ;  //16位顶点序号,从正面看为逆时针,正反面由顶点算出
+    uint8_t *lineColorQ;    //颜色在调色板中的序号
+    uint8_t *planeColorQ;
+    uint8_t *labelColorQ;
+    uint32_t *palette;      //调色板
+    uint32_t paletteTotal;
+
+    //细节层次: lod[i] 为逐级简化的模型,包围球投影半径小于 lodPixel[i] 像素时使用(由 model_lod_build 生成,随模型一起销毁,修改模型后不会自动更新)
+    struct _3DModel *lod[MODEL_LOD_MAX];
+    float lodPixel[MODEL_LOD_MAX];
+    uint32_t lodTotal;
+
+    //各数组的共享, NULL/该数组为本模型私有. 共享的数组只读,添加图元、焊接、改颜色前先拷贝用到的数组,
+    //此时对应的 xxxMax 等于 xxxTotal. model_load 映射的模型各数组共享同一个文件映射
+    _3D_ModelShare *share[MODEL_ARRAY_TOTAL];
 } _3D_Model;
 
 /*
@@ -67,16 +144,41 @@ _3D_Model *model_line_add3(_3D_Model *model, uint32_t argbColor,
  *      argbColor: 平面颜色
  *      xyz[3 * count]: 三个点的坐标数组
  *      count: 三角平面个数,决定xyz字节长度: count * 3 * sizeof(float)
+ *      cw: 顶点顺序约定, false/从正面看为逆时针(右手定则,add2/add3 使用此约定) true/从正面看为顺时针
  * 
  *  返回: 更新后的模型指针
  */
-_3D_Model *model_plane_add(_3D_Model *model, uint32_t argbColor, float *xyz, uint32_t count);
+_3D_Model *model_plane_add(_3D_Model *model, uint32_t argbColor, float *xyz, uint32_t count, bool cw);
 _3D_Model *model_plane_add2(_3D_Model *model, uint32_t argbColor, float xyz1[3], float xyz2[3], float xyz3[3]);
 _3D_Model *model_plane_add3(_3D_Model *model, uint32_t argbColor,
     float x1, float y1, float z1,
     float x2, float y2, float z2,
     float x3, float y3, float z3);
 
+/*
+ *  追加顶点(不添加图元),之后可用 model_xxx_add_index 按序号引用
+ *  参数:
+ *      model: 不能为NULL
+ *      xyz[3 * pointTotal]: 坐标点数组
+ *
+ *  返回: 第一个顶点的序号
+ */
+uint32_t model_xyz_add(_3D_Model *model, float *xyz, uint32_t pointTotal);
+
+/*
+ *  按顶点序号添加线条、三角平面(导入共享顶点的模型时使用)
+ *  参数:
+ *      model: 传入为NULL时自动创建内存
+ *      argbColor: 颜色
+ *      index[2 * count]/index[3 * count]: 顶点序号,超出顶点数的图元被跳过
+ *      count: 图元个数
+ *      cw: 顶点顺序约定,同 model_plane_add
+ *
+ *  返回: 更新后的模型指针
+ */
+_3D_Model *model_line_add_index(_3D_Model *model, uint32_t argbColor, uint32_t *index, uint32_t count);
+_3D_Model *model_plane_add_index(_3D_Model *model, uint32_t argbColor, uint32_t *index, uint32_t count, bool cw);
+
 /*
  *  模型初始化,添加注释
  *  参数:
@@ -90,10 +192,45 @@ _3D_Model *model_plane_add3(_3D_Model *model, uint32_t argbColor,
 _3D_Model *model_label_add(_3D_Model *model, uint32_t argbColor, char *text, float xyz[3]);
 _3D_Model *model_label_add2(_3D_Model *model, uint32_t argbColor, char *text, float x, float y, float z);
 
-// 模型拷贝
+/*
+ *  顶点焊接: 合并坐标完全相同的顶点,各图元的顶点序号改为指向合并后的顶点
+ *  模型构建完成后调用一次,之后每个单元每次抓拍每个顶点只需变换、投影一次
+ *
+ *  返回: 合并后的顶点数
+ */
+uint32_t model_weld(_3D_Model *model);
+
+/*
+ *  重排三角平面和顶点(见 model_optimize),图元的形状、颜色不变
+ *  参数:
+ *      planeOrder[planeTotal]: 新的第i个三角平面为原来的第 planeOrder[i] 个, NULL/不重排
+ *      xyzOrder[xyzTotal]: 新的第i个顶点为原来的第 xyzOrder[i] 个, NULL/不重排
+ */
+void model_reorder(_3D_Model *model, uint32_t *planeOrder, uint32_t *xyzOrder);
+
+// 设置三角平面剔除模式 MODEL_CULL_XXX
+void model_cull(_3D_Model *model, uint8_t mode);
+
+/*
+ *  量化编码: 顶点坐标按包围盒量化为16位整数,颜色存为调色板序号,三角平面不再存法向量,
+ *  顶点数不多时序号也存为16位,内存约为原来的 1/3~1/4,细节层次一并编码
+ *  抓拍时反量化合并进变换矩阵,正反面在相机坐标系中由顶点算出;
+ *  量化后的模型修改(添加图元、焊接、改颜色)前自动还原为浮点编码
+ *
+ *  返回: false/颜色超过 MODEL_PALETTE_MAX 种或模型为空,模型不变
+ */
+bool model_quantize(_3D_Model *model);
+
+// 还原为浮点编码(坐标保留量化误差,法向量按顶点重新计算)
+void model_dequantize(_3D_Model *model);
+
+// 把所有线条和三角平面改为同一颜色(只拷贝颜色数组,顶点和序号仍与其它拷贝共享)
+void model_color(_3D_Model *model, uint32_t argbColor);
+
+// 模型拷贝: 只增加各数组的引用计数,不拷贝数据,修改时才各自拷贝
 _3D_Model *model_copy(_3D_Model *model);
 
-// 内存销毁
+// 内存销毁: 共享的数组只减少引用计数,最后一个引用销毁时才释放
 void model_release(_3D_Model **model);
 
 #endif
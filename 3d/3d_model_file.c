@@ -0,0 +1,326 @@
+/*
+ *  模型的二进制文件格式: 文件头 + 各数组原样存放的数据段,加载时 mmap 映射后直接使用,不拷贝、不逐图元分配内存
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "3d_model_file.h"
+
+//各数据段的字节数
+static uint64_t model_file_section_size(_3D_ModelFileHead *head, uint32_t section)
+{
+    switch (section)
+    {
+    case MODEL_FILE_XYZ:
+        return (uint64_t)head->xyzTotal * 3 * sizeof(float);
+    case MODEL_FILE_LINE_INDEX:
+        return (uint64_t)head->lineTotal * 2 * sizeof(uint32_t);
+    case MODEL_FILE_LINE_COLOR:
+        return (uint64_t)head->lineTotal * sizeof(uint32_t);
+    case MODEL_FILE_PLANE_INDEX:
+        return (uint64_t)head->planeTotal * 3 * sizeof(uint32_t);
+    case MODEL_FILE_PLANE_COLOR:
+        return (uint64_t)head->planeTotal * sizeof(uint32_t);
+    case MODEL_FILE_PLANE_NORMAL:
+        return (uint64_t)head->planeTotal * 4 * sizeof(float);
+    case MODEL_FILE_LABEL_INDEX:
+    case MODEL_FILE_LABEL_COLOR:
+    case MODEL_FILE_LABEL_TEXT:
+        return (uint64_t)head->labelTotal * sizeof(uint32_t);
+    case MODEL_FILE_TEXT:
+        return head->textSize;
+    }
+    return 0;
+}
+
+//写入数据并补齐到对齐位置
+static bool model_file_write(FILE *fp, void *data, uint64_t size)
+{
+    static const uint8_t zero[MODEL_FILE_ALIGN] = {0};
+    uint64_t pad = (MODEL_FILE_ALIGN - size % MODEL_FILE_ALIGN) % MODEL_FILE_ALIGN;
+    if (size > 0 && fwrite(data, 1, size, fp) != size)
+        return false;
+    return pad == 0 || fwrite(zero, 1, pad, fp) == pad;
+}
+
+/*
+ *  把模型写入文件(细节层次不保存,加载后需要时重新 model_lod_build)
+ *  参数:
+ *      filePath: 文件路径,已存在时覆盖
+ *
+ *  返回: false/失败
+ */
+bool model_save(_3D_Model *model, char *filePath)
+{
+    _3D_ModelFileHead head;
+    uint32_t *textOffset = NULL;
+    char *text = NULL;
+    void *data[MODEL_FILE_SECTIONS];
+    uint64_t offset;
+    uint32_t i, len;
+    FILE *fp;
+    bool ret = true;
+
+    if (!model || !filePath)
+        return false;
+    //量化编码的模型按浮点编码保存
+    if (model->xyzQ)
+    {
+        model = model_copy(model);
+        model_dequantize(model);
+        ret = model_save(model, filePath);
+        model_release(&model);
+        return ret;
+    }
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, MODEL_FILE_MAGIC, sizeof(head.magic));
+    head.version = MODEL_FILE_VERSION;
+    head.endian = MODEL_FILE_ENDIAN;
+    head.headSize = sizeof(head);
+    head.xyzTotal = model->xyzTotal;
+    head.lineTotal = model->lineTotal;
+    head.planeTotal = model->planeTotal;
+    head.labelTotal = model->labelTotal;
+    head.cull = model->cull;
+    head.boundValid = model->bound.valid ? 1 : 0;
+    memcpy(head.aabb, model->bound.aabb, sizeof(head.aabb));
+    memcpy(head.center, model->bound.center, sizeof(head.center));
+    head.radius = model->bound.radius;
+
+    //注释内容拼接为一个文本段
+    if (model->labelTotal > 0)
+    {
+        textOffset = (uint32_t *)calloc(model->labelTotal, sizeof(uint32_t));
+        for (i = 0; i < model->labelTotal; i++)
+        {
+            if (model->labelText[i])
+                head.textSize += strlen(model->labelText[i]) + 1;
+        }
+        text = (char *)calloc(head.textSize + 1, sizeof(char));
+        for (i = 0, len = 0; i < model->labelTotal; i++)
+        {
+            if (!model->labelText[i])
+            {
+                textOffset[i] = MODEL_FILE_TEXT_NULL;
+                continue;
+            }
+            textOffset[i] = len;
+            strcpy(&text[len], model->labelText[i]);
+            len += strlen(model->labelText[i]) + 1;
+        }
+    }
+
+    data[MODEL_FILE_XYZ] = model->xyz;
+    data[MODEL_FILE_LINE_INDEX] = model->lineIndex;
+    data[MODEL_FILE_LINE_COLOR] = model->lineColor;
+    data[MODEL_FILE_PLANE_INDEX] = model->planeIndex;
+    data[MODEL_FILE_PLANE_COLOR] = model->planeColor;
+    data[MODEL_FILE_PLANE_NORMAL] = model->planeNormal;
+    data[MODEL_FILE_LABEL_INDEX] = model->labelIndex;
+    data[MODEL_FILE_LABEL_COLOR] = model->labelColor;
+    data[MODEL_FILE_LABEL_TEXT] = textOffset;
+    data[MODEL_FILE_TEXT] = text;
+
+    //各段依次紧跟文件头,起始位置对齐
+    offset = (sizeof(head) + MODEL_FILE_ALIGN - 1) / MODEL_FILE_ALIGN * MODEL_FILE_ALIGN;
+    for (i = 0; i < MODEL_FILE_SECTIONS; i++)
+    {
+        head.offset[i] = offset;
+        offset += (model_file_section_size(&head, i) + MODEL_FILE_ALIGN - 1) / MODEL_FILE_ALIGN * MODEL_FILE_ALIGN;
+    }
+
+    fp = fopen(filePath, "wb");
+    if (!fp)
+        ret = false;
+    else
+    {
+        ret = model_file_write(fp, &head, sizeof(head));
+        for (i = 0; ret && i < MODEL_FILE_SECTIONS; i++)
+            ret = model_file_write(fp, data[i], model_file_section_size(&head, i));
+        if (fclose(fp) != 0)
+            ret = false;
+    }
+
+    if (textOffset)
+        free(textOffset);
+    if (text)
+        free(text);
+    return ret;
+}
+
+//检查顶点序号都在顶点数组范围内
+static bool model_file_check_index(uint32_t *index, uint32_t total, uint32_t xyzTotal)
+{
+    uint32_t i;
+    for (i = 0; i < total; i++)
+    {
+        if (index[i] >= xyzTotal)
+            return false;
+    }
+    return true;
+}
+
+//检查文件头和各段范围
+static bool model_file_check(_3D_ModelFileHead *head, uint8_t *map, uint64_t mapSize)
+{
+    uint64_t size;
+    uint32_t *textOffset;
+    uint32_t i;
+    if (memcmp(head->magic, MODEL_FILE_MAGIC, sizeof(head->magic)) ||
+        head->version != MODEL_FILE_VERSION ||
+        head->endian != MODEL_FILE_ENDIAN ||
+        head->headSize != sizeof(_3D_ModelFileHead))
+        return false;
+    for (i = 0; i < MODEL_FILE_SECTIONS; i++)
+    {
+        size = model_file_section_size(head, i);
+        if (head->offset[i] % sizeof(uint32_t) ||
+            head->offset[i] > mapSize ||
+            size > mapSize - head->offset[i])
+            return false;
+    }
+    //顶点序号
+    if (!model_file_check_index((uint32_t *)(map + head->offset[MODEL_FILE_LINE_INDEX]), head->lineTotal * 2, head->xyzTotal) ||
+        !model_file_check_index((uint32_t *)(map + head->offset[MODEL_FILE_PLANE_INDEX]), head->planeTotal * 3, head->xyzTotal) ||
+        !model_file_check_index((uint32_t *)(map + head->offset[MODEL_FILE_LABEL_INDEX]), head->labelTotal, head->xyzTotal))
+        return false;
+    //注释内容: 偏移在文本段内且文本段以'\0'结尾
+    if (head->textSize > 0 && map[head->offset[MODEL_FILE_TEXT] + head->textSize - 1] != '\0')
+        return false;
+    textOffset = (uint32_t *)(map + head->offset[MODEL_FILE_LABEL_TEXT]);
+    for (i = 0; i < head->labelTotal; i++)
+    {
+        if (textOffset[i] != MODEL_FILE_TEXT_NULL && textOffset[i] >= head->textSize)
+            return false;
+    }
+    return true;
+}
+
+//段数据指针,空段返回NULL
+static void *model_file_section(_3D_ModelFileHead *head, uint8_t *map, uint32_t section)
+{
+    if (model_file_section_size(head, section) < 1)
+        return NULL;
+    return map + head->offset[section];
+}
+
+//数组指向映射,共享 root 持有的映射
+static void model_file_share(_3D_Model *model, _3D_ModelShare *root, uint32_t id, void *data, uint32_t total)
+{
+    _3D_ModelShare *share;
+    if (!data)
+        return;
+    share = (_3D_ModelShare *)calloc(1, sizeof(_3D_ModelShare));
+    share->ref = 1;
+    share->data = data;
+    share->total = total;
+    share->text = id == MODEL_ARRAY_LABEL_TEXT;
+    share->parent = root;
+    root->ref += 1;
+    model->share[id] = share;
+}
+
+/*
+ *  映射模型文件
+ *  加载时只检查文件头、各段范围和顶点序号,不拷贝数据,返回模型的各数组直接指向只读的文件映射,
+ *  可以照常交给引擎抓拍;修改时只把用到的数组拷贝到堆内存(见 _3D_ModelShare),全部数组不再引用映射时解除映射
+ *  参数:
+ *      filePath: 文件路径
+ *
+ *  返回: 模型指针,用 model_release 销毁, NULL/打开失败或文件格式不对
+ */
+_3D_Model *model_load(char *filePath)
+{
+    _3D_ModelFileHead *head;
+    _3D_Model *model;
+    _3D_ModelShare *root;
+    struct stat st;
+    uint32_t *textOffset;
+    uint8_t *map;
+    uint32_t i;
+    int fd;
+
+    if (!filePath)
+        return NULL;
+    fd = open(filePath, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(_3D_ModelFileHead))
+    {
+        close(fd);
+        return NULL;
+    }
+    map = (uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //映射建立后文件描述符就不再需要了
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    head = (_3D_ModelFileHead *)map;
+    if (!model_file_check(head, map, st.st_size))
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    model = (_3D_Model *)calloc(1, sizeof(_3D_Model));
+    //包围体和剔除模式
+    model->bound.valid = head->boundValid ? true : false;
+    memcpy(model->bound.aabb, head->aabb, sizeof(model->bound.aabb));
+    memcpy(model->bound.center, head->center, sizeof(model->bound.center));
+    model->bound.radius = head->radius;
+    model->cull = (uint8_t)head->cull;
+    //各数组直接指向映射
+    model->xyz = (float *)model_file_section(head, map, MODEL_FILE_XYZ);
+    model->xyzTotal = model->xyzMax = head->xyzTotal;
+    model->lineIndex = (uint32_t *)model_file_section(head, map, MODEL_FILE_LINE_INDEX);
+    model->lineColor = (uint32_t *)model_file_section(head, map, MODEL_FILE_LINE_COLOR);
+    model->lineTotal = model->lineMax = head->lineTotal;
+    model->planeIndex = (uint32_t *)model_file_section(head, map, MODEL_FILE_PLANE_INDEX);
+    model->planeColor = (uint32_t *)model_file_section(head, map, MODEL_FILE_PLANE_COLOR);
+    model->planeNormal = (float *)model_file_section(head, map, MODEL_FILE_PLANE_NORMAL);
+    model->planeTotal = model->planeMax = head->planeTotal;
+    model->labelIndex = (uint32_t *)model_file_section(head, map, MODEL_FILE_LABEL_INDEX);
+    model->labelColor = (uint32_t *)model_file_section(head, map, MODEL_FILE_LABEL_COLOR);
+    model->labelTotal = model->labelMax = head->labelTotal;
+    //注释内容指针数组是唯一需要分配的内存,文本本身仍在映射里
+    if (head->labelTotal > 0)
+    {
+        textOffset = (uint32_t *)(map + head->offset[MODEL_FILE_LABEL_TEXT]);
+        model->labelText = (char **)calloc(head->labelTotal, sizeof(char *));
+        for (i = 0; i < head->labelTotal; i++)
+        {
+            if (textOffset[i] != MODEL_FILE_TEXT_NULL)
+                model->labelText[i] = (char *)(map + head->offset[MODEL_FILE_TEXT] + textOffset[i]);
+        }
+    }
+    //各数组共享同一个映射,最后一个引用释放时解除映射
+    root = (_3D_ModelShare *)calloc(1, sizeof(_3D_ModelShare));
+    root->map = map;
+    root->mapSize = st.st_size;
+    model_file_share(model, root, MODEL_ARRAY_XYZ, model->xyz, head->xyzTotal);
+    model_file_share(model, root, MODEL_ARRAY_LINE_INDEX, model->lineIndex, head->lineTotal);
+    model_file_share(model, root, MODEL_ARRAY_LINE_COLOR, model->lineColor, head->lineTotal);
+    model_file_share(model, root, MODEL_ARRAY_PLANE_INDEX, model->planeIndex, head->planeTotal);
+    model_file_share(model, root, MODEL_ARRAY_PLANE_COLOR, model->planeColor, head->planeTotal);
+    model_file_share(model, root, MODEL_ARRAY_PLANE_NORMAL, model->planeNormal, head->planeTotal);
+    model_file_share(model, root, MODEL_ARRAY_LABEL_INDEX, model->labelIndex, head->labelTotal);
+    model_file_share(model, root, MODEL_ARRAY_LABEL_COLOR, model->labelColor, head->labelTotal);
+    model_file_share(model, root, MODEL_ARRAY_LABEL_TEXT, model->labelText, head->labelTotal);
+    //没有任何数组时映射直接释放
+    if (root->ref < 1)
+    {
+        munmap(map, st.st_size);
+        free(root);
+    }
+    return model;
+}
@@ -0,0 +1,76 @@
+/*
+ *  模型的二进制文件格式: 文件头 + 各数组原样存放的数据段,加载时 mmap 映射后直接使用,不拷贝、不逐图元分配内存
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_MODEL_FILE_H_
+#define _3D_MODEL_FILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "3d_model.h"
+
+#define MODEL_FILE_MAGIC "3DMF"
+#define MODEL_FILE_VERSION 1
+#define MODEL_FILE_ENDIAN 0x01020304 //字节序标记,与本机读出的值不同时拒绝加载
+#define MODEL_FILE_ALIGN 16          //各数据段起始偏移的对齐字节数
+
+// 数据段序号,各段内容与 _3D_Model 中同名数组的内存布局一致
+#define MODEL_FILE_XYZ 0          //float[3 * xyzTotal]
+#define MODEL_FILE_LINE_INDEX 1   //uint32_t[2 * lineTotal]
+#define MODEL_FILE_LINE_COLOR 2   //uint32_t[lineTotal]
+#define MODEL_FILE_PLANE_INDEX 3  //uint32_t[3 * planeTotal]
+#define MODEL_FILE_PLANE_COLOR 4  //uint32_t[planeTotal]
+#define MODEL_FILE_PLANE_NORMAL 5 //float[4 * planeTotal]
+#define MODEL_FILE_LABEL_INDEX 6  //uint32_t[labelTotal]
+#define MODEL_FILE_LABEL_COLOR 7  //uint32_t[labelTotal]
+#define MODEL_FILE_LABEL_TEXT 8   //uint32_t[labelTotal] 注释内容在文本段中的偏移, MODEL_FILE_TEXT_NULL 表示没有内容
+#define MODEL_FILE_TEXT 9         //char[textSize] 以'\0'结尾的注释内容依次存放
+#define MODEL_FILE_SECTIONS 10
+
+#define MODEL_FILE_TEXT_NULL 0xFFFFFFFF
+
+// 文件头,位于文件起始处
+typedef struct _3DModelFileHead
+{
+    char magic[4];     //MODEL_FILE_MAGIC
+    uint32_t version;  //MODEL_FILE_VERSION
+    uint32_t endian;   //MODEL_FILE_ENDIAN
+    uint32_t headSize; //sizeof(_3D_ModelFileHead)
+
+    uint32_t xyzTotal, lineTotal, planeTotal, labelTotal;
+    uint32_t textSize;
+
+    uint32_t cull;       //三角平面剔除模式 MODEL_CULL_XXX
+    uint32_t boundValid; //包围体,同 _3D_ModelBound
+    float aabb[6];
+    float center[3];
+    float radius;
+    uint32_t reserved;
+
+    uint64_t offset[MODEL_FILE_SECTIONS]; //各数据段在文件中的偏移(字节)
+} _3D_ModelFileHead;
+
+/*
+ *  把模型写入文件(细节层次不保存,加载后需要时重新 model_lod_build; 量化编码的模型按浮点编码保存)
+ *  参数:
+ *      filePath: 文件路径,已存在时覆盖
+ *
+ *  返回: false/失败
+ */
+bool model_save(_3D_Model *model, char *filePath);
+
+/*
+ *  映射模型文件
+ *  加载时只检查文件头、各段范围和顶点序号,不拷贝数据,返回模型的各数组直接指向只读的文件映射,
+ *  可以照常交给引擎抓拍;修改时只把用到的数组拷贝到堆内存(见 _3D_ModelShare),全部数组不再引用映射时解除映射
+ *  参数:
+ *      filePath: 文件路径
+ *
+ *  返回: 模型指针,用 model_release 销毁, NULL/打开失败或文件格式不对
+ */
+_3D_Model *model_load(char *filePath);
+
+#endif
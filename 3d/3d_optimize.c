@@ -0,0 +1,380 @@
+/*
+ *  模型图元排序优化: 按 Tipsify 算法重排三角平面提高顶点缓存命中率,再按簇由外向内排序减少重复绘制,
+ *  最后按首次使用的顺序重排顶点,使抓拍时顶点数组的访问基本连续
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "3d_optimize.h"
+
+// 簇: 重排重复绘制的单位,簇内保持 Tipsify 的顺序
+typedef struct _3DOptimizeCluster
+{
+    uint32_t start, total; //在 order 数组中的范围
+    float key;             //排序键,大的先画
+} _3D_OptimizeCluster;
+
+typedef struct _3DOptimize
+{
+    uint32_t *index; //三角平面顶点序号 index[3 * triTotal]
+    uint32_t triTotal, vertexTotal;
+    uint32_t *adjStart; //顶点的邻接三角平面在 adj 数组中的范围 adjStart[i] ~ adjStart[i + 1]
+    uint32_t *adj;
+    uint32_t *live;  //顶点还没输出的邻接三角平面数
+    uint32_t *stamp; //顶点最后进入缓存的时刻
+    uint32_t *deadEnd; //输出过的顶点,扇形走不下去时从这里回溯
+    uint32_t deadEndTotal;
+    bool *emitted;
+    uint32_t *order; //输出的三角平面顺序
+    uint32_t orderTotal;
+    _3D_OptimizeCluster *cluster;
+    uint32_t clusterTotal;
+} _3D_Optimize;
+
+//三角平面的顶点序号(量化编码的16位序号展开到 tmp[])
+static uint32_t *optimize_triangle(_3D_Model *model, uint32_t i, uint32_t tmp[3])
+{
+    uint32_t c;
+    if (!model->planeIndexQ)
+        return &model->planeIndex[i * 3];
+    for (c = 0; c < 3; c++)
+        tmp[c] = model->planeIndexQ[i * 3 + c];
+    return tmp;
+}
+
+/*
+ *  按先进先出的顶点缓存模拟三角平面的绘制,统计未命中数
+ *  参数:
+ *      cacheSize: 缓存大小,传0时用 OPTIMIZE_CACHE_SIZE
+ *      atvr: 不为NULL时返回未命中数与被引用顶点数之比
+ *
+ *  返回: 平均每个三角平面的未命中数(ACMR), 0/模型没有三角平面
+ */
+float model_acmr(_3D_Model *model, uint32_t cacheSize, float *atvr)
+{
+    uint32_t *pushed; //顶点进入缓存时已进入的顶点数+1, 0/从未进入
+    uint32_t pushTotal = 0, vertexTotal = 0;
+    uint32_t i, c, v, tmp[3], *index;
+
+    if (atvr)
+        *atvr = 0;
+    if (!model || model->planeTotal < 1)
+        return 0;
+    if (cacheSize < 1)
+        cacheSize = OPTIMIZE_CACHE_SIZE;
+
+    //先进先出: 进入缓存后又有 cacheSize 个顶点进入时被挤出
+    pushed = (uint32_t *)calloc(model->xyzTotal, sizeof(uint32_t));
+    for (i = 0; i < model->planeTotal; i++)
+    {
+        index = optimize_triangle(model, i, tmp);
+        for (c = 0; c < 3; c++)
+        {
+            v = index[c];
+            if (pushed[v] && pushTotal - (pushed[v] - 1) <= cacheSize)
+                continue;
+            if (!pushed[v])
+                vertexTotal += 1;
+            pushed[v] = ++pushTotal;
+        }
+    }
+    free(pushed);
+
+    if (atvr && vertexTotal > 0)
+        *atvr = (float)pushTotal / vertexTotal;
+    return (float)pushTotal / model->planeTotal;
+}
+
+//建立顶点到三角平面的邻接表
+static _3D_Optimize *optimize_init(_3D_Model *model)
+{
+    _3D_Optimize *opt = (_3D_Optimize *)calloc(1, sizeof(_3D_Optimize));
+    uint32_t i, v;
+
+    opt->index = model->planeIndex;
+    opt->triTotal = model->planeTotal;
+    opt->vertexTotal = model->xyzTotal;
+    opt->adjStart = (uint32_t *)calloc(opt->vertexTotal + 1, sizeof(uint32_t));
+    opt->adj = (uint32_t *)calloc(opt->triTotal * 3, sizeof(uint32_t));
+    opt->live = (uint32_t *)calloc(opt->vertexTotal, sizeof(uint32_t));
+    opt->stamp = (uint32_t *)calloc(opt->vertexTotal, sizeof(uint32_t));
+    opt->deadEnd = (uint32_t *)calloc(opt->triTotal * 3, sizeof(uint32_t));
+    opt->emitted = (bool *)calloc(opt->triTotal, sizeof(bool));
+    opt->order = (uint32_t *)calloc(opt->triTotal, sizeof(uint32_t));
+    opt->cluster = (_3D_OptimizeCluster *)calloc(opt->triTotal, sizeof(_3D_OptimizeCluster));
+
+    //计数后前缀和,再按三角平面顺序填入(stamp 暂作填入位置)
+    for (i = 0; i < opt->triTotal * 3; i++)
+        opt->live[opt->index[i]] += 1;
+    for (v = 0; v < opt->vertexTotal; v++)
+        opt->adjStart[v + 1] = opt->adjStart[v] + opt->live[v];
+    for (i = 0; i < opt->triTotal * 3; i++)
+    {
+        v = opt->index[i];
+        opt->adj[opt->adjStart[v] + opt->stamp[v]++] = i / 3;
+    }
+    memset(opt->stamp, 0, sizeof(uint32_t) * opt->vertexTotal);
+    return opt;
+}
+
+static void optimize_release(_3D_Optimize *opt)
+{
+    free(opt->adjStart);
+    free(opt->adj);
+    free(opt->live);
+    free(opt->stamp);
+    free(opt->deadEnd);
+    free(opt->emitted);
+    free(opt->order);
+    free(opt->cluster);
+    free(opt);
+}
+
+/*
+ *  选下一个扇形中心: 优先本次扇形用到的顶点中,剩余三角平面画完时仍在缓存里、且在缓存里待得最久的
+ *  都不合适时从回溯栈找还有三角平面的顶点,再不行按序号往后找
+ *  参数:
+ *      candStart: 本次扇形用到的顶点在 deadEnd 中的起始位置
+ *      jump: 返回是否离开了本次扇形的邻域(簇的分界)
+ *
+ *  返回: 顶点序号, -1/所有三角平面都已输出
+ */
+static int64_t optimize_next(_3D_Optimize *opt, uint32_t candStart, uint32_t time, uint32_t cacheSize, uint32_t *cursor, bool *jump)
+{
+    int64_t best = -1, bestPriority = -1, priority;
+    uint32_t i, v;
+
+    *jump = false;
+    for (i = candStart; i < opt->deadEndTotal; i++)
+    {
+        v = opt->deadEnd[i];
+        if (opt->live[v] < 1)
+            continue;
+        priority = 0;
+        if (time - opt->stamp[v] + 2 * opt->live[v] <= cacheSize)
+            priority = time - opt->stamp[v];
+        if (priority > bestPriority)
+        {
+            bestPriority = priority;
+            best = v;
+        }
+    }
+    if (best >= 0)
+        return best;
+
+    *jump = true;
+    while (opt->deadEndTotal > 0)
+    {
+        v = opt->deadEnd[--opt->deadEndTotal];
+        if (opt->live[v] > 0)
+            return v;
+    }
+    for (; *cursor < opt->vertexTotal; *cursor += 1)
+    {
+        if (opt->live[*cursor] > 0)
+            return *cursor;
+    }
+    return -1;
+}
+
+//Tipsify: 以顶点为中心一次输出它所有剩余的三角平面,在离开邻域处切分簇
+static void optimize_tipsify(_3D_Optimize *opt, uint32_t cacheSize)
+{
+    uint32_t time = cacheSize + 1; //缓存时钟,初始时所有顶点都不在缓存里
+    uint32_t cursor = 0, candStart, i, c, t, v;
+    int64_t fan;
+    bool jump = true;
+
+    fan = optimize_next(opt, 0, time, cacheSize, &cursor, &jump);
+    while (fan >= 0)
+    {
+        //离开邻域,且当前簇已够大时开始新的簇
+        if (jump && (opt->clusterTotal < 1 ||
+            opt->cluster[opt->clusterTotal - 1].total >= OPTIMIZE_CLUSTER_MIN))
+        {
+            opt->cluster[opt->clusterTotal].start = opt->orderTotal;
+            opt->clusterTotal += 1;
+        }
+
+        candStart = opt->deadEndTotal;
+        for (i = opt->adjStart[fan]; i < opt->adjStart[fan + 1]; i++)
+        {
+            t = opt->adj[i];
+            if (opt->emitted[t])
+                continue;
+            opt->emitted[t] = true;
+            opt->order[opt->orderTotal++] = t;
+            opt->cluster[opt->clusterTotal - 1].total += 1;
+            for (c = 0; c < 3; c++)
+            {
+                v = opt->index[t * 3 + c];
+                opt->deadEnd[opt->deadEndTotal++] = v;
+                opt->live[v] -= 1;
+                if (time - opt->stamp[v] > cacheSize)
+                    opt->stamp[v] = time++;
+            }
+        }
+        fan = optimize_next(opt, candStart, time, cacheSize, &cursor, &jump);
+    }
+}
+
+/*
+ *  簇的排序键: 簇中心相对模型中心的偏移在簇平均法向上的投影
+ *  朝外且靠外的簇更可能挡住其它簇,先画它们,后画的被挡住的像素在深度测试时就被丢弃
+ *  法向用 planeNormal (顺时针添加的三角平面,其翻转只记录在法向量中),按面积加权
+ */
+static void optimize_cluster_key(_3D_Optimize *opt, float *xyz, float *normal)
+{
+    _3D_OptimizeCluster *cluster;
+    double center[3] = {0}, area = 0;
+    double *sum; //每个簇: 面积加权的中心 x,y,z, 面积, 法向量 x,y,z
+    double u[3], w[3], n[3], a, len;
+    float *p0, *p1, *p2;
+    uint32_t i, j, c, t;
+
+    sum = (double *)calloc(opt->clusterTotal * 7, sizeof(double));
+    for (i = 0; i < opt->clusterTotal; i++)
+    {
+        cluster = &opt->cluster[i];
+        for (j = cluster->start; j < cluster->start + cluster->total; j++)
+        {
+            t = opt->order[j];
+            p0 = &xyz[opt->index[t * 3] * 3];
+            p1 = &xyz[opt->index[t * 3 + 1] * 3];
+            p2 = &xyz[opt->index[t * 3 + 2] * 3];
+            for (c = 0; c < 3; c++)
+            {
+                u[c] = p1[c] - p0[c];
+                w[c] = p2[c] - p0[c];
+            }
+            n[0] = u[1] * w[2] - u[2] * w[1];
+            n[1] = u[2] * w[0] - u[0] * w[2];
+            n[2] = u[0] * w[1] - u[1] * w[0];
+            a = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (c = 0; c < 3; c++)
+            {
+                sum[i * 7 + c] += a * (p0[c] + p1[c] + p2[c]) / 3;
+                sum[i * 7 + 4 + c] += a * normal[t * 4 + c];
+            }
+            sum[i * 7 + 3] += a;
+        }
+        for (c = 0; c < 3; c++)
+            center[c] += sum[i * 7 + c];
+        area += sum[i * 7 + 3];
+    }
+    for (c = 0; c < 3; c++)
+        center[c] = area > 0 ? center[c] / area : 0;
+
+    for (i = 0; i < opt->clusterTotal; i++)
+    {
+        a = sum[i * 7 + 3];
+        len = sqrt(sum[i * 7 + 4] * sum[i * 7 + 4] + sum[i * 7 + 5] * sum[i * 7 + 5] + sum[i * 7 + 6] * sum[i * 7 + 6]);
+        opt->cluster[i].key = 0;
+        if (a <= 0 || len <= 0)
+            continue;
+        for (c = 0; c < 3; c++)
+            opt->cluster[i].key += (float)((sum[i * 7 + c] / a - center[c]) * sum[i * 7 + 4 + c] / len);
+    }
+    free(sum);
+}
+
+//排序键从大到小,相同时保持原顺序
+static int optimize_cluster_compare(const void *a, const void *b)
+{
+    const _3D_OptimizeCluster *ca = (const _3D_OptimizeCluster *)a;
+    const _3D_OptimizeCluster *cb = (const _3D_OptimizeCluster *)b;
+    if (ca->key != cb->key)
+        return ca->key > cb->key ? -1 : 1;
+    return ca->start < cb->start ? -1 : 1;
+}
+
+//优化一个模型(不含细节层次),返回簇数
+static uint32_t optimize_model(_3D_Model *model, uint32_t cacheSize)
+{
+    _3D_Optimize *opt;
+    uint32_t *planeOrder, *xyzOrder, *first;
+    uint32_t i, j, c, v, total = 0, clusterTotal;
+
+    if (model->xyzQ)
+        model_dequantize(model);
+    opt = optimize_init(model);
+    optimize_tipsify(opt, cacheSize);
+
+    //按簇重排
+    optimize_cluster_key(opt, model->xyz, model->planeNormal);
+    qsort(opt->cluster, opt->clusterTotal, sizeof(_3D_OptimizeCluster), &optimize_cluster_compare);
+    planeOrder = (uint32_t *)calloc(opt->triTotal, sizeof(uint32_t));
+    for (i = 0; i < opt->clusterTotal; i++)
+    {
+        for (j = 0; j < opt->cluster[i].total; j++)
+            planeOrder[total++] = opt->order[opt->cluster[i].start + j];
+    }
+
+    //顶点按首次使用的顺序,没被三角平面用到的(只属于线条、注释)按原顺序排在后面
+    xyzOrder = (uint32_t *)calloc(opt->vertexTotal, sizeof(uint32_t));
+    first = (uint32_t *)calloc(opt->vertexTotal, sizeof(uint32_t)); //新序号+1, 0/未用到
+    total = 0;
+    for (i = 0; i < opt->triTotal; i++)
+    {
+        for (c = 0; c < 3; c++)
+        {
+            v = opt->index[planeOrder[i] * 3 + c];
+            if (!first[v])
+            {
+                xyzOrder[total] = v;
+                first[v] = ++total;
+            }
+        }
+    }
+    for (v = 0; v < opt->vertexTotal; v++)
+    {
+        if (!first[v])
+            xyzOrder[total++] = v;
+    }
+
+    clusterTotal = opt->clusterTotal;
+    optimize_release(opt);
+    model_reorder(model, planeOrder, xyzOrder);
+    free(planeOrder);
+    free(xyzOrder);
+    free(first);
+    return clusterTotal;
+}
+
+/*
+ *  重排三角平面和顶点(细节层次一并优化),图元的形状、颜色不变,导入模型时自动调用
+ *  线条和注释只更新顶点序号,顺序不变; 量化编码的模型会先还原为浮点编码
+ *  参数:
+ *      cacheSize: 缓存大小,传0时用 OPTIMIZE_CACHE_SIZE
+ *      report: 不为NULL时返回原模型优化前后的统计
+ *
+ *  返回: false/模型没有三角平面,模型不变
+ */
+bool model_optimize(_3D_Model *model, uint32_t cacheSize, _3D_OptimizeReport *report)
+{
+    _3D_OptimizeReport ret;
+    uint32_t i;
+
+    if (!model || model->planeTotal < 1)
+        return false;
+    if (cacheSize < 1)
+        cacheSize = OPTIMIZE_CACHE_SIZE;
+
+    ret.acmrBefore = model_acmr(model, cacheSize, &ret.atvrBefore);
+    ret.cluster = optimize_model(model, cacheSize);
+    ret.acmrAfter = model_acmr(model, cacheSize, &ret.atvrAfter);
+    for (i = 0; i < model->lodTotal; i++)
+    {
+        if (model->lod[i] && model->lod[i]->planeTotal > 0)
+            optimize_model(model->lod[i], cacheSize);
+    }
+
+    if (report)
+        *report = ret;
+    return true;
+}
@@ -0,0 +1,51 @@
+/*
+ *  模型图元排序优化: 按 Tipsify 算法重排三角平面提高顶点缓存命中率,再按簇由外向内排序减少重复绘制,
+ *  最后按首次使用的顺序重排顶点,使抓拍时顶点数组的访问基本连续
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_OPTIMIZE_H_
+#define _3D_OPTIMIZE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "3d_model.h"
+
+// 排序时假设的顶点缓存大小(先进先出),也是 model_acmr 的默认缓存大小
+#define OPTIMIZE_CACHE_SIZE 16
+
+// 簇的三角平面数下限,太小的簇法向量不稳定,并入下一个簇
+#define OPTIMIZE_CLUSTER_MIN 32
+
+// 优化前后的统计
+typedef struct _3DOptimizeReport
+{
+    float acmrBefore, acmrAfter; //平均每个三角平面的缓存未命中数(0.5~3,越小越好)
+    float atvrBefore, atvrAfter; //缓存未命中数与顶点数之比(>=1,越接近1越好)
+    uint32_t cluster;            //重排重复绘制时分成的簇数
+} _3D_OptimizeReport;
+
+/*
+ *  按先进先出的顶点缓存模拟三角平面的绘制,统计未命中数
+ *  参数:
+ *      cacheSize: 缓存大小,传0时用 OPTIMIZE_CACHE_SIZE
+ *      atvr: 不为NULL时返回未命中数与被引用顶点数之比
+ *
+ *  返回: 平均每个三角平面的未命中数(ACMR), 0/模型没有三角平面
+ */
+float model_acmr(_3D_Model *model, uint32_t cacheSize, float *atvr);
+
+/*
+ *  重排三角平面和顶点(细节层次一并优化),图元的形状、颜色不变,导入模型时自动调用
+ *  线条和注释只更新顶点序号,顺序不变; 量化编码的模型会先还原为浮点编码
+ *  参数:
+ *      cacheSize: 缓存大小,传0时用 OPTIMIZE_CACHE_SIZE
+ *      report: 不为NULL时返回原模型优化前后的统计
+ *
+ *  返回: false/模型没有三角平面,模型不变
+ */
+bool model_optimize(_3D_Model *model, uint32_t cacheSize, _3D_OptimizeReport *report);
+
+#endif
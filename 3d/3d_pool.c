@@ -0,0 +1,153 @@
+/*
+ *  常驻线程池,用于把一批互不相关的任务分摊到多个核心上并行执行
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "3d_pool.h"
+
+//领取并执行任务,直到本轮任务全部被领取
+static void pool_work(_3D_Pool *pool, PoolTask task, void *argv, uint32_t total)
+{
+    uint32_t index;
+    while ((index = __sync_fetch_and_add(&pool->next, 1)) < total)
+        task(argv, index);
+}
+
+// 工作线程
+static void pool_thread(void *argv)
+{
+    _3D_Pool *pool = (_3D_Pool *)argv;
+    uint32_t round = 0;
+    PoolTask task;
+    void *taskArgv;
+    uint32_t total;
+    while (1)
+    {
+        //等待新一轮任务
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->exit && pool->round == round)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->exit)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        round = pool->round;
+        task = pool->task;
+        taskArgv = pool->argv;
+        total = pool->total;
+        pthread_mutex_unlock(&pool->lock);
+        //干活
+        pool_work(pool, task, taskArgv, total);
+        //报告完成
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0)
+            pthread_cond_signal(&pool->condDone);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*
+ *  线程池初始化
+ *  参数:
+ *      threadTotal: 并行线程总数(含调用者线程),传0时按CPU核心数
+ *
+ *  返回: 线程池指针, threadTotal 为1时不创建工作线程,任务全部在调用者线程执行
+ */
+_3D_Pool *pool_init(uint32_t threadTotal)
+{
+    _3D_Pool *pool;
+    long cpus;
+    uint32_t i;
+    //按CPU核心数
+    if (threadTotal < 1)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threadTotal = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    pool = (_3D_Pool *)calloc(1, sizeof(_3D_Pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pthread_cond_init(&pool->condDone, NULL);
+    //调用者线程也参与干活,所以少开一个
+    pool->threadTotal = threadTotal - 1;
+    if (pool->threadTotal > 0)
+    {
+        pool->th = (pthread_t *)calloc(pool->threadTotal, sizeof(pthread_t));
+        for (i = 0; i < pool->threadTotal; i++)
+            pthread_create(&pool->th[i], NULL, (void *)&pool_thread, pool);
+    }
+    return pool;
+}
+
+/*
+ *  并行执行 total 个任务,阻塞直到全部完成(调用者线程也参与执行)
+ *  注意: 同一个线程池同一时间只能有一个调用者,且不能在任务回调里嵌套调用
+ *  参数:
+ *      task: 任务回调,每个序号只会被调用一次,执行顺序不确定
+ *      argv: 传给任务回调的参数
+ *      total: 任务数量
+ */
+void pool_run(_3D_Pool *pool, PoolTask task, void *argv, uint32_t total)
+{
+    uint32_t index;
+    //没有工作线程或只有一个任务,直接在本线程执行
+    if (pool->threadTotal < 1 || total < 2)
+    {
+        for (index = 0; index < total; index++)
+            task(argv, index);
+        return;
+    }
+    //发布新一轮任务
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->argv = argv;
+    pool->total = total;
+    pool->next = 0;
+    pool->running = pool->threadTotal;
+    pool->round += 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    //自己也干活
+    pool_work(pool, task, argv, total);
+    //等待工作线程完成
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0)
+        pthread_cond_wait(&pool->condDone, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// 并行线程总数(含调用者线程)
+uint32_t pool_threads(_3D_Pool *pool)
+{
+    return pool->threadTotal + 1;
+}
+
+// 内存销毁
+void pool_release(_3D_Pool **pool)
+{
+    uint32_t i;
+    if (pool && (*pool))
+    {
+        //结束线程
+        pthread_mutex_lock(&(*pool)->lock);
+        (*pool)->exit = true;
+        pthread_cond_broadcast(&(*pool)->cond);
+        pthread_mutex_unlock(&(*pool)->lock);
+        for (i = 0; i < (*pool)->threadTotal; i++)
+            pthread_join((*pool)->th[i], NULL);
+        if ((*pool)->th)
+            free((*pool)->th);
+        pthread_cond_destroy(&(*pool)->cond);
+        pthread_cond_destroy(&(*pool)->condDone);
+        pthread_mutex_destroy(&(*pool)->lock);
+        free(*pool);
+        *pool = NULL;
+    }
+}
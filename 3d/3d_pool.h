@@ -0,0 +1,64 @@
+/*
+ *  常驻线程池,用于把一批互不相关的任务分摊到多个核心上并行执行
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_POOL_H_
+#define _3D_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ *  任务回调
+ *  参数:
+ *      argv: pool_run 传入的参数
+ *      index: 任务序号,范围[0, total)
+ */
+typedef void (*PoolTask)(void *argv, uint32_t index);
+
+typedef struct _3DPool
+{
+    pthread_t *th;        //工作线程(不含调用者线程)
+    uint32_t threadTotal; //工作线程数量
+    pthread_mutex_t lock;
+    pthread_cond_t cond;     //通知工作线程有新一轮任务
+    pthread_cond_t condDone; //通知调用者本轮任务完成
+
+    PoolTask task; //本轮任务
+    void *argv;
+    uint32_t total;   //本轮任务数量
+    uint32_t next;    //下一个待领取的任务序号(原子操作)
+    uint32_t running; //本轮仍在工作的线程数量
+    uint32_t round;   //轮次,工作线程据此判断是否有新任务
+    bool exit;        //线程回收标志
+} _3D_Pool;
+
+/*
+ *  线程池初始化
+ *  参数:
+ *      threadTotal: 并行线程总数(含调用者线程),传0时按CPU核心数
+ *
+ *  返回: 线程池指针, threadTotal 为1时不创建工作线程,任务全部在调用者线程执行
+ */
+_3D_Pool *pool_init(uint32_t threadTotal);
+
+/*
+ *  并行执行 total 个任务,阻塞直到全部完成(调用者线程也参与执行)
+ *  注意: 同一个线程池同一时间只能有一个调用者,且不能在任务回调里嵌套调用
+ *  参数:
+ *      task: 任务回调,每个序号只会被调用一次,执行顺序不确定
+ *      argv: 传给任务回调的参数
+ *      total: 任务数量
+ */
+void pool_run(_3D_Pool *pool, PoolTask task, void *argv, uint32_t total);
+
+// 并行线程总数(含调用者线程)
+uint32_t pool_threads(_3D_Pool *pool);
+
+// 内存销毁
+void pool_release(_3D_Pool **pool);
+
+#endif
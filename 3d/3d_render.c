@@ -0,0 +1,266 @@
+/*
+ *  屏幕空间图元的分块(tile)绘制: 先把投影后的图元按屏幕分块归类,再由线程池并行绘制各块
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "3d_render.h"
+#include "2d_draw.h"
+
+// 初始化
+_3D_Render *render_init(void)
+{
+    return (_3D_Render *)calloc(1, sizeof(_3D_Render));
+}
+
+// 开始新一帧,清空上一帧的图元(不清空 rgbMap 和 depthMap)
+void render_begin(_3D_Render *render, uint8_t *rgbMap, float *depthMap, uint32_t width, uint32_t height)
+{
+    render->rgbMap = rgbMap;
+    render->depthMap = depthMap;
+    render->width = width;
+    render->height = height;
+    render->primTotal = 0;
+}
+
+//取一个新图元(内存不够时加倍扩容)
+static _3D_RenderPrim *render_prim_new(_3D_Render *render)
+{
+    if (render->primTotal >= render->primMax)
+    {
+        render->primMax = render->primMax ? render->primMax * 2 : 256;
+        render->prim = (_3D_RenderPrim *)realloc(render->prim, render->primMax * sizeof(_3D_RenderPrim));
+        render->allocs += 1;
+    }
+    return &render->prim[render->primTotal++];
+}
+
+/*
+ *  计算坐标点的包围盒并限制在屏幕内
+ *  参数:
+ *      xy[2 * count]: 屏幕坐标
+ *      box[4]: 返回 xMin,yMin,xMax,yMax
+ *
+ *  返回: false/完全在屏幕外
+ */
+static bool render_box(_3D_Render *render, float *xy, uint32_t count, int32_t box[4])
+{
+    float xMin, xMax, yMin, yMax;
+    uint32_t c;
+    xMin = xMax = xy[0];
+    yMin = yMax = xy[1];
+    for (c = 2; c < count * 2; c += 2)
+    {
+        if (xy[c] < xMin)
+            xMin = xy[c];
+        if (xy[c] > xMax)
+            xMax = xy[c];
+        if (xy[c + 1] < yMin)
+            yMin = xy[c + 1];
+        if (xy[c + 1] > yMax)
+            yMax = xy[c + 1];
+    }
+    //注意 NaN 也在这里被排除
+    if (!(xMax >= 0 && yMax >= 0 && xMin < render->width && yMin < render->height))
+        return false;
+    box[0] = xMin > 0 ? (int32_t)xMin : 0;
+    box[1] = yMin > 0 ? (int32_t)yMin : 0;
+    box[2] = xMax < render->width - 1 ? (int32_t)xMax : (int32_t)render->width - 1;
+    box[3] = yMax < render->height - 1 ? (int32_t)yMax : (int32_t)render->height - 1;
+    return true;
+}
+
+// 提交点
+void render_dot(_3D_Render *render, float xy[2], float depth, uint32_t argbColor, bool draw)
+{
+    _3D_RenderPrim *prim;
+    int32_t box[4];
+    if (!render_box(render, xy, 1, box))
+        return;
+    prim = render_prim_new(render);
+    prim->type = RENDER_DOT;
+    prim->draw = draw;
+    prim->argbColor = argbColor;
+    memcpy(prim->xy, xy, sizeof(float) * 2);
+    prim->depth[0] = depth;
+    memcpy(prim->box, box, sizeof(box));
+}
+
+// 提交直线
+void render_line(_3D_Render *render, float xy[4], float depth[2], uint32_t argbColor)
+{
+    _3D_RenderPrim *prim;
+    int32_t box[4];
+    if (!render_box(render, xy, 2, box))
+        return;
+    prim = render_prim_new(render);
+    prim->type = RENDER_LINE;
+    prim->draw = true;
+    prim->argbColor = argbColor;
+    memcpy(prim->xy, xy, sizeof(float) * 4);
+    memcpy(prim->depth, depth, sizeof(float) * 2);
+    memcpy(prim->box, box, sizeof(box));
+}
+
+// 提交三角形
+void render_triangle(_3D_Render *render, float xy[6], float depth[3], uint32_t argbColor)
+{
+    _3D_RenderPrim *prim;
+    int32_t box[4];
+    if (!render_box(render, xy, 3, box))
+        return;
+    prim = render_prim_new(render);
+    prim->type = RENDER_TRIANGLE;
+    prim->draw = true;
+    prim->argbColor = argbColor;
+    memcpy(prim->xy, xy, sizeof(float) * 6);
+    memcpy(prim->depth, depth, sizeof(float) * 3);
+    memcpy(prim->box, box, sizeof(box));
+}
+
+//绘制单个图元,只写 rect 范围内的像素
+static void render_prim_draw(_3D_Render *render, _3D_RenderPrim *prim, int32_t *rect)
+{
+    uint32_t offset;
+    int32_t x, y;
+    switch (prim->type)
+    {
+    case RENDER_DOT:
+        x = prim->box[0];
+        y = prim->box[1];
+        if (rect && (x < rect[0] || x > rect[2] || y < rect[1] || y > rect[3]))
+            return;
+        offset = y * render->width + x;
+        //被遮挡
+        if (!(prim->depth[0] < render->depthMap[offset]))
+            return;
+        //占用该点
+        render->depthMap[offset] = prim->depth[0];
+        //画点
+        if (prim->draw)
+        {
+            offset *= 3;
+            render->rgbMap[offset++] = (uint8_t)((prim->argbColor >> 16) & 0xFF);
+            render->rgbMap[offset++] = (uint8_t)((prim->argbColor >> 8) & 0xFF);
+            render->rgbMap[offset++] = (uint8_t)(prim->argbColor & 0xFF);
+        }
+        break;
+    case RENDER_LINE:
+        _2d_draw_line_depth(
+            render->rgbMap, render->depthMap,
+            render->width, render->height,
+            prim->xy, prim->depth,
+            prim->argbColor, rect);
+        break;
+    case RENDER_TRIANGLE:
+        _2d_draw_triangle_depth(
+            render->rgbMap, render->depthMap,
+            render->width, render->height,
+            prim->xy, prim->depth,
+            prim->argbColor, rect);
+        break;
+    }
+}
+
+//按包围盒把图元序号归入各分块(两遍扫描: 先计数再填充,块内保持提交顺序)
+static void render_bin(_3D_Render *render)
+{
+    _3D_RenderPrim *prim;
+    uint32_t c, tx, ty, tile;
+    uint32_t total;
+
+    render->tileX = (render->width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    render->tileY = (render->height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    render->tileTotal = render->tileX * render->tileY;
+    if (render->tileTotal > render->tileMax)
+    {
+        render->tileMax = render->tileTotal;
+        render->tileStart = (uint32_t *)realloc(render->tileStart, (render->tileMax + 1) * sizeof(uint32_t));
+        render->tileCursor = (uint32_t *)realloc(render->tileCursor, render->tileMax * sizeof(uint32_t));
+        render->allocs += 2;
+    }
+
+    //计数
+    memset(render->tileCursor, 0, render->tileTotal * sizeof(uint32_t));
+    for (c = 0, prim = render->prim; c < render->primTotal; c++, prim++)
+    {
+        for (ty = prim->box[1] / RENDER_TILE_SIZE; ty <= prim->box[3] / RENDER_TILE_SIZE; ty++)
+            for (tx = prim->box[0] / RENDER_TILE_SIZE; tx <= prim->box[2] / RENDER_TILE_SIZE; tx++)
+                render->tileCursor[ty * render->tileX + tx] += 1;
+    }
+
+    //前缀和得到各块起始位置
+    for (tile = 0, total = 0; tile < render->tileTotal; tile++)
+    {
+        render->tileStart[tile] = total;
+        total += render->tileCursor[tile];
+        render->tileCursor[tile] = render->tileStart[tile];
+    }
+    render->tileStart[render->tileTotal] = total;
+    if (total > render->tileIndexMax)
+    {
+        render->tileIndexMax = total * 2;
+        render->tileIndex = (uint32_t *)realloc(render->tileIndex, render->tileIndexMax * sizeof(uint32_t));
+        render->allocs += 1;
+    }
+
+    //填充
+    for (c = 0, prim = render->prim; c < render->primTotal; c++, prim++)
+    {
+        for (ty = prim->box[1] / RENDER_TILE_SIZE; ty <= prim->box[3] / RENDER_TILE_SIZE; ty++)
+            for (tx = prim->box[0] / RENDER_TILE_SIZE; tx <= prim->box[2] / RENDER_TILE_SIZE; tx++)
+                render->tileIndex[render->tileCursor[ty * render->tileX + tx]++] = c;
+    }
+}
+
+//线程池任务: 绘制一个分块
+static void render_tile(void *argv, uint32_t tile)
+{
+    _3D_Render *render = (_3D_Render *)argv;
+    int32_t rect[4];
+    uint32_t c;
+    rect[0] = (tile % render->tileX) * RENDER_TILE_SIZE;
+    rect[1] = (tile / render->tileX) * RENDER_TILE_SIZE;
+    rect[2] = rect[0] + RENDER_TILE_SIZE - 1;
+    rect[3] = rect[1] + RENDER_TILE_SIZE - 1;
+    for (c = render->tileStart[tile]; c < render->tileStart[tile + 1]; c++)
+        render_prim_draw(render, &render->prim[render->tileIndex[c]], rect);
+}
+
+// 绘制本帧提交的所有图元
+void render_end(_3D_Render *render, _3D_Pool *pool)
+{
+    uint32_t c;
+    //单线程: 按提交顺序直接绘制
+    if (!pool || pool_threads(pool) < 2)
+    {
+        for (c = 0; c < render->primTotal; c++)
+            render_prim_draw(render, &render->prim[c], NULL);
+        return;
+    }
+    //多线程: 分块后各块并行绘制,块与块之间没有共享的像素,无需加锁
+    render_bin(render);
+    pool_run(pool, &render_tile, render, render->tileTotal);
+}
+
+// 内存销毁
+void render_release(_3D_Render **render)
+{
+    if (render && (*render))
+    {
+        if ((*render)->prim)
+            free((*render)->prim);
+        if ((*render)->tileStart)
+            free((*render)->tileStart);
+        if ((*render)->tileCursor)
+            free((*render)->tileCursor);
+        if ((*render)->tileIndex)
+            free((*render)->tileIndex);
+        free(*render);
+        *render = NULL;
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ *  屏幕空间图元的分块(tile)绘制: 先把投影后的图元按屏幕分块归类,再由线程池并行绘制各块
+ *
+ *  address: https://github.com/wexiangis/3d_matrix
+ *  address2: https://gitee.com/wexiangis/matrix_3d
+ */
+#ifndef _3D_RENDER_H_
+#define _3D_RENDER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "3d_pool.h"
+
+// 分块边长,单位:像素
+#define RENDER_TILE_SIZE 32
+
+// 图元类型
+#define RENDER_DOT 0
+#define RENDER_LINE 1
+#define RENDER_TRIANGLE 2
+
+// 屏幕空间图元
+typedef struct _3DRenderPrim
+{
+    uint8_t type;       //图元类型 RENDER_XXX
+    bool draw;          //false时只占用深度不画颜色
+    uint32_t argbColor; //颜色
+    float xy[6];        //屏幕坐标,点/线/三角形分别使用前 2/4/6 个
+    float depth[3];     //各顶点深度(到相机的距离)
+    int32_t box[4];     //已限制在屏幕内的包围盒 xMin,yMin,xMax,yMax
+} _3D_RenderPrim;
+
+typedef struct _3DRender
+{
+    //绘制目标
+    uint8_t *rgbMap;
+    float *depthMap;
+    uint32_t width, height;
+
+    //按提交顺序排列的图元
+    _3D_RenderPrim *prim;
+    uint32_t primTotal, primMax;
+
+    //分块: 第 i 块的图元序号为 tileIndex[tileStart[i] ~ tileStart[i + 1])
+    uint32_t tileX, tileY;  //横纵分块数
+    uint32_t tileTotal, tileMax;
+    uint32_t *tileStart;
+    uint32_t *tileCursor;
+    uint32_t *tileIndex;
+    uint32_t tileIndexMax;
+
+    uint32_t allocs; //累计堆分配(扩容)次数,稳定后每帧应不再增加
+} _3D_Render;
+
+// 初始化
+_3D_Render *render_init(void);
+
+// 开始新一帧,清空上一帧的图元(不清空 rgbMap 和 depthMap)
+void render_begin(_3D_Render *render, uint8_t *rgbMap, float *depthMap, uint32_t width, uint32_t height);
+
+/*
+ *  提交图元,参数同 _2d_draw_xxx_depth
+ *  参数:
+ *      xy: 屏幕坐标
+ *      depth: 各顶点深度(到相机的距离,要求大于0)
+ *      argbColor: 颜色
+ *      draw: (仅点)false时只占用深度不画颜色
+ */
+void render_dot(_3D_Render *render, float xy[2], float depth, uint32_t argbColor, bool draw);
+void render_line(_3D_Render *render, float xy[4], float depth[2], uint32_t argbColor);
+void render_triangle(_3D_Render *render, float xy[6], float depth[3], uint32_t argbColor);
+
+/*
+ *  绘制本帧提交的所有图元
+ *  参数:
+ *      pool: 线程池,置NULL或只有1个线程时按提交顺序直接绘制,
+ *            否则分块后并行绘制,每块只写自己范围内的像素,结果与直接绘制逐像素一致
+ */
+void render_end(_3D_Render *render, _3D_Pool *pool);
+
+// 内存销毁
+void render_release(_3D_Render **render);
+
+#endif
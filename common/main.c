@@ -15,7 +15,7 @@
 #ifdef OUTPUT_FRAME_FOLDER
 #define INTERVAL_MS 200 // 保存帧图片建议每秒5张
 #else
-#define INTERVAL_MS 50
+#define INTERVAL_MS 16 // 显示约60帧/秒,抓拍在两步运动计算之间插值
 #endif
 
 //引擎计算间隔ms
@@ -33,10 +33,10 @@ static _3D_Camera *camera3 = NULL;
 static _3D_Model *model0 = NULL;
 static _3D_Model *model1 = NULL;
 static _3D_Model *model2 = NULL;
-//3个运动控制器(往引擎添加模型后返回的运动控制指针)
-static _3D_Sport *sport0 = NULL;
-static _3D_Sport *sport1 = NULL;
-static _3D_Sport *sport2 = NULL;
+//3个单元句柄(往引擎添加模型后返回,用于读写运动状态)
+static _3D_Handle unit0 = ENGINE_HANDLE_NONE;
+static _3D_Handle unit1 = ENGINE_HANDLE_NONE;
+static _3D_Handle unit2 = ENGINE_HANDLE_NONE;
 //引擎
 static _3D_Engine *engine = NULL;
 
@@ -123,6 +123,7 @@ void key_callback(void *obj, int key, int type)
 
 int main(int argc, char **argv)
 {
+    _3D_Sport sport;
 #ifdef OUTPUT_FRAME_FOLDER
     //3个相机输出的帧序号起始
     int order1 = 1000, order2 = 2000, order3 = 3000;
@@ -134,21 +135,23 @@ int main(int argc, char **argv)
     //引擎启动
     engine_start(engine);
 
-    if (sport1)
+    if (engine_sport_get(engine, unit1, &sport))
     {
         //给模型1 x轴 的初速度,单位:点/秒
-        // sport1->speed[0] = 50;
+        // sport.speed[0] = 50;
         //给模型1 x轴,y轴 的旋转初速度,单位:度/秒
-        sport1->speed_angle[0] = 90;
-        // sport1->speed_angle[1] = 90;
+        sport.speed_angle[0] = 90;
+        // sport.speed_angle[1] = 90;
+        engine_sport_set(engine, unit1, &sport);
     }
 
-    if (sport2)
+    if (engine_sport_get(engine, unit2, &sport))
     {
         //给模型2 z轴 的初速度,单位:点/秒
-        // sport2->speed[1] = 50;
+        // sport.speed[1] = 50;
         //给模型2 z轴 的旋转初速度,单位:度/秒
-        sport2->speed_angle[1] = 90;
+        sport.speed_angle[1] = 90;
+        engine_sport_set(engine, unit2, &sport);
     }
 
     //注册按键回调
@@ -185,7 +188,7 @@ int main(int argc, char **argv)
     //各模块的释放示例
 
     // 先释放 engine,由于其占用着model指针
-    // 添加 model 时返回的 sport 指针属于 engine,会同时被释放掉
+    // 添加 model 时返回的句柄随之失效
     engine_release(&engine);
 
     // 释放模型
@@ -232,37 +235,45 @@ void all_init(void)
     model0 = model_line_add3(model0, 0x008000, 0, 50, 0, 0, -50, 0); //绿色Y轴
     model0 = model_line_add3(model0, 0x000080, 0, 0, 50, 0, 0, -50); //蓝色Z轴
 
-    //模型1初始化: 长方体
+    //模型1初始化: 长方体(三角平面顶点从外面看均为逆时针,开启背面剔除)
     model1 = model_plane_add3(model1, 0xFF0000, 10, 20, 30, -10, 20, 30, -10, -20, 30);
     model1 = model_plane_add3(model1, 0xFF0000, 10, 20, 30, -10, -20, 30, 10, -20, 30);
-    model1 = model_plane_add3(model1, 0x00FF00, 10, 20, 30, -10, 20, 30, -10, 20, -30);
-    model1 = model_plane_add3(model1, 0x00FF00, 10, 20, 30, -10, 20, -30, 10, 20, -30);
+    model1 = model_plane_add3(model1, 0x00FF00, 10, 20, 30, -10, 20, -30, -10, 20, 30);
+    model1 = model_plane_add3(model1, 0x00FF00, 10, 20, 30, 10, 20, -30, -10, 20, -30);
     model1 = model_plane_add3(model1, 0x0000FF, 10, 20, 30, 10, -20, 30, 10, -20, -30);
     model1 = model_plane_add3(model1, 0x0000FF, 10, 20, 30, 10, -20, -30, 10, 20, -30);
-    model1 = model_plane_add3(model1, 0xFFFF00, -10, -20, 30, 10, -20, 30, 10, -20, -30);
-    model1 = model_plane_add3(model1, 0xFFFF00, -10, -20, 30, 10, -20, -30, -10, -20, -30);
+    model1 = model_plane_add3(model1, 0xFFFF00, -10, -20, 30, 10, -20, -30, 10, -20, 30);
+    model1 = model_plane_add3(model1, 0xFFFF00, -10, -20, 30, -10, -20, -30, 10, -20, -30);
     model1 = model_plane_add3(model1, 0x00FFFF, -10, -20, 30, -10, 20, 30, -10, 20, -30);
     model1 = model_plane_add3(model1, 0x00FFFF, -10, -20, 30, -10, 20, -30, -10, -20, -30);
-    model1 = model_plane_add3(model1, 0xFF00FF, -10, -20, -30, 10, -20, -30, 10, 20, -30);
-    model1 = model_plane_add3(model1, 0xFF00FF, -10, -20, -30, 10, 20, -30, -10, 20, -30);
+    model1 = model_plane_add3(model1, 0xFF00FF, -10, -20, -30, 10, 20, -30, 10, -20, -30);
+    model1 = model_plane_add3(model1, 0xFF00FF, -10, -20, -30, -10, 20, -30, 10, 20, -30);
 
-    //模型2初始化: 三棱柱
+    //模型2初始化: 三棱柱(同上)
     model2 = model_plane_add3(model2, 0xFFFF00, 20, 0, 20, -10, 17.3, 20, -10, -17.3, 20);
-    model2 = model_plane_add3(model2, 0x00FFFF, 20, 0, -20, -10, 17.3, -20, -10, -17.3, -20);
-    model2 = model_plane_add3(model2, 0xFF0000, 20, 0, 20, -10, 17.3, 20, -10, 17.3, -20);
-    model2 = model_plane_add3(model2, 0xFF0000, 20, 0, 20, -10, 17.3, -20, 20, 0, -20);
+    model2 = model_plane_add3(model2, 0x00FFFF, 20, 0, -20, -10, -17.3, -20, -10, 17.3, -20);
+    model2 = model_plane_add3(model2, 0xFF0000, 20, 0, 20, -10, 17.3, -20, -10, 17.3, 20);
+    model2 = model_plane_add3(model2, 0xFF0000, 20, 0, 20, 20, 0, -20, -10, 17.3, -20);
     model2 = model_plane_add3(model2, 0x00FF00, 20, 0, 20, -10, -17.3, 20, -10, -17.3, -20);
     model2 = model_plane_add3(model2, 0x00FF00, 20, 0, 20, -10, -17.3, -20, 20, 0, -20);
-    model2 = model_plane_add3(model2, 0x0000FF, -10, 17.3, 20, -10, -17.3, 20, -10, -17.3, -20);
-    model2 = model_plane_add3(model2, 0x0000FF, -10, 17.3, 20, -10, -17.3, -20, -10, 17.3, -20);
+    model2 = model_plane_add3(model2, 0x0000FF, -10, 17.3, 20, -10, -17.3, -20, -10, -17.3, 20);
+    model2 = model_plane_add3(model2, 0x0000FF, -10, 17.3, 20, -10, 17.3, -20, -10, -17.3, -20);
+
+    //合并重复顶点,每个顶点只需变换一次
+    model_weld(model1);
+    model_weld(model2);
+
+    //封闭的实体模型,背面不可见
+    model_cull(model1, MODEL_CULL_BACK);
+    model_cull(model2, MODEL_CULL_BACK);
 
     //引擎初始化: 建立 250 x 250 x 250 三维空间
     engine = engine_init(ENGINE_INTERVAL_MS, 250, 250, 250);
 
-    //往引擎添加模型,得到模型的运动控制器
-    sport0 = engine_model_add(engine, model0, NULL, NULL); //这是xyz坐标轴,放到空间原点处
-    sport1 = engine_model_add(engine, model1, model1_xyz, model1_roll_xyz);
-    sport2 = engine_model_add(engine, model2, model2_xyz, model2_roll_xyz);
+    //往引擎添加模型,得到单元句柄
+    unit0 = engine_model_add(engine, model0, NULL, NULL); //这是xyz坐标轴,放到空间原点处
+    unit1 = engine_model_add(engine, model1, model1_xyz, model1_roll_xyz);
+    unit2 = engine_model_add(engine, model2, model2_xyz, model2_roll_xyz);
 }
 
 #elif 1 //随机平面三角形填充测试